@@ -0,0 +1,165 @@
+#include <filesystem>
+#include <fstream>
+#include <queue>
+#include <random>
+
+#include "SyntheticSite.h"
+
+namespace fs = std::filesystem;
+using std::string;
+using std::vector;
+
+namespace
+{
+const char *words[] = {"garden", "log", "metal", "forge", "river", "lantern", "signal", "copper", "orbit", "ember",
+                       "harbor", "quartz", "meadow", "cipher", "thread", "canvas", "summit", "static", "willow", "engine"};
+
+void WriteText(const fs::path &path, const string &text, size_t &bytes)
+{
+    fs::create_directories(path.parent_path());
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << text;
+    bytes += text.size();
+}
+
+string PageName(size_t index)
+{
+    string number = std::to_string(index);
+    return "page" + string(number.size() < 5 ? 5 - number.size() : 0, '0') + number;
+}
+
+string Templates(size_t nesting)
+{
+    string text =
+        "# $ChildList(items,columnCount)\n<div class=\"childlist\" style=\"grid-template-columns: repeat($$columnCount$$,auto);\">\n$$items$$\n</div>\n#\n\n"
+        "# $ChildListItem(name)\n<div><a href=\"$$name$$.html\"><figure><img alt=\"$$name$$\" src=\"/links/images/$$name$$.png\"></figure><caption>$$name$$</caption></a>\n</div>\n#\n\n"
+        "# $NavigList(items)\n<div class=\"NavigList\">$$items$$\n<div class=\"NavigItem\"><a href=\"Sitemap.html\">Sitemap</a></div>\n</div>\n#\n\n"
+        "# $NavigItem(name)\n<div class=\"NavigItem\"><a href=\"$$name$$.html\">$$name$$</a></div>\n#\n\n"
+        "# $TreeMap(map)\n<div class=\"tree-container\">\n<ul class=\"tree\">\n<li>\n$$map$$\n</li>\n</ul>\n</div>\n#\n\n"
+        "# $TreeMapTitle1(name,childMap)\n<li class=\"TreeTopLevel\">\n<label for=\"$$name$$\"><a href=\"$$name$$.html\">$$name$$</a></label>\n<ul>\n$$childMap$$\n</ul>\n</li>\n#\n\n"
+        "# $TreeMapTitle2(name,childMap)\n<li>\n<label for=\"$$name$$\"><a href=\"$$name$$.html\">$$name$$</a></label>\n<ul>\n$$childMap$$\n</ul>\n</li>\n#\n\n"
+        "# $Header():\n<!DOCTYPE html>\n<html>\n<head>\n<title>bench - $PageName()$ </title>\n</head>\n<body>\n$NavigList()$\n<div class=\"bodyContainer\">\n#\n\n"
+        "# $Footer():\n</div>\n<footer><p>synthetic</p></footer>\n</body>\n</html>\n#\n\n";
+
+    // Nest0 is plain markup, every NestK wraps Nest(K-1)
+    text += "# $Nest0(title,text)\n<div class=\"card\"><h2>$$title$$</h2><p>$$text$$</p></div>\n#\n\n";
+    for (size_t level = 1; level < nesting; level++)
+    {
+        auto inner = std::to_string(level - 1);
+        text += "# $Nest" + std::to_string(level) + "(title,text)\n<section class=\"level" + std::to_string(level) + "\">$Nest" + inner +
+                "($$title$$,$$text$$)$</section>\n#\n\n";
+    }
+    return text;
+}
+
+string Sentence(std::mt19937 &random, size_t count)
+{
+    std::uniform_int_distribution<size_t> pick(0, std::size(words) - 1);
+    string text;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i != 0)
+            text += ' ';
+        text += words[pick(random)];
+    }
+    return text;
+}
+
+string BodyLine(std::mt19937 &random, size_t nesting)
+{
+    std::uniform_int_distribution<int> kind(0, 9);
+    switch (kind(random))
+    {
+    case 0:
+        return "# " + Sentence(random, 4);
+    case 1:
+        return "> " + Sentence(random, 12);
+    case 2:
+        return "```" + Sentence(random, 6) + "```";
+    case 3:
+        return "/hline";
+    case 4:
+        if (nesting > 0)
+            return "$Nest" + std::to_string(nesting - 1) + "(" + Sentence(random, 2) + "," + Sentence(random, 10) + ")$";
+        [[fallthrough]];
+    case 5:
+        return Sentence(random, 6) + " **" + Sentence(random, 2) + "** " + Sentence(random, 6) + " *" + Sentence(random, 1) + "* /nl";
+    default:
+        return Sentence(random, 16);
+    }
+}
+} // namespace
+
+SyntheticSite GenerateSyntheticSite(const string &root, const SyntheticSiteOptions &options)
+{
+    SyntheticSite site;
+    fs::path rootPath(root);
+    fs::remove_all(rootPath);
+
+    fs::path content = rootPath / "content";
+    site.config.contentDir = content.string();
+    site.config.outputDir = (rootPath / "site").string();
+    site.config.layoutPath = (content / "directives" / "layout.md").string();
+    site.config.templatesPath = (content / "directives" / "templates.md").string();
+    site.config.warningsFile = (rootPath / "warnings.txt").string();
+
+    // Breadth first, every page takes up to fanout children until the page budget or depth runs out
+    struct Pending
+    {
+        size_t index;
+        size_t level;
+    };
+    vector<vector<size_t>> children(1);
+    std::queue<Pending> open;
+    open.push({0, 0});
+    size_t count = 1;
+    while (!open.empty() && count < options.pages)
+    {
+        auto current = open.front();
+        open.pop();
+        if (current.level >= options.depth)
+            continue;
+        for (size_t i = 0; i < options.fanout && count < options.pages; i++)
+        {
+            children[current.index].push_back(count);
+            children.emplace_back();
+            open.push({count, current.level + 1});
+            count++;
+        }
+    }
+
+    string layout;
+    for (size_t i = 0; i < children.size(); i++)
+    {
+        site.pages.push_back(PageName(i));
+        // The root always gets a heading, it names the start page
+        if (children[i].empty() && i != 0)
+            continue;
+        layout += "##" + PageName(i) + "\n";
+        for (auto child : children[i])
+            layout += "#" + PageName(child) + "\n";
+        layout += "\n";
+    }
+    WriteText(site.config.layoutPath, layout, site.bytes);
+    WriteText(site.config.templatesPath, Templates(options.nesting), site.bytes);
+
+    std::mt19937 random(options.seed);
+    for (size_t i = 0; i < site.pages.size(); i++)
+    {
+        string page = "$Header()$\n";
+        if (i == 0)
+            page += "$TreeMap()$\n";
+        else if (!children[i].empty())
+            page += "$ChildList(4)$\n";
+
+        for (size_t line = 0; line < options.bodyLines; line++)
+        {
+            auto body = BodyLine(random, options.nesting);
+            page += body + "\n";
+            site.bodyLines.push_back(std::move(body));
+        }
+        page += "$Footer()$\n";
+        WriteText(content / (site.pages[i] + ".md"), page, site.bytes);
+    }
+    return site;
+}
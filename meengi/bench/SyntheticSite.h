@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "GeneratorConfig.h"
+
+// Shape of a generated site, the same options always produce the same files
+struct SyntheticSiteOptions
+{
+    size_t pages = 200;
+    size_t depth = 4;     // levels below the root page
+    size_t fanout = 8;    // children per page
+    size_t nesting = 3;   // templates call each other this many levels deep
+    size_t bodyLines = 200;
+    uint32_t seed = 1;
+};
+
+struct SyntheticSite
+{
+    GeneratorConfig config;
+    // Pages in layout order, names only
+    std::vector<std::string> pages;
+    // Markdown lines of every page body, handy as parser input
+    std::vector<std::string> bodyLines;
+    size_t bytes = 0;
+};
+
+// Writes content/, layout.md and templates.md under root (which is wiped first)
+SyntheticSite GenerateSyntheticSite(const std::string &root, const SyntheticSiteOptions &options);
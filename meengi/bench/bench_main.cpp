@@ -0,0 +1,389 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "GeneratorConfig.h"
+#include "LayoutParser.h"
+#include "TemplateParser.h"
+#include "ShortHandParser.h"
+#include "BlockParser.h"
+#include "DelimiterSet.h"
+#include "FileHelpers.h"
+#include "Generator.h"
+#include "SyntheticSite.h"
+
+namespace fs = std::filesystem;
+using std::string;
+using std::vector;
+
+namespace
+{
+struct BenchOptions
+{
+    SyntheticSiteOptions site;
+    size_t repeats = 5;
+    string filter;
+    string label;
+    string outPath;
+    string workDir = (fs::temp_directory_path() / "meengi_bench").string();
+};
+
+struct BenchResult
+{
+    string name;
+    size_t ops = 0;   // operations per run
+    size_t bytes = 0; // input bytes per run
+    vector<double> runs;
+};
+
+void PrintUsage(const char *exe)
+{
+    std::cout << "Usage: " << exe << " [options]\n\n"
+              << "Options:\n"
+              << "  --pages <n>        Pages in the synthetic site (default 200)\n"
+              << "  --depth <n>        Layout levels below the root page (default 4)\n"
+              << "  --fanout <n>       Children per page (default 8)\n"
+              << "  --nesting <n>      Depth of nested template calls (default 3)\n"
+              << "  --body-lines <n>   Markdown lines per page (default 200)\n"
+              << "  --seed <n>         Seed for the generated text (default 1)\n"
+              << "  --repeats <n>      Timed runs per benchmark (default 5)\n"
+              << "  --filter <text>    Only run benchmarks whose name contains text\n"
+              << "  --label <text>     Stored in the report, e.g. the commit being measured\n"
+              << "  --out <file>       Write the JSON report to file instead of stdout\n"
+              << "  --work-dir <path>  Where the synthetic site is generated\n";
+}
+
+bool ParseArguments(int argc, char **argv, BenchOptions &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (i + 1 >= argc)
+            return false;
+        string value = argv[++i];
+
+        size_t number = 0;
+        if (arg != "--filter" && arg != "--label" && arg != "--out" && arg != "--work-dir")
+        {
+            try
+            {
+                number = std::stoul(value);
+            }
+            catch (const std::exception &)
+            {
+                return false;
+            }
+        }
+
+        if (arg == "--pages")
+            options.site.pages = std::max<size_t>(number, 1);
+        else if (arg == "--depth")
+            options.site.depth = number;
+        else if (arg == "--fanout")
+            options.site.fanout = number;
+        else if (arg == "--nesting")
+            options.site.nesting = number;
+        else if (arg == "--body-lines")
+            options.site.bodyLines = number;
+        else if (arg == "--seed")
+            options.site.seed = static_cast<uint32_t>(number);
+        else if (arg == "--repeats")
+            options.repeats = std::max<size_t>(number, 1);
+        else if (arg == "--filter")
+            options.filter = value;
+        else if (arg == "--label")
+            options.label = value;
+        else if (arg == "--out")
+            options.outPath = value;
+        else if (arg == "--work-dir")
+            options.workDir = value;
+        else
+            return false;
+    }
+    return true;
+}
+
+class BenchRunner
+{
+private:
+    const BenchOptions &options;
+
+public:
+    vector<BenchResult> results;
+
+    BenchRunner(const BenchOptions &options) : options(options)
+    {
+    }
+
+    // One untimed warm-up run, then options.repeats timed runs of fn
+    void Run(const string &name, size_t ops, size_t bytes, const std::function<void()> &fn)
+    {
+        if (!options.filter.empty() && name.find(options.filter) == string::npos)
+            return;
+
+        BenchResult result;
+        result.name = name;
+        result.ops = std::max<size_t>(ops, 1);
+        result.bytes = bytes;
+
+        fn();
+        for (size_t i = 0; i < options.repeats; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            fn();
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            result.runs.push_back(elapsed.count());
+        }
+        std::sort(result.runs.begin(), result.runs.end());
+
+        std::cerr << name << ": " << result.runs[result.runs.size() / 2] / 1e6 << " ms per run" << std::endl;
+        results.push_back(std::move(result));
+    }
+};
+
+string JsonString(const string &text)
+{
+    string out = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if (static_cast<unsigned char>(c) < 0x20)
+            continue;
+        out += c;
+    }
+    return out + "\"";
+}
+
+string Report(const BenchOptions &options, const SyntheticSite &site, const vector<BenchResult> &results)
+{
+    std::ostringstream out;
+    out << "{\n"
+        << "  \"format\": \"meengi-bench 1\",\n"
+        << "  \"label\": " << JsonString(options.label) << ",\n"
+        << "  \"site\": {\"pages\": " << site.pages.size() << ", \"depth\": " << options.site.depth
+        << ", \"fanout\": " << options.site.fanout << ", \"nesting\": " << options.site.nesting
+        << ", \"body_lines\": " << options.site.bodyLines << ", \"seed\": " << options.site.seed
+        << ", \"bytes\": " << site.bytes << "},\n"
+        << "  \"results\": [";
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const auto &result = results[i];
+        double median = result.runs[result.runs.size() / 2];
+        double seconds = median / 1e9;
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"name\": " << JsonString(result.name)
+            << ", \"repeats\": " << result.runs.size()
+            << ", \"ops\": " << result.ops
+            << ", \"median_ns\": " << static_cast<uint64_t>(median)
+            << ", \"min_ns\": " << static_cast<uint64_t>(result.runs.front())
+            << ", \"max_ns\": " << static_cast<uint64_t>(result.runs.back())
+            << ", \"ns_per_op\": " << median / result.ops;
+        if (result.bytes != 0 && seconds > 0)
+            out << ", \"mb_per_s\": " << result.bytes / seconds / 1e6;
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+    return out.str();
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    BenchOptions options;
+    if (!ParseArguments(argc, argv, options))
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    auto site = GenerateSyntheticSite(options.workDir, options.site);
+    LayoutParser layout(site.config.layoutPath);
+    BenchRunner runner(options);
+
+    size_t bodyBytes = 0;
+    for (const auto &line : site.bodyLines)
+        bodyBytes += line.size();
+
+    // Parsers on their own, fed with the generated markdown
+    ShortHandParser shortHandParser;
+    string out;
+    runner.Run("shorthand_parse", site.bodyLines.size(), bodyBytes, [&]()
+               {
+        for (const auto &line : site.bodyLines)
+        {
+            out.clear();
+            shortHandParser.Parse(line, out);
+        } });
+
+    runner.Run("block_parse", site.bodyLines.size(), bodyBytes, [&]()
+               {
+        out.clear();
+        BlockParser blocks(out);
+        for (const auto &line : site.bodyLines)
+            blocks.Feed(line);
+        blocks.Finish(); });
+
+    // Pathological lines: runs of delimiters a backtracking matcher chokes on. Both parsers are linear,
+    // so the 1024k runs should take about four times the 256k ones.
+    const vector<std::pair<string, string>> patterns = {
+        {"stars", "*"}, {"bold", "**a"}, {"italic", "*a"}, {"ticks", "`"}, {"fences", "```a"}, {"mixed", "*a**b`c#/n"}};
+    for (const auto &[name, unit] : patterns)
+    {
+        for (size_t size : {size_t(256) << 10, size_t(1024) << 10})
+        {
+            string line;
+            while (line.size() < size)
+                line += unit;
+            line.resize(size);
+            string suffix = "_pathological_" + name + "_" + std::to_string(size >> 10) + "k";
+            runner.Run("shorthand" + suffix, 1, size, [&]()
+                       {
+                out.clear();
+                shortHandParser.Parse(line, out); });
+            runner.Run("block" + suffix, 1, size, [&]()
+                       {
+                out.clear();
+                BlockParser blocks(out);
+                blocks.Feed(line);
+                blocks.Finish(); });
+        }
+    }
+
+    TemplateParser templateParser(site.config.templatesPath);
+    runner.Run("template_parser_parse", site.bodyLines.size(), bodyBytes, [&]()
+               {
+        RenderContext context;
+        context.layout = &layout.GetTree();
+        context.node = layout.GetStartNode();
+        for (const auto &line : site.bodyLines)
+        {
+            out.clear();
+            templateParser.Parse(line, context, out);
+        } });
+
+    // <p>$$text$$</p><a href="$$link$$">$$text$$</a>
+    Template card(vector<int>{0, 1, 0}, vector<string>{"<p>", "</p><a href=\"", "\">", "</a>"});
+    vector<std::string_view> cardArgs = {"some paragraph text for the card", "page00042.html"};
+    const size_t expansions = 10000;
+    runner.Run("template_expand", expansions, 0, [&]()
+               {
+        for (size_t i = 0; i < expansions; i++)
+        {
+            out.clear();
+            card.Parse(cardArgs, out);
+        } });
+
+    vector<string> inputs;
+    size_t inputBytes = 0;
+    for (const auto &page : site.pages)
+    {
+        inputs.push_back((fs::path(site.config.contentDir) / (page + ".md")).string());
+        inputBytes += fs::file_size(inputs.back());
+    }
+    runner.Run("get_lines_from_file", inputs.size(), inputBytes, [&]()
+               {
+        for (const auto &input : inputs)
+            GetLinesFromFile(input); });
+    runner.Run("mapped_file_lines", inputs.size(), inputBytes, [&]()
+               {
+        size_t lines = 0;
+        for (const auto &input : inputs)
+        {
+            MappedFile file(input);
+            LineReader reader(file.Text());
+            std::string_view line;
+            while (reader.Next(line))
+                lines++;
+        }
+        out.assign(lines % 2, ' '); });
+
+    // Delimiter scanning on the largest page: every stop of the shorthand scanner, found with
+    // find_first_of and with DelimiterSet at each level the CPU has
+    string largest;
+    for (const auto &input : inputs)
+    {
+        if (fs::file_size(input) > largest.size())
+        {
+            std::ifstream file(input, std::ios::binary);
+            largest.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+    }
+    const string shorthandStops = "*`#/\n\r";
+    size_t stops = 0;
+    runner.Run("delimiter_scan_find_first_of", 1, largest.size(), [&]()
+               {
+        stops = 0;
+        for (auto pos = largest.find_first_of(shorthandStops); pos != string::npos; pos = largest.find_first_of(shorthandStops, pos + 1))
+            stops++; });
+    auto bestLevel = DelimiterSet::Level();
+    for (auto level : {ScanLevel::Scalar, ScanLevel::Sse2, ScanLevel::Avx2})
+    {
+        DelimiterSet::SetLevel(level);
+        if (DelimiterSet::Level() != level)
+            continue;
+        DelimiterSet delimiters(shorthandStops);
+        runner.Run(string("delimiter_scan_") + DelimiterSet::LevelName(level), stops, largest.size(), [&]()
+                   {
+            size_t found = 0;
+            for (auto pos = delimiters.Find(largest); pos != string::npos; pos = delimiters.Find(largest, pos + 1))
+                found++;
+            out.assign(found % 2, ' '); });
+    }
+    DelimiterSet::SetLevel(bestLevel);
+
+    // Layout tree: parsing layout.md, then a BFS over it and a lookup of every page by name
+    auto layoutBytes = fs::file_size(site.config.layoutPath);
+    runner.Run("layout_parse", site.pages.size(), layoutBytes, [&]()
+               {
+        LayoutParser parsed(site.config.layoutPath);
+        out.assign(parsed.GetTree().Size() % 2, ' '); });
+    runner.Run("layout_walk", site.pages.size(), 0, [&]()
+               {
+        auto &tree = layout.GetTree();
+        vector<Node *> order{tree.Root()};
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            for (auto child : tree.Children(order[i]))
+                order.push_back(child);
+        }
+        size_t found = 0;
+        for (const auto &page : site.pages)
+            found += tree.Find(page) != nullptr;
+        out.assign((order.size() + found) % 2, ' '); });
+
+    // Whole builds the way the CLI runs them
+    auto build = [&](unsigned jobs, bool incremental)
+    {
+        auto config = site.config;
+        config.jobs = jobs;
+        config.incremental = incremental;
+        if (!incremental)
+            ClearPreviousFiles(config.outputDir);
+        Generator generator(config);
+        generator.Render();
+    };
+    runner.Run("build_full", site.pages.size(), inputBytes, [&]()
+               { build(1, false); });
+    runner.Run("build_full_parallel", site.pages.size(), inputBytes, [&]()
+               { build(0, false); });
+    build(1, true);
+    runner.Run("build_noop_incremental", site.pages.size(), inputBytes, [&]()
+               { build(1, true); });
+
+    auto report = Report(options, site, runner.results);
+    if (options.outPath.empty())
+        std::cout << report;
+    else
+        std::ofstream(options.outPath, std::ios::trunc) << report;
+
+    fs::remove_all(options.workDir);
+    return 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "GeneratorConfig.h"
+
+// What the asset stage knows about one file of the assets directory
+struct AssetRecord
+{
+    uint64_t size = 0;
+    int64_t mtime = 0; // source modification time, in ticks of the filesystem clock
+    uint64_t hash = 0;
+    std::string output; // path of the copy, relative to the assets output directory
+};
+
+struct AssetSummary
+{
+    size_t files = 0;     // files under the assets directory
+    size_t copied = 0;    // files copied by this build
+    size_t unchanged = 0; // files whose copy was already up to date
+};
+
+// Mirrors GeneratorConfig::assetsDir into assetsOutputDir before pages are rendered, one per Generator.
+// Files whose size and mtime match the previous build are not even read; the others are hashed and
+// only copied when the hash changed or the copy is missing. Copies are spread over GeneratorConfig::jobs
+// workers and written next to the target first, then renamed. With fingerprintAssets the copy of
+// images/a.png is images/a.<hash>.png; copies left over from older builds are removed.
+class AssetPipeline
+{
+private:
+    std::map<std::string, AssetRecord> assets;
+    std::string url;
+    std::string sourceDir; // set by Link, assets are then looked up on disk
+    bool enabled = false;
+
+public:
+    AssetPipeline();
+
+    // previous holds the records of the last build (paths relative to the assets directory),
+    // current receives the records of this one
+    AssetSummary Sync(const GeneratorConfig &config, const std::map<std::string, AssetRecord> &previous, std::map<std::string, AssetRecord> &current);
+
+    // Resolves $Asset$ to the unfingerprinted URL of the file in the assets directory itself, without
+    // copying or hashing anything. Used by --serve, which serves the assets directory as is.
+    void Link(const GeneratorConfig &config);
+
+    // URL of the asset at path (relative to the assets directory) for $Asset(path)$, false if there is no such asset
+    // (url is then the unfingerprinted one). Without an asset stage url is path as is.
+    bool Resolve(const std::string &path, std::string &url) const;
+    // Forgets the assets of the last Sync, $Asset$ then resolves to the path as is
+    void Reset();
+};
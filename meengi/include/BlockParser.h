@@ -0,0 +1,55 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// Block-level markdown (--block-markdown), the alternative to ShortHandParser's line by line shorthands.
+// A state machine fed the expanded lines of a page one after the other, so blocks can span lines:
+//   #..###### text   heading <h1>..<h6>, one line
+//   ``` [lang]       fenced code up to the next ``` line, escaped and copied as is
+//   - item, * item, + item, 1. item   list items, later lines without a marker continue the item
+//   > text           blockquote, consecutive lines form one
+//   <tag ...         a line starting with a tag is HTML and passed through (with its inline shorthands)
+//   /hline           a line of its own becomes the horizontal rule
+//   anything else    paragraph, up to the next blank line or block
+// Text blocks are collected and expanded once they end: **bold**, *italic*, `code`, /nl and /hline.
+// Every delimiter is paired with the next one of its kind through cursors that only move forward, so a page
+// costs O(n) however its delimiters are laid out; there is no backtracking and no recursion.
+class BlockParser
+{
+private:
+    enum class Block
+    {
+        None,
+        Paragraph,
+        Quote,
+        Item,
+        Code
+    };
+    enum class List
+    {
+        None,
+        Unordered,
+        Ordered
+    };
+
+    std::string &out;
+    Block block = Block::None;
+    List list = List::None;
+    std::string pending; // text of the open paragraph, quote or list item
+
+    void FeedLine(std::string_view line);
+    void CloseBlock();
+    void CloseList();
+
+public:
+    // Blocks are appended to out as soon as they end
+    explicit BlockParser(std::string &out);
+
+    // Next piece of the page, any number of lines. A line break is implied after it.
+    void Feed(std::string_view text);
+    // Ends the open blocks at the end of the page
+    void Finish();
+
+    // Inline shorthands of one block of text, appended to out
+    static void ParseInline(std::string_view text, std::string &out);
+};
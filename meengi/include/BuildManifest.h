@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "RenderContext.h"
+#include "AssetPipeline.h"
+
+class Node;
+class LayoutTree;
+
+// Hashes of everything a page was rendered from on the previous build
+struct PageRecord
+{
+    uint64_t source = 0;
+    uint64_t output = 0; // hash of the HTML written for the page
+    std::map<std::string, uint64_t> templates;
+    std::map<LayoutDependency, uint64_t> layout;
+    std::map<std::string, uint64_t> assets; // hash of the URL each $Asset$ resolved to
+    std::vector<Warning> warnings;
+    std::vector<std::string> terms; // words of the page, with --search-index
+};
+
+// Persisted in the output directory so the next build only re-renders pages whose inputs changed
+class BuildManifest
+{
+public:
+    uint64_t layoutHash = 0;
+    uint64_t templatesHash = 0;
+    uint64_t optionsHash = 0; // options that change the HTML of every page, e.g. --minify
+    std::map<std::string, PageRecord> pages;
+    std::map<std::string, AssetRecord> assets;
+
+    bool Load(const std::string &path);
+    bool Save(const std::string &path) const;
+};
+
+// What the previous build produced. A one-off build loads it from the manifest on disk,
+// --watch keeps it alive between rebuilds.
+struct BuildState
+{
+    BuildManifest manifest;
+    bool loaded = false;
+
+    // When set only the pages in changedSources get their markdown hashed again
+    bool trackSources = false;
+    std::set<std::string> changedSources;
+
+    // When set the expanded lines of every page are kept, so an edited page only expands the lines that
+    // changed. They are dropped when the layout or templates change.
+    bool keepFragments = false;
+    std::map<std::string, PageFragments> fragments;
+};
+
+// Hashes the part of the layout a LayoutDependency refers to.
+// The whole tree is hashed once per hasher since every $TreeMap$ page needs it.
+class LayoutHasher
+{
+private:
+    LayoutTree &layout;
+    Node *startNode;
+    uint64_t treeHash = 0;
+    bool treeHashed = false;
+
+public:
+    LayoutHasher(LayoutTree &layout, Node *startNode);
+    uint64_t Hash(LayoutDependency dependency, Node *node);
+};
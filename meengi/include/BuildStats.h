@@ -0,0 +1,131 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+struct GeneratorConfig;
+class StatsWindow;
+
+// Where build time goes, see --stats
+enum class Phase
+{
+    LayoutParse,
+    TemplateCompile,
+    PageRead,
+    TemplateExpand,
+    ShortHand,
+    Minify,
+    PageWrite,
+    Manifest,
+    Assets,
+    Compress,
+    SearchIndex,
+    Count
+};
+
+enum class Counter
+{
+    Pages,
+    PagesRendered,
+    PagesWritten,
+    PagesUnchanged, // rendered, but the .html already held the same bytes
+    TemplateExpansions,
+    MaxTemplateDepth, // highest number of templates active at once
+    BytesIn,          // markdown read by rendered pages
+    BytesOut,         // HTML written
+    BytesMinified,    // bytes --minify took out of the rendered pages
+    Warnings,
+    TemplateCacheHits,
+    TemplateCacheMisses,
+    AssetsCopied,
+    AssetsUnchanged,
+    PagesCompressed,   // pages whose precompressed variants were (re)written
+    BytesCompressed,   // size of those variants
+    SearchTerms,       // distinct words in the --search-index
+    CompiledTemplates, // templates expanded by code from --emit-cpp instead of read from templates.md
+    SnapshotLoads,     // directive files taken from the snapshot instead of parsed
+    LinesReused,       // lines --watch took from the page's last render instead of expanding them
+    Count
+};
+
+// Build instrumentation behind --stats and --trace.
+// Recording is a no-op until Enable is called, and safe from several threads once it is.
+// It is process wide: generators rendering at the same time add up into the same counters, and a
+// report covers a StatsWindow so one generator's report doesn't clear what another is still counting.
+// Pages and trace events are only kept while a window is open.
+class BuildStats
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static void Enable(bool trace);
+    static void Disable();
+    static bool Enabled();
+    static bool Tracing();
+    static void Reset();
+
+    static void AddPhase(Phase phase, uint64_t nanoseconds, uint64_t calls = 1);
+    static void Add(Counter counter, uint64_t value);
+    static void Max(Counter counter, uint64_t value);
+    static void AddPage(std::string_view name, uint64_t nanoseconds);
+    static void AddTraceEvent(const char *name, std::string_view detail, Clock::time_point start, Clock::time_point end);
+    static uint64_t Get(Counter counter);
+
+    // What was recorded since window opened. The max template depth is the highest seen since Enable.
+    static void PrintSummary(std::ostream &out, const StatsWindow &window);
+    // Chrome trace-event JSON, open it in chrome://tracing or https://ui.perfetto.dev
+    static bool WriteTrace(const std::string &path, const StatsWindow &window);
+    // Prints the summary and writes the trace of window as config asks
+    static void Report(const GeneratorConfig &config, const StatsWindow &window);
+};
+
+// Open for the length of a build, what BuildStats reports through it starts here
+class StatsWindow
+{
+private:
+    friend class BuildStats;
+    uint64_t serial;
+    BuildStats::Clock::time_point start;
+    uint64_t phaseNs[static_cast<size_t>(Phase::Count)];
+    uint64_t phaseCalls[static_cast<size_t>(Phase::Count)];
+    uint64_t counters[static_cast<size_t>(Counter::Count)];
+
+    StatsWindow(const StatsWindow &other);
+    StatsWindow &operator=(const StatsWindow &other);
+
+public:
+    StatsWindow();
+    ~StatsWindow();
+};
+
+// Adds the lifetime of the scope to a phase and, while tracing, emits it as a trace event
+class PhaseTimer
+{
+private:
+    Phase phase;
+    std::string_view detail;
+    bool active;
+    BuildStats::Clock::time_point start;
+
+public:
+    explicit PhaseTimer(Phase phase, std::string_view detail = std::string_view());
+    ~PhaseTimer();
+    // For details only known once the phase ran, detail has to outlive the timer
+    void SetDetail(std::string_view value);
+};
+
+// Trace event only, for spans that are not a phase of their own (a whole page)
+class TraceSpan
+{
+private:
+    const char *name;
+    std::string_view detail;
+    bool active;
+    BuildStats::Clock::time_point start;
+
+public:
+    TraceSpan(const char *name, std::string_view detail = std::string_view());
+    ~TraceSpan();
+};
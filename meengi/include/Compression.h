@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// Precompressed variants of the pages, written next to them for servers that send them as is
+enum class Encoding
+{
+    Gzip, // .gz, needs zlib
+    Zstd  // .zst, needs zstd
+};
+
+// False when meengi was built without the library the encoding needs
+bool EncodingAvailable(Encoding encoding);
+// ".gz" / ".zst"
+const char *EncodingExtension(Encoding encoding);
+const char *EncodingName(Encoding encoding);
+
+// Replaces out with data compressed at the highest level, the output only depends on data
+bool Compress(Encoding encoding, std::string_view data, std::string &out);
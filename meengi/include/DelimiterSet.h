@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+// Instructions DelimiterSet compares with. The best one the CPU has is picked on first use.
+enum class ScanLevel
+{
+    Scalar,
+    Sse2, // 16 bytes per compare
+    Avx2  // 32 bytes per compare
+};
+
+// The bytes a tokenizer stops at, e.g. "*`#/\n\r" for ShortHandParser. std::string_view::find_first_of
+// checks one byte of text at a time against the whole set; Bitmap instead compares 64 bytes of text
+// against each delimiter with SIMD and returns one bit per byte, and Find walks those bitmaps.
+// Single byte searches are better off with string_view::find, which is memchr.
+class DelimiterSet
+{
+private:
+    char delimiters[16];
+    size_t count = 0;
+    bool table[256] = {}; // for the scalar fallback and sets of more than 16 bytes
+
+public:
+    explicit DelimiterSet(std::string_view delimiters);
+
+    // Bit i is set when block[i] is a delimiter. block must hold 64 readable bytes.
+    uint64_t Bitmap(const char *block) const;
+    // Position of the first delimiter at or after from, npos when there is none
+    size_t Find(std::string_view text, size_t from = 0) const;
+
+    static ScanLevel Level();
+    // Caps the level Bitmap uses, to compare implementations. A level the CPU lacks is never used.
+    static void SetLevel(ScanLevel level);
+    static const char *LevelName(ScanLevel level);
+};
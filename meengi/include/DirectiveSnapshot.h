@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "LayoutParser.h"
+#include "TemplateParser.h"
+#include "WarningSink.h"
+
+// layout.md and templates.md as parsed, kept between runs in GeneratorConfig::snapshotPath so that a run whose
+// directive files didn't change maps them in instead of reading them line by line. One binary file:
+//   header     magic, format version, byte order mark, the hash of each directive file, where its section starts
+//              and a checksum of the rest
+//   layout     LayoutTree's flat arrays (nodes, child ids, names) and the warnings raised reading layout.md
+//   templates  every Template with its compiled ops and purity, and the warnings raised reading templates.md
+// A section is only used while its file hashes the same. A snapshot of another version, byte order or one that
+// doesn't check out is ignored, and the next build writes a new one.
+class DirectiveSnapshot
+{
+public:
+    static constexpr uint32_t version = 1;
+
+    // nullptr unless path holds a layout section for layoutHash
+    static std::unique_ptr<LayoutParser> LoadLayout(const std::string &path, uint64_t layoutHash, std::vector<Warning> &warnings);
+    // nullptr unless path holds a templates section for templatesHash
+    static std::unique_ptr<TemplateParser> LoadTemplates(const std::string &path, uint64_t templatesHash, std::vector<Warning> &warnings);
+
+    // Compiled templates (--emit-cpp) need no snapshot, for them only the layout is written
+    static bool Save(const std::string &path, uint64_t layoutHash, const LayoutTree &layout, const std::vector<Warning> &layoutWarnings,
+                     uint64_t templatesHash, const TemplateParser &templates, const std::vector<Warning> &templateWarnings);
+};
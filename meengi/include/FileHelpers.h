@@ -2,22 +2,33 @@
 #include <string>
 #include <vector>
 #include <fstream>
+#include <cstdint>
+#include <string_view>
 
+#include "MappedFile.h"
+#include "WarningSink.h"
+
+// Copies every line, prefer MappedFile::Lines which hands out views into the mapped file
 std::vector<std::string> GetLinesFromFile(const std::string &path, bool ignore_comments = true);
 std::string ExtractBetween(const std::string &target, const std::string &start, const std::string &end);
 std::string ExtractBetween(const std::string &target, const size_t &p_start, const std::string &end);
 std::vector<std::string> TokenizeBetween(const std::string &target, const std::string &tokens);
 
-// writes out warnings to warnings.txt
-void warn(const std::string &warning);
-
 // uses try catch block to avoid crashing
 bool toInt(const std::string &str, int &out);
 
-void ClearPreviousFiles();
-void ClearPreviousWarnings();
+// Removes the .html files directly inside outputDir
+void ClearPreviousFiles(const std::string &outputDir);
+
+// Writes data to a temporary file next to path in a single write and renames it over path,
+// so readers see either the old file or the complete new one. False if any step fails.
+bool WriteFileAtomically(const std::string &path, std::string_view data);
+// Same for a copy of from: a reflink where the filesystem supports it, else copy_file_range, else read/write
+bool CopyFileAtomically(const std::string &from, const std::string &to);
 
 void ReadTemplateTitle(const std::string &iLine, std::string &templateName, std::vector<std::string> &argsList);
+// Same with views into iLine instead of copies, argsList is cleared first so it can be reused
+void ReadTemplateTitle(std::string_view iLine, std::string_view &templateName, std::vector<std::string_view> &argsList);
 void ReadTemplateText(const std::string &input, const std::vector<std::string> &argsList, std::vector<int> &argsOrder, std::vector<std::string> &salamiSlices);
 
 std::string Trim(const std::string &input);
@@ -28,3 +39,10 @@ std::string Trim(const std::string &input);
 
 // Need this to find out how many arguments do we have in a template
 size_t Max(const std::vector<int> &vec);
+
+// 64 bit FNV-1a, only used to detect changes between builds
+uint64_t HashBytes(std::string_view data, uint64_t seed = 14695981039346656037ull);
+// Hash of the whole file, 0 if it can't be read
+uint64_t HashFile(const std::string &path, bool map = true);
+std::string ToHex(uint64_t value);
+bool FromHex(const std::string &str, uint64_t &out);
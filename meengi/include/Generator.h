@@ -0,0 +1,76 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "GeneratorConfig.h"
+#include "LayoutParser.h"
+#include "TemplateParser.h"
+#include "ShortHandParser.h"
+#include "AssetPipeline.h"
+#include "BuildManifest.h"
+#include "WarningSink.h"
+#include "PageRenderer.h"
+
+struct SourceChanges;
+
+// One site: its config, layout, compiled templates, asset stage and warnings file.
+// Generators share nothing, so several sites can be rendered at once from different threads.
+// The layout and templates are read on first use and kept until they are reloaded; renders of
+// a single generator take turns since they write the same output directory and manifest.
+class Generator
+{
+private:
+    GeneratorConfig config;
+    WarningSink warnings;
+    ShortHandParser shortHandParser;
+    AssetPipeline assets;
+
+    // Warnings raised while reading layout.md and templates.md, replayed by every render
+    std::unique_ptr<LayoutParser> layout;
+    std::vector<Warning> layoutWarnings;
+    std::unique_ptr<TemplateParser> templates;
+    std::vector<Warning> templateWarnings;
+
+    // Hashes of layout.md and templates.md when they were loaded, and whether either was parsed since
+    // the snapshot (GeneratorConfig::snapshotPath) was written
+    uint64_t layoutHash = 0;
+    uint64_t templatesHash = 0;
+    bool snapshotStale = false;
+
+    std::mutex loadLock;
+    std::mutex renderLock;
+
+    friend class PageRenderer;
+
+    Generator(const Generator &other);
+    Generator &operator=(const Generator &other);
+
+    void SaveSnapshot();
+
+public:
+    explicit Generator(const GeneratorConfig &config);
+
+    const GeneratorConfig &Config() const;
+    WarningSink &Warnings();
+    LayoutTree &Layout();
+    TemplateParser &Templates();
+
+    // The next render reads layout.md (templates.md) again
+    void ReloadLayout();
+    void ReloadTemplates();
+    // Reloads the directives changes touched, both when it's unknown what changed. Pages rendered
+    // afterwards, by Render or RenderPage, no longer see cached expansions of the old layout.
+    void Reload(const SourceChanges &changes);
+
+    // Renders every page of the layout, see PageRenderer::Render. The warnings file is rewritten from scratch.
+    RenderSummary Render();
+    // Same, but compares against and updates state instead of the manifest on disk (which is still written)
+    RenderSummary Render(BuildState &state);
+
+    // Renders the named page into html without touching the output directory or the warnings file,
+    // false if the layout has no such page. Used by --serve.
+    bool RenderPage(std::string_view name, std::string &html, std::vector<Warning> &pageWarnings);
+    // $Asset(path)$ then links the assets directory itself instead of the copies of a build, see AssetPipeline::Link
+    void LinkAssets();
+};
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <string>
+#include <vector>
+
+#include "Compression.h"
 
 struct GeneratorConfig
 {
@@ -9,7 +12,34 @@ struct GeneratorConfig
     std::string layoutPath = "./content/directives/layout.md";
     std::string templatesPath = "./content/directives/templates.md";
     std::string warningsFile = "warnings.txt";
+    // One JSON object per warning instead of plain text lines
+    bool warningsJson = false;
+    // Number of pages rendered concurrently, 0 picks one per core
+    unsigned jobs = 1;
+    // Keep pages whose inputs did not change since the last build (see BuildManifest)
+    bool incremental = true;
+    // Print per-phase timings and counters after every build (see BuildStats)
+    bool stats = false;
+    // Chrome trace-event JSON written after every build when set
+    std::string tracePath;
+    // Files under assetsDir are mirrored into assetsOutputDir on every build when set (see AssetPipeline)
+    std::string assetsDir;
+    std::string assetsOutputDir;
+    // Put in front of an asset's path by $Asset(path)$
+    std::string assetsUrl;
+    // Copies are named name.<hash>.ext so they can be cached forever
+    bool fingerprintAssets = false;
+    // Collapse whitespace and drop comments in the rendered HTML (see HtmlMinifier)
+    bool minify = false;
+    // Compressed copies written next to every page (page.html.gz, ...), see --precompress
+    std::vector<Encoding> precompress;
+    // Parse pages as block-level markdown instead of line by line shorthands (see BlockParser)
+    bool blockMarkdown = false;
+    // Full-text index of every page written to this path when set (see SearchIndex)
+    std::string searchIndex;
+    // Parsed layout.md and templates.md are kept in this file when set, see DirectiveSnapshot
+    std::string snapshotPath;
+    // mmap pages and directives (see MappedFile). Off for --watch and --serve, which keep running while
+    // the sources are edited: a mapped file truncated in place would kill the process with SIGBUS.
+    bool mapFiles = true;
 };
-
-const GeneratorConfig &GetGeneratorConfig();
-void SetGeneratorConfig(const GeneratorConfig &config);
@@ -0,0 +1,14 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// Optional last stage of rendering (--minify), after ShortHandParser.
+// One left-to-right pass over the page, no DOM: runs of whitespace become a single space (none at the start
+// or end of the page), HTML comments are dropped, and the content of <pre>, <textarea>, <script> and
+// <style> is copied untouched. Quoted attribute values are kept as they are.
+class HtmlMinifier
+{
+public:
+    // Appends the minified html to out and returns the number of bytes it saved
+    static size_t Minify(std::string_view html, std::string &out);
+};
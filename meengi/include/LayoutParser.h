@@ -1,42 +1,121 @@
-#pragma once
-#include <vector>
-#include <string>
-#include <map>
-
-class Node
-{
-public:
-    std::string name;
-    std::vector<Node *> children;
-    Node *parent;
-
-    Node();
-    Node(std::string name, Node *parent = nullptr);
-    void AddChild(Node *child);
-    void Print() const;
-    Node Find(std::string name);
-    void Clean();
-};
-
+#pragma once
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+// Position of a node in LayoutTree's node array
+using NodeId = uint32_t;
+constexpr NodeId NoNode = UINT32_MAX;
+
+// One page of the layout. Nodes don't own anything: the name points into the tree's interned names
+// and the children are a range of the tree's child list, see LayoutTree.
+class Node
+{
+public:
+    std::string_view name;
+    NodeId id = NoNode;
+    NodeId parent = NoNode;
+    uint32_t firstChild = 0;
+    uint32_t childCount = 0;
+
+    Node();
+    explicit Node(std::string_view name);
+};
+
+// Children of a node as Node pointers, iterating it only walks two arrays
+class NodeRange
+{
+private:
+    Node *nodes;
+    const NodeId *first;
+    const NodeId *last;
+
+public:
+    class iterator
+    {
+    private:
+        Node *nodes;
+        const NodeId *cur;
+
+    public:
+        iterator(Node *nodes, const NodeId *cur) : nodes(nodes), cur(cur) {}
+        Node *operator*() const { return nodes + *cur; }
+        iterator &operator++()
+        {
+            ++cur;
+            return *this;
+        }
+        bool operator!=(const iterator &other) const { return cur != other.cur; }
+        bool operator==(const iterator &other) const { return cur == other.cur; }
+    };
+
+    NodeRange(Node *nodes, const NodeId *first, const NodeId *last) : nodes(nodes), first(first), last(last) {}
+    iterator begin() const { return iterator(nodes, first); }
+    iterator end() const { return iterator(nodes, last); }
+    size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+};
+
+// The layout as flat arrays: nodes in BFS order from the home page (pages listed under no PageTitle come last),
+// the children of every node stored next to each other in one id list, and a hash index from name to node.
+// Built once, the tree never changes afterwards so Node pointers stay valid for its lifetime.
+class LayoutTree
+{
+private:
+    friend class DirectiveSnapshot;
+
+    std::vector<Node> nodes;
+    std::vector<NodeId> childIds;
+    std::unique_ptr<char[]> names;
+    std::unordered_map<std::string_view, NodeId> index;
+
+    LayoutTree(const LayoutTree &other);
+    LayoutTree &operator=(const LayoutTree &other);
+
+public:
+    // Nodes in the order they were first listed, edges as parent/child id pairs (a page can be listed more than once)
+    struct Builder
+    {
+        std::vector<std::string> names;
+        std::vector<NodeId> parents;
+        std::vector<std::pair<NodeId, NodeId>> edges;
+        NodeId root = NoNode;
+    };
+
+    LayoutTree();
+    void Build(const Builder &builder);
+
+    // The home page, a placeholder named "Uninitialised" if layout.md names none
+    Node *Root();
+    // nullptr if no page has that name
+    Node *Find(std::string_view name);
+    Node *Parent(const Node *node);
+    // Pages that aren't part of the tree (tests, placeholders) have no children
+    NodeRange Children(const Node *node);
+    size_t Size() const;
+};
+
+// Reads layout.md into a LayoutTree, see Generator for the one a build uses
 class LayoutParser
 {
 private:
-    static LayoutParser *instance;
-    std::map<std::string, Node *> NodeMap;
-
-    Node StartNode;
-
-    void SaveInMap(Node *node, const std::string str);
-    static LayoutParser *GetInstance();
-
-    LayoutParser(const std::string &path);
+    friend class DirectiveSnapshot;
+
+    LayoutTree tree;
+
+    // An empty layout, for DirectiveSnapshot to fill
+    LayoutParser();
+
     LayoutParser(const LayoutParser &other);
     LayoutParser &operator=(const LayoutParser &other);
 
 public:
-    ~LayoutParser();
-    const std::map<std::string, Node *> &GetMap() const;
-    static Node *GetStartNode();
-    static Node *FindNode(const std::string &name);
-    static void Reset();
+    explicit LayoutParser(const std::string &path, bool map = true);
+
+    LayoutTree &GetTree();
+    Node *GetStartNode();
+    Node *FindNode(std::string_view name);
 };
@@ -0,0 +1,84 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Read-only view of a whole file. On POSIX systems the file is mmap'ed so nothing is copied,
+// elsewhere it is read into memory once. The views handed out are valid while the MappedFile lives.
+// A mapped file truncated while it is read raises SIGBUS, so processes that keep running while the
+// sources are edited (--watch, --serve) pass map = false and read every file into memory instead.
+class MappedFile
+{
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::string fallback;
+
+    void Close();
+    bool Read(const std::string &path);
+
+    MappedFile(const MappedFile &other);
+    MappedFile &operator=(const MappedFile &other);
+
+public:
+    MappedFile();
+    explicit MappedFile(const std::string &path, bool map = true);
+    ~MappedFile();
+
+    // Drops the current file, false if path can't be read (the view is then empty).
+    // The file is read into memory rather than mapped when map is false.
+    bool Open(const std::string &path, bool map = true);
+    bool IsOpen() const;
+    std::string_view Text() const;
+
+    // Every line as a view, see LineReader
+    std::vector<std::string_view> Lines(bool ignore_comments = true) const;
+};
+
+// Lines starting with // are comments in every input file
+inline bool IsCommentLine(std::string_view line)
+{
+    return line.size() > 1 && line[0] == '/' && line[1] == '/';
+}
+
+// Walks the lines of a text without copying them
+//     LineReader reader(file.Text());
+//     while (reader.Next(line)) ...
+class LineReader
+{
+private:
+    std::string_view text;
+    size_t pos = 0;
+    size_t lineNumber = 0;
+    bool ignoreComments;
+
+public:
+    explicit LineReader(std::string_view text, bool ignore_comments = true) : text(text), ignoreComments(ignore_comments)
+    {
+    }
+
+    // Same splitting as getline ('\n' only, no empty line after a final '\n')
+    bool Next(std::string_view &line)
+    {
+        while (pos < text.size())
+        {
+            auto end = text.find('\n', pos);
+            if (end == std::string_view::npos)
+                end = text.size();
+            line = text.substr(pos, end - pos);
+            lineNumber++;
+            pos = end + 1;
+
+            if (!ignoreComments || !IsCommentLine(line))
+                return true;
+        }
+        return false;
+    }
+
+    // 1 based number of the line last returned, comment lines are counted too
+    size_t LineNumber() const
+    {
+        return lineNumber;
+    }
+};
@@ -1,27 +1,75 @@
 #pragma once
 #include <fstream>
 
-#include "LayoutParser.h"
+#include "GeneratorConfig.h"
+#include "LayoutParser.h"
 #include "TemplateParser.h"
-#include "ShortHandParser.h"
+#include "ShortHandParser.h"
+#include "RenderContext.h"
+#include "AssetPipeline.h"
+#include "HtmlMinifier.h"
+#include "SearchIndex.h"
+#include "BlockParser.h"
 
-class PageRenderer
-{
+struct PageRecord;
+struct BuildState;
+class BuildManifest;
+class LayoutHasher;
+class Generator;
+
+struct RenderSummary
+{
+    size_t pages = 0;     // pages in the layout
+    size_t rendered = 0;  // pages rendered by this build, the rest were up to date
+    size_t written = 0;   // rendered pages whose .html changed and was rewritten
+    size_t unchanged = 0; // rendered pages whose .html already held the same bytes
+    size_t minifiedBytes = 0; // bytes --minify took out of the rendered pages
+    AssetSummary assets;
+};
+
+// One render of a Generator's site, built by Generator::Render from the generator's loaded parts
+class PageRenderer
+{
 private:
-    static TemplateParser templateParser;
-    static ShortHandParser shortHandParser;
-    static Node *currentNode;
-    static bool templatesInitialised;
+    const GeneratorConfig &config;
+    LayoutTree &layout;
+    TemplateParser &templateParser;
+    const ShortHandParser &shortHandParser;
+    AssetPipeline &assets;
+    WarningSink &warnings;
+
+    PageRenderer(const PageRenderer &other);
+    PageRenderer &operator=(const PageRenderer &other);
 
-    PageRenderer();
-    static std::string GetInputPath(Node *node);
-    static std::string GetOutputPath(Node *node);
-    static std::string InterpretLine(const std::string &iLine);
-    static void EnsureTemplates();
+    std::string GetInputPath(Node *node) const;
+    std::string GetOutputPath(Node *node) const;
+    const std::string &ExpandLine(std::string_view line, size_t lineNumber, RenderContext &context) const;
+    void InterpretLine(std::string_view iLine, size_t lineNumber, RenderContext &context, std::string &out, BlockParser *blocks) const;
+    void RenderPage(RenderContext &context) const;
+    void MinifyPage(RenderContext &context) const;
+    void WriteSearchIndex(const std::vector<Node *> &pages, const BuildManifest &manifest) const;
+    enum class PageWrite
+    {
+        Unchanged,
+        Written,
+        Failed
+    };
+
+    PageWrite WritePage(Node *node, const std::string &html, uint64_t hash, uint64_t previousHash) const;
+    bool PrecompressPage(Node *node, const std::string &html, bool changed) const;
+    std::string GetManifestPath() const;
+    bool IsUpToDate(const PageRecord &record, Node *node, uint64_t source, bool templatesChanged, bool layoutChanged, LayoutHasher &layoutHasher) const;
+    void RemoveStaleOutputs(const std::vector<Node *> &pages) const;
 
 public:
-    static void Render(Node *startNode);
-    static Node *GetCurrent();
-    static void Configure();
-    static void Reset();
+    // Expects the generator's layout and templates to be loaded
+    explicit PageRenderer(Generator &generator);
+
+    // Renders a single page into html without writing anything, its warnings go to pageWarnings
+    void RenderToMemory(Node *node, std::string &html, std::vector<Warning> &pageWarnings) const;
+
+    // Renders every page reachable from startNode, spread over GeneratorConfig::jobs workers.
+    // With GeneratorConfig::incremental only pages whose inputs changed since the last build are rendered.
+    // state holds what the previous build produced, it is loaded from the manifest on disk unless already loaded.
+    RenderSummary Render(Node *startNode, BuildState &state);
 };
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Generator.h"
+#include "SourceWatch.h"
+
+// What a GET answers. Pages come with their cached HTML in body, files only with their path so they can be sent with sendfile.
+struct PreviewResponse
+{
+    int status = 200;
+    std::string contentType;
+    std::shared_ptr<const std::string> body;
+    std::string filePath;
+    uint64_t fileSize = 0;
+
+    // Set when the page was rendered for this request
+    double renderMs = -1;
+    std::vector<Warning> warnings;
+};
+
+// --serve: a small HTTP/1.1 server on 127.0.0.1 for previewing a site without building it.
+// Pages are rendered on their first request from the generator's in-memory layout and templates and kept
+// until a change to their markdown (any page for layout.md or templates.md) drops them, so the first view
+// after an edit costs one page render. Other paths are files under the assets directory or next to the content.
+class PreviewServer
+{
+private:
+    Generator &generator;
+    std::unordered_map<std::string, std::shared_ptr<const std::string>> pages; // rendered HTML by page name
+    size_t renders = 0;
+
+    bool ResolveFile(const std::string &path, PreviewResponse &response) const;
+    void Respond(int client, const std::string &method, const std::string &target, bool keepAlive);
+
+public:
+    // Like SiteWatcher, wants a generator whose config has mapFiles off
+    PreviewServer(Generator &generator);
+
+    // target is the request target as sent, query string included
+    PreviewResponse Get(const std::string &target);
+    // Reloads the directives changes touched and drops the cached pages they can affect,
+    // every page for a directive or when it's unknown what changed
+    void Invalidate(const SourceChanges &changes);
+    // Same for the changed files
+    void Invalidate(const std::set<std::string> &changedPaths);
+    void InvalidateAll();
+    // Pages rendered so far, cache hits don't count
+    size_t Renders() const;
+
+    // Serves until the process is stopped
+    int Run(uint16_t port);
+};
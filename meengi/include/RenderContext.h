@@ -0,0 +1,120 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "WarningSink.h"
+
+class Node;
+class LayoutTree;
+class AssetPipeline;
+
+// Parts of the layout a page's output can depend on
+enum class LayoutDependency
+{
+    Children,  // $ChildList$
+    Ancestors, // $NavigList$
+    Tree,      // $TreeMap$
+    Subtree    // $TreeMapPartial$
+};
+
+// A line of a page after template expansion and what expanding it recorded, see BuildState::fragments
+struct LineFragment
+{
+    std::string expanded;
+    size_t line = 0; // where the line was when it was expanded, its warnings are raised for this line
+    std::vector<Warning> warnings;
+    std::set<std::string, std::less<>> usedTemplates;
+    std::set<LayoutDependency> layoutDependencies;
+};
+
+// The expanded lines of a page, keyed by their markdown
+using PageFragments = std::map<std::string, LineFragment, std::less<>>;
+
+// State of a single page while it is being rendered.
+// Every page gets its own context so pages can be rendered concurrently.
+struct RenderContext
+{
+    Node *node = nullptr;
+
+    // What the page is rendered against, owned by its Generator. Without a layout the layout lists
+    // expand to nothing, without an asset stage $Asset(path)$ is path as is.
+    LayoutTree *layout = nullptr;
+    const AssetPipeline *assets = nullptr;
+
+    // Templates being expanded, innermost last, used to avoid infinite loops
+    std::vector<std::string_view> activeTemplates;
+
+    // Warnings raised while rendering this page, written out in page order once all pages are done
+    std::vector<Warning> warnings;
+
+    // Inputs the page actually used, recorded in the build manifest for incremental builds
+    std::set<std::string, std::less<>> usedTemplates;
+    std::set<LayoutDependency> layoutDependencies;
+    std::set<std::string> usedAssets; // $Asset(path)$ paths
+
+    // Counted for --stats, the timings only while BuildStats is enabled
+    size_t templateExpansions = 0;
+    size_t maxTemplateDepth = 0;
+    uint64_t expandNs = 0;
+    uint64_t shortHandNs = 0;
+    size_t minifiedBytes = 0; // saved by --minify
+
+    // Words of the page for --search-index
+    std::vector<std::string> terms;
+
+    // Set by --watch: lines found in either are taken from there instead of being expanded, expanded
+    // lines are added to fragments. Lines found in previousFragments are moved over to fragments.
+    PageFragments *previousFragments = nullptr;
+    PageFragments *fragments = nullptr;
+
+    // Reused for the template expansion of every line of the page. A PageRenderer hands these on from
+    // page to page on each worker, so expanding stops allocating once they fit the deepest nesting.
+    std::string lineBuffer;
+    std::vector<std::string_view> lineArguments;
+    // Buffers of nested expansions, one per level
+    std::deque<std::string> scratchText;
+    std::deque<std::vector<std::string_view>> scratchArgs;
+    size_t scratchDepth = 0;
+
+    // Rendered HTML of the page
+    std::string output;
+};
+
+// A buffer for the text and one for the arguments of an expansion nested scratchDepth levels deep. Levels are
+// handed out innermost last and reused by the next expansion at the same depth while the context lives.
+class ExpansionScratch
+{
+private:
+    RenderContext &context;
+
+    template <typename T>
+    static T &Level(std::deque<T> &levels, size_t depth)
+    {
+        if (levels.size() <= depth)
+            levels.resize(depth + 1);
+        return levels[depth];
+    }
+
+public:
+    std::string &text;
+    std::vector<std::string_view> &args;
+
+    explicit ExpansionScratch(RenderContext &context)
+        : context(context), text(Level(context.scratchText, context.scratchDepth)), args(Level(context.scratchArgs, context.scratchDepth))
+    {
+        context.scratchDepth++;
+        text.clear();
+        args.clear();
+    }
+    ExpansionScratch(const ExpansionScratch &) = delete;
+    ExpansionScratch &operator=(const ExpansionScratch &) = delete;
+    ~ExpansionScratch()
+    {
+        context.scratchDepth--;
+    }
+};
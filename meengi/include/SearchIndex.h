@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Full-text index of the site (--search-index), one compact JSON file a static page can fetch:
+//   {"version":1,"pages":["index","About",...],"terms":{"word":[0,2,1],...}}
+// Pages are numbered by their position in "pages" (layout order) and every posting list is delta encoded:
+// the first entry is a page number, each later one the distance to the previous, so a client sums as it reads.
+// Tokenize runs in the render workers right behind each page; the term lists are kept in the build manifest,
+// so pages an incremental build skips still end up in the index without being rendered or read again.
+class SearchIndex
+{
+public:
+    // Words of the rendered page, sorted and without duplicates. Text inside tags, comments, <script> and
+    // <style> is left out, entities break words. A word is a run of ASCII letters and digits (lowercased)
+    // or non-ASCII bytes, 2 to 64 bytes long.
+    static void Tokenize(std::string_view html, std::vector<std::string> &terms);
+
+    // The index of pages, terms[i] being the term list of pages[i]
+    static std::string Build(const std::vector<std::string> &pages, const std::vector<const std::vector<std::string> *> &terms);
+};
@@ -1,10 +1,17 @@
-#pragma once
+#pragma once
 #include <string>
-#include <regex>
+#include <string_view>
 
 class ShortHandParser
 {
 public:
     ShortHandParser();
-    std::string Parse(const std::string &iLine);
+    std::string Parse(const std::string &iLine) const;
+
+    // Single pass scanner, appends the expanded line to out
+    void Parse(std::string_view iLine, std::string &out) const;
+
+    // Original regex based implementation.
+    // Kept as the reference engine for golden tests, not used while rendering.
+    std::string ParseRegex(const std::string &iLine) const;
 };
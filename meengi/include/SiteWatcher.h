@@ -0,0 +1,32 @@
+#pragma once
+#include <set>
+#include <string>
+#include <vector>
+
+#include "BuildManifest.h"
+#include "Generator.h"
+#include "SourceWatch.h"
+
+// --watch: keeps the generator's parsed layout, compiled templates and the build state, with every
+// page's expanded lines, in memory and re-renders only the pages an edit affects.
+class SiteWatcher
+{
+private:
+    Generator &generator;
+    BuildState state;
+
+public:
+    // Sources are edited while it runs, so the generator's config should have mapFiles off
+    SiteWatcher(Generator &generator);
+
+    // Full (or manifest based incremental) first build
+    RenderSummary Build();
+    // Rebuild after the given changes, logs how long it took. When it's unknown what changed (inotify dropped
+    // events) the directives are read again and every page's markdown is hashed.
+    RenderSummary Rebuild(const SourceChanges &changes);
+    // Rebuild after the given files changed
+    RenderSummary Rebuild(const std::set<std::string> &changedPaths);
+    RenderSummary RebuildAll();
+    // Build, then block and rebuild whenever something under the content or directive directories changes
+    int Run();
+};
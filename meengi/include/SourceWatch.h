@@ -0,0 +1,44 @@
+#pragma once
+#include <filesystem>
+#include <map>
+#include <set>
+#include <string>
+
+#include "GeneratorConfig.h"
+
+// Which sources of a site an edit touched
+struct SourceChanges
+{
+    bool layout = false;         // layout.md
+    bool templates = false;      // templates.md
+    bool lost = false;           // inotify dropped events, anything may have changed
+    std::set<std::string> pages; // pages whose markdown changed, by name
+
+    // Sorts a changed file by what it is to config's site, other files are ignored
+    void Add(const GeneratorConfig &config, const std::string &path);
+    bool Empty() const;
+};
+
+// inotify on the content directory and the directories holding layout.md and templates.md, shared by
+// --watch and --serve (Linux only). Editors often save through a rename, so whole directories are
+// watched rather than single files. The descriptor is non-blocking, poll it before calling Read.
+class SourceWatch
+{
+private:
+    const GeneratorConfig &config;
+    int fd = -1;
+    std::map<int, std::filesystem::path> watched;
+
+    SourceWatch(const SourceWatch &other);
+    SourceWatch &operator=(const SourceWatch &other);
+
+public:
+    explicit SourceWatch(const GeneratorConfig &config);
+    ~SourceWatch();
+
+    // False (after saying so on stderr) when inotify is unavailable
+    bool Open();
+    int Descriptor() const;
+    // Adds every pending event to changes
+    void Read(SourceChanges &changes);
+};
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "TemplateParser.h"
+
+// Ahead-of-time compilation of templates.md (--emit-cpp). Every template becomes a function of straight-line
+// appends: literal runs are string_view constants, placeholders append their argument under the conditions
+// Template::Parse fills it, invocations with fixed names and arguments call back into the TemplateParser with
+// constant argument arrays, and invocations built from placeholders are assembled in an ExpansionScratch first.
+// The unit ends with the CompiledTemplateSet, linked when the program starts; a Generator uses it instead of
+// reading templates.md as long as templates.md still hashes to templatesHash.
+class TemplateCompiler
+{
+private:
+    static void EmitOps(const Template &temp, const std::vector<TemplateOp> &ops, std::string_view target, std::string_view indent, std::string &out);
+
+public:
+    // C++ source for every template of parser, templatesHash being HashBytes of the templates.md it read
+    static std::string EmitCpp(const TemplateParser &parser, uint64_t templatesHash);
+};
@@ -1,40 +1,232 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 #include <set>
+#include <cstdint>
+#include <memory>
+#include <atomic>
+#include <shared_mutex>
+#include <functional>
+
+#include "RenderContext.h"
 
 class Node;
 
+// Arguments of one expansion: views into the line, compiled template or buffer they were written in.
+// Owns nothing, so handing arguments down a nested expansion never copies them.
+class TemplateArgs
+{
+private:
+    const std::string_view *first = nullptr;
+    size_t count = 0;
+
+public:
+    TemplateArgs() = default;
+    TemplateArgs(const std::string_view *first, size_t count) : first(first), count(count) {}
+    TemplateArgs(const std::vector<std::string_view> &args) : first(args.data()), count(args.size()) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    std::string_view operator[](size_t i) const { return first[i]; }
+    const std::string_view *begin() const { return first; }
+    const std::string_view *end() const { return first + count; }
+};
+
+// One step of a compiled template body
+struct TemplateOp
+{
+    enum class Kind
+    {
+        Literal, // text is copied as is
+        Slot,    // value of the slot-th $$arg$$ placeholder
+        Invoke   // nested $name(args)$
+    };
+
+    Kind kind = Kind::Literal;
+    std::string text;
+    size_t slot = 0;
+
+    // Invoke: name and arguments are resolved while compiling unless the invocation contains placeholders,
+    // then parts holds its literal and slot pieces and it is resolved on every expansion
+    std::string name;
+    std::vector<std::string> args;
+    std::vector<std::string_view> argViews; // views into args, set by Template::Compile
+    std::vector<TemplateOp> parts;
+};
+
+class TemplateParser;
+
+// A template of templates.md turned into C++ by --emit-cpp (see TemplateCompiler). expand appends the
+// template's literals and arguments to out and hands nested invocations back to the parser.
+struct CompiledTemplate
+{
+    using Expand = void (*)(const TemplateParser &parser, TemplateArgs args, RenderContext &context, std::string &out);
+
+    std::string_view name;
+    uint64_t hash; // Template::Hash of the definition
+    bool cacheable;
+    Expand expand;
+};
+
+// Every template of one templates.md. A generated unit links its set when the program starts.
+struct CompiledTemplateSet
+{
+    uint64_t templatesHash; // HashBytes of the templates.md it was generated from
+    const CompiledTemplate *templates;
+    size_t count;
+
+    static void Link(const CompiledTemplateSet *set);
+    // The set linked into this program, nullptr if there is none
+    static const CompiledTemplateSet *Linked();
+};
+
 // First content salami slice + ArgOrder[0]th argument + second content salami slice + ArgOrder[1]th argument ...
+// The body is also compiled once into a list of TemplateOps, so expanding it is a single walk over that list.
+// A copy is compiled again since the ops hold views into their own strings.
+// A template from a CompiledTemplateSet has no ops nor salami, its generated code expands it.
 class Template
 {
 private:
+    friend class TemplateCompiler;
+    friend class DirectiveSnapshot;
+
     std::vector<int> ArgsOrder;
     std::vector<std::string> ContentSalami;
+    std::vector<TemplateOp> Ops;
+    size_t arity = 0;        // arguments the placeholders refer to
+    size_t literalBytes = 0; // size of the salami slices together
+    uint64_t hash = 0;
+    bool cacheable = false;
+    CompiledTemplate::Expand compiled = nullptr;
+
+    void Compile();
+    // Points the invocations' argViews at their args, once Ops stays put
+    void BindArgViews();
 
 public:
     Template();
     Template(const std::vector<int> &argOrder, const std::vector<std::string> &contentSalami);
-    std::string Parse(const std::vector<std::string> &inputArgs);
+    explicit Template(const CompiledTemplate &compiledTemplate);
+    Template(const Template &other);
+    Template &operator=(const Template &other);
+    Template(Template &&other) = default;
+    Template &operator=(Template &&other) = default;
+
+    std::string Parse(TemplateArgs inputArgs) const;
+    // Appends the expansion to out, growing it once to the final size
+    void Parse(TemplateArgs inputArgs, std::string &out) const;
+    // Changes whenever the definition changes, used by incremental builds
+    uint64_t Hash() const;
+
+    const std::vector<TemplateOp> &GetOps() const;
+    // Names of the templates invoked by the body, false if one of the names is built from placeholders
+    bool GetInvokedNames(std::set<std::string> &names) const;
+    // Set by TemplateParser once it knows the expansion only depends on the arguments
+    void SetCacheable(bool value);
+    bool IsCacheable() const;
+    CompiledTemplate::Expand Compiled() const;
+    // Appends what the slot-th placeholder expands to for inputArgs, same rules as Parse
+    void AppendArgument(size_t slot, TemplateArgs inputArgs, std::string &out) const;
+};
+
+// What a pure template expanded to, plus what the expansion recorded in the render context
+struct CachedExpansion
+{
+    std::string output;
+    std::set<std::string, std::less<>> usedTemplates;
+    std::set<LayoutDependency> layoutDependencies;
+    size_t templateExpansions = 0;
+    size_t depth = 0;
+};
+
+// Expansions of pure templates by (name, args) and $TreeMap$ fragments by layout node, shared by every
+// page of a render and kept across renders (--watch) for as long as layout.md hashes the same
+struct ExpansionCache
+{
+    std::shared_mutex lock;
+    std::unordered_map<std::string, CachedExpansion> entries;
+    std::unordered_map<std::string, CachedExpansion> layoutEntries;
+    uint64_t layoutHash = 0;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    bool enabled = true;
 };
 
 class TemplateParser
 {
 private:
-    // used to avoid infinite loops
-    static std::set<std::string> currentTemplates;
+    friend class TemplateCompiler;
+    friend class DirectiveSnapshot;
+
     std::unordered_map<std::string, Template> TemplateMap;
-    std::string ParseTemplate(const std::string &name, const std::vector<std::string> &inputArgs);
+    // TemplateMap by views of its keys, so a name from a line is looked up without building a string
+    std::unordered_map<std::string_view, const Template *> templateIndex;
+    std::unique_ptr<ExpansionCache> cache = std::make_unique<ExpansionCache>();
+    // TreeMapTitle1/2 are pure, so every node's part of a tree map is the same wherever it is shown
+    bool treeFragmentsCacheable = false;
+    // ... and so is TreeMap, the whole map below a node is the same for every page
+    bool treeMapsCacheable = false;
+    size_t compiledCount = 0;
+
+    // Marks the templates whose expansion can be memoized, see MEENGI_USAGE.md
+    void ClassifyTemplates();
+    // Builds templateIndex and works out which tree map parts are cacheable, once TemplateMap is complete
+    void IndexTemplates();
+    bool IsPureOrMissing(const std::string &name) const;
+    const Template *FindTemplate(std::string_view name) const;
+    // Looks key up in entries, on a miss runs expand(RenderContext &, std::string &) in a blank context and
+    // stores the output with what it recorded. Hits don't allocate.
+    template <typename Expand>
+    void Memoize(std::unordered_map<std::string, CachedExpansion> &entries, const std::string &key, RenderContext &context, std::string &out,
+                 const Expand &expand) const;
+
+    // Expansion appends into out, nested invocations never re-scan text that was already expanded
+    void Invoke(std::string_view name, TemplateArgs inputArgs, RenderContext &context, std::string &out) const;
+    void ExpandTemplate(std::string_view name, TemplateArgs inputArgs, RenderContext &context, std::string &out) const;
+    void ExpandOps(const Template &temp, const std::vector<TemplateOp> &ops, TemplateArgs inputArgs, RenderContext &context, std::string &out) const;
+    void ExpandBody(const Template &temp, TemplateArgs inputArgs, RenderContext &context, std::string &out) const;
 
     // Special Parsing functions
-    std::string ParseChildList(Node *node, std::vector<std::string> args);
-    std::string ParseNavigList(Node *node, std::vector<std::string> args);
-    std::string PasrseTreeMap(Node *node, std::vector<std::string> args);
-    std::string ParseTreeMapLevel(Node *node, int lvl);
+    void ParseChildList(Node *node, TemplateArgs args, RenderContext &context, std::string &out) const;
+    void ParseNavigList(Node *node, TemplateArgs args, RenderContext &context, std::string &out) const;
+    void PasrseTreeMap(Node *node, TemplateArgs args, RenderContext &context, std::string &out) const;
+    void ExpandTreeMap(Node *node, TemplateArgs args, RenderContext &context, std::string &out) const;
+    void ParseTreeMapLevel(Node *node, int lvl, RenderContext &context, std::string &out) const;
+    void ExpandTreeMapLevel(Node *node, int lvl, RenderContext &context, std::string &out) const;
 
 public:
+    // Holds no templates
     TemplateParser();
-    TemplateParser(const std::string &templatesPath);
-    std::string Parse(const std::string &iLine);
+    TemplateParser(const std::string &templatesPath, bool map = true);
+    // Takes the templates from generated code, templates.md is not read
+    explicit TemplateParser(const CompiledTemplateSet &compiledTemplates);
+
+    // Hash of the named template's definition, 0 if there is no such template
+    uint64_t GetTemplateHash(const std::string &name) const;
+
+    // Pure templates: no PageName, ChildList, NavigList or TreeMapPartial anywhere below them,
+    // no invocation built from placeholders and not part of a cycle
+    bool IsCacheable(const std::string &name) const;
+    // Starts a render against the layout hashing to layoutHash: resets the hit/miss counters and drops
+    // every memoized expansion if the layout changed since the last render
+    void BeginRender(uint64_t layoutHash);
+    void ClearCache();
+    void EnableCache(bool enabled);
+    uint64_t GetCacheHits() const;
+    uint64_t GetCacheMisses() const;
+
+    // Parses a line outside of any page, PageName and the layout lists expand to nothing
+    std::string Parse(const std::string &iLine) const;
+    // Only reads the parser, so a single parser can serve several pages at once
+    std::string Parse(const std::string &iLine, RenderContext &context) const;
+    // Appends the expanded line to out
+    void Parse(std::string_view iLine, RenderContext &context, std::string &out) const;
+
+    // Number of templates that come from a CompiledTemplateSet
+    size_t GetCompiledCount() const;
+    // Used by generated code: $name(args)$, and an invocation whose text was built in invocation.text
+    void InvokeCompiled(std::string_view name, TemplateArgs args, RenderContext &context, std::string &out) const;
+    void InvokeCompiled(ExpansionScratch &invocation, RenderContext &context, std::string &out) const;
 };
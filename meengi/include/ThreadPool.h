@@ -0,0 +1,51 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of workers, each with its own task queue.
+// A worker drains its own queue from the front and steals from the back of the others once it runs dry.
+class ThreadPool
+{
+private:
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    std::mutex stateLock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t)> *job = nullptr;
+    size_t generation = 0;
+    size_t busyWorkers = 0;
+    bool stopping = false;
+    std::exception_ptr failure;
+
+    void WorkerLoop(size_t id);
+    bool PopTask(size_t id, size_t &task);
+    void RunTasks(size_t id);
+
+    ThreadPool(const ThreadPool &other);
+    ThreadPool &operator=(const ThreadPool &other);
+
+public:
+    explicit ThreadPool(unsigned workers);
+    ~ThreadPool();
+
+    // Runs fn(i) for every i in [0, count) and returns once all of them are done.
+    // The first exception thrown by a task is rethrown here.
+    void ParallelFor(size_t count, const std::function<void(size_t)> &fn);
+    size_t Size() const;
+
+    static unsigned DefaultWorkers();
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// A warning and, when known, the file and line it was raised for
+struct Warning
+{
+    std::string message;
+    std::string file;
+    size_t line = 0; // 1 based, 0 when unknown
+};
+
+// Writes out the warnings of one generator to its warnings file.
+// Warnings are buffered in memory, a warning identical to one already seen since the last
+// Clear is dropped, and the buffer is written out in one go by Flush, once it holds enough
+// warnings, and when the sink is destroyed. Safe to call from several threads.
+class WarningSink
+{
+private:
+    std::mutex lock;
+    std::vector<Warning> pending;
+    std::unordered_set<std::string> seen;
+    std::string path;
+    std::string contentDir;
+    bool json;
+
+    // Expects the lock to be held
+    void WritePending();
+
+    WarningSink(const WarningSink &other);
+    WarningSink &operator=(const WarningSink &other);
+
+public:
+    // Files inside contentDir are shown relative to it
+    WarningSink(const std::string &path, const std::string &contentDir, bool json);
+    ~WarningSink();
+
+    void Add(const Warning &warning);
+    void Flush();
+    // Forgets every warning seen so far and empties the warnings file
+    void Clear();
+    // Text line or JSON object the warnings file gets for a warning
+    std::string Format(const Warning &warning) const;
+};
+
+// Raises a warning: it goes to the innermost WarningCapture, else the innermost WarningScope of the
+// calling thread. Warnings raised outside of both are printed to stderr.
+void warn(const std::string &warning);
+void warn(const Warning &warning);
+
+// While alive, warnings raised on the constructing thread are collected into sink instead of being written out
+class WarningCapture
+{
+private:
+    std::vector<Warning> *previous;
+
+public:
+    WarningCapture(std::vector<Warning> &sink);
+    ~WarningCapture();
+};
+
+// While alive, warnings raised on the constructing thread (and not captured) go to sink
+class WarningScope
+{
+private:
+    WarningSink *previous;
+
+public:
+    WarningScope(WarningSink &sink);
+    ~WarningScope();
+};
+
+// While alive, warnings raised on the constructing thread without a location are attributed to file
+class WarningLocation
+{
+private:
+    std::string file;
+    const std::string *previousFile;
+    size_t previousLine;
+
+    WarningLocation(const WarningLocation &other);
+    WarningLocation &operator=(const WarningLocation &other);
+
+public:
+    WarningLocation(const std::string &file);
+    ~WarningLocation();
+    void SetLine(size_t line);
+};
@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <set>
+#include <vector>
+
+#include "AssetPipeline.h"
+#include "FileHelpers.h"
+#include "ThreadPool.h"
+#include "BuildStats.h"
+
+namespace fs = std::filesystem;
+using std::string;
+using std::vector;
+
+namespace
+{
+// images/a.png -> images/a.0123abcd.png when fingerprinting
+string OutputName(const string &path, uint64_t hash, bool fingerprint)
+{
+    if (!fingerprint)
+        return path;
+    fs::path source(path);
+    string name = source.stem().string() + "." + ToHex(hash).substr(0, 8) + source.extension().string();
+    return (source.parent_path() / name).generic_string();
+}
+
+bool SameFile(const fs::path &path, uint64_t size, uint64_t hash)
+{
+    std::error_code ec;
+    auto existing = fs::file_size(path, ec);
+    return !ec && existing == size && HashFile(path.string()) == hash;
+}
+} // namespace
+
+AssetPipeline::AssetPipeline()
+{
+}
+
+AssetSummary AssetPipeline::Sync(const GeneratorConfig &config, const std::map<string, AssetRecord> &previous, std::map<string, AssetRecord> &current)
+{
+    assets.clear();
+    current.clear();
+    sourceDir.clear();
+    enabled = !config.assetsDir.empty();
+    url = config.assetsUrl;
+
+    AssetSummary summary;
+    if (!enabled)
+        return summary;
+
+    fs::path source(config.assetsDir);
+    fs::path target(config.assetsOutputDir);
+    std::error_code ec;
+
+    vector<string> paths;
+    vector<AssetRecord> records;
+    for (const auto &entry : fs::recursive_directory_iterator(source, ec))
+    {
+        if (!entry.is_regular_file(ec))
+            continue;
+        paths.push_back(entry.path().lexically_relative(source).generic_string());
+        AssetRecord record;
+        record.size = entry.file_size(ec);
+        record.mtime = entry.last_write_time(ec).time_since_epoch().count();
+        records.push_back(record);
+    }
+
+    // A file whose size and mtime didn't move keeps its hash, the rest is hashed (and maybe copied) by the workers
+    vector<size_t> work;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        auto &record = records[i];
+        auto old = previous.find(paths[i]);
+        if (old != previous.end() && old->second.size == record.size && old->second.mtime == record.mtime)
+        {
+            record.hash = old->second.hash;
+            record.output = OutputName(paths[i], record.hash, config.fingerprintAssets);
+            if (record.output == old->second.output && fs::exists(target / record.output, ec))
+                continue;
+        }
+        work.push_back(i);
+    }
+
+    // Failed copies are reported in path order once the workers are done
+    std::atomic<size_t> copied{0};
+    vector<char> failed(work.size(), 0);
+    auto sync = [&](size_t i)
+    {
+        size_t index = work[i];
+        auto &record = records[index];
+        const auto &path = paths[index];
+        TraceSpan span("asset", path);
+
+        auto from = source / path;
+        record.hash = HashFile(from.string(), config.mapFiles);
+        record.output = OutputName(path, record.hash, config.fingerprintAssets);
+        auto to = target / record.output;
+        if (SameFile(to, record.size, record.hash))
+            return;
+
+        std::error_code error;
+        fs::create_directories(to.parent_path(), error);
+        if (CopyFileAtomically(from.string(), to.string()))
+            copied++;
+        else
+            failed[i] = 1;
+    };
+
+    unsigned jobs = config.jobs;
+    if (jobs == 0)
+        jobs = ThreadPool::DefaultWorkers();
+
+    if (jobs > 1 && work.size() > 1)
+    {
+        ThreadPool pool(jobs);
+        pool.ParallelFor(work.size(), sync);
+    }
+    else
+    {
+        for (size_t i = 0; i < work.size(); i++)
+            sync(i);
+    }
+
+    size_t failures = 0;
+    for (size_t i = 0; i < work.size(); i++)
+    {
+        if (failed[i])
+        {
+            // Without size and mtime the next Sync copies the file again, even when its output name is unchanged
+            records[work[i]].size = 0;
+            records[work[i]].mtime = 0;
+            failures++;
+            warn("Could not copy asset " + (source / paths[work[i]]).string() + " to " + (target / records[work[i]].output).string());
+        }
+    }
+
+    // Copies this build no longer produces, e.g. an older fingerprint of a changed file
+    std::set<string> outputs;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        outputs.insert(records[i].output);
+        current[paths[i]] = std::move(records[i]);
+    }
+    for (const auto &[path, record] : previous)
+    {
+        if (outputs.count(record.output) == 0)
+            fs::remove(target / record.output, ec);
+    }
+
+    assets = current;
+    summary.files = paths.size();
+    summary.copied = copied;
+    summary.unchanged = paths.size() - summary.copied - failures;
+    BuildStats::Add(Counter::AssetsCopied, summary.copied);
+    BuildStats::Add(Counter::AssetsUnchanged, summary.unchanged);
+    return summary;
+}
+
+void AssetPipeline::Link(const GeneratorConfig &config)
+{
+    assets.clear();
+    enabled = !config.assetsDir.empty();
+    url = config.assetsUrl;
+    sourceDir = config.assetsDir;
+}
+
+bool AssetPipeline::Resolve(const string &path, string &resolved) const
+{
+    if (!enabled)
+    {
+        resolved = path;
+        return true;
+    }
+
+    string relative = fs::path(path).lexically_normal().generic_string();
+    relative.erase(0, relative.find_first_not_of('/'));
+
+    if (!sourceDir.empty())
+    {
+        resolved = url + relative;
+        std::error_code ec;
+        return fs::is_regular_file(fs::path(sourceDir) / relative, ec);
+    }
+
+    auto found = assets.find(relative);
+    resolved = url + (found == assets.end() ? relative : found->second.output);
+    return found != assets.end();
+}
+
+void AssetPipeline::Reset()
+{
+    assets.clear();
+    url.clear();
+    sourceDir.clear();
+    enabled = false;
+}
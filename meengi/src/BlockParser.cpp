@@ -0,0 +1,428 @@
+#include <algorithm>
+
+#include "BlockParser.h"
+#include "DelimiterSet.h"
+
+using std::string;
+using std::string_view;
+
+namespace
+{
+constexpr size_t npos = string_view::npos;
+constexpr const char *hline = "<div class=\" hrcls\"><hr></ div>";
+const DelimiterSet inlineDelimiters("*`/");
+
+bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+bool IsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+bool IsAlpha(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+string_view TrimStart(string_view text)
+{
+    size_t start = 0;
+    while (start < text.size() && IsSpace(text[start]))
+        start++;
+    return text.substr(start);
+}
+
+string_view TrimEnd(string_view text)
+{
+    while (!text.empty() && IsSpace(text.back()))
+        text.remove_suffix(1);
+    return text;
+}
+
+void AppendEscaped(string_view text, string &out)
+{
+    for (char c : text)
+    {
+        if (c == '&')
+            out += "&amp;";
+        else if (c == '<')
+            out += "&lt;";
+        else if (c == '>')
+            out += "&gt;";
+        else
+            out += c;
+    }
+}
+
+// "- item", "* item", "+ item" or "12. item" / "12) item"; content receives the text after the marker
+bool ListMarker(string_view line, bool &ordered, string_view &content)
+{
+    size_t marker = 0;
+    if (!line.empty() && (line[0] == '-' || line[0] == '*' || line[0] == '+'))
+    {
+        ordered = false;
+        marker = 1;
+    }
+    else
+    {
+        while (marker < line.size() && marker < 9 && IsDigit(line[marker]))
+            marker++;
+        if (marker == 0 || marker >= line.size() || (line[marker] != '.' && line[marker] != ')'))
+            return false;
+        ordered = true;
+        marker++;
+    }
+    if (marker < line.size() && !IsSpace(line[marker]))
+        return false;
+    content = TrimStart(line.substr(marker));
+    return true;
+}
+
+// First match of one kind of inline delimiter at or after a position. The scanner only ever asks for
+// positions further right, so an answer stays good until the scanner passes it, and each kind of
+// delimiter is looked for in every byte of the text once at most.
+class Cursor
+{
+private:
+    size_t at = 0;
+    bool searched = false;
+
+public:
+    template <typename Find>
+    size_t Next(size_t from, Find find)
+    {
+        if (!searched || (at != npos && at < from))
+        {
+            at = find(from);
+            searched = true;
+        }
+        return at;
+    }
+};
+
+// Pairs every opener with the next closer of its kind, the way the old lazy (.*?) patterns did, but only
+// when the closer comes before the closer of the span it sits in, so tags always nest and every closer is
+// reached by the left to right walk.
+class InlineScanner
+{
+private:
+    string_view text;
+    string &out;
+    Cursor ticks;   // `
+    Cursor doubles; // **
+    Cursor singles; // * with no * on either side
+    size_t boldClose = npos;
+    size_t italicClose = npos;
+
+    size_t FindSingle(size_t from) const
+    {
+        for (auto pos = text.find('*', from); pos != npos; pos = text.find('*', pos))
+        {
+            auto end = text.find_first_not_of('*', pos);
+            if (end == npos)
+                end = text.size();
+            if (end - pos == 1 && (pos == 0 || text[pos - 1] != '*'))
+                return pos;
+            pos = end;
+        }
+        return npos;
+    }
+
+    size_t OnStar(size_t pos)
+    {
+        if (pos == boldClose)
+        {
+            out += "</b>";
+            boldClose = npos;
+            return pos + 2;
+        }
+        if (pos == italicClose)
+        {
+            out += "</i>";
+            italicClose = npos;
+            return pos + 1;
+        }
+
+        size_t limit = std::min(boldClose, italicClose);
+        if (pos + 1 < text.size() && text[pos + 1] == '*')
+        {
+            if (boldClose == npos)
+            {
+                auto close = doubles.Next(pos + 2, [&](size_t from)
+                                          { return text.find("**", from); });
+                if (close != npos && close < limit)
+                {
+                    out += "<b>";
+                    boldClose = close;
+                    return pos + 2;
+                }
+            }
+            out += "**";
+            return pos + 2;
+        }
+
+        if (italicClose == npos)
+        {
+            auto close = singles.Next(pos + 1, [&](size_t from)
+                                      { return FindSingle(from); });
+            if (close != npos && close < limit)
+            {
+                out += "<i>";
+                italicClose = close;
+                return pos + 1;
+            }
+        }
+        out += '*';
+        return pos + 1;
+    }
+
+    size_t OnBacktick(size_t pos)
+    {
+        auto close = ticks.Next(pos + 1, [&](size_t from)
+                                { return text.find('`', from); });
+        if (close == npos || close >= std::min(boldClose, italicClose))
+        {
+            out += '`';
+            return pos + 1;
+        }
+        out += "<code>";
+        AppendEscaped(text.substr(pos + 1, close - pos - 1), out);
+        out += "</code>";
+        return close + 1;
+    }
+
+    size_t OnSlash(size_t pos)
+    {
+        if (text.compare(pos, 3, "/nl") == 0)
+        {
+            out += "<br><br>";
+            return pos + 3;
+        }
+        if (text.compare(pos, 6, "/hline") == 0)
+        {
+            out += hline;
+            return pos + 6;
+        }
+        out += '/';
+        return pos + 1;
+    }
+
+public:
+    InlineScanner(string_view text, string &out) : text(text), out(out)
+    {
+    }
+
+    void Run()
+    {
+        size_t pos = 0;
+        while (pos < text.size())
+        {
+            auto next = inlineDelimiters.Find(text, pos);
+            if (next == npos)
+                next = text.size();
+            out.append(text.data() + pos, next - pos);
+            pos = next;
+            if (pos == text.size())
+                break;
+
+            if (text[pos] == '*')
+                pos = OnStar(pos);
+            else if (text[pos] == '`')
+                pos = OnBacktick(pos);
+            else
+                pos = OnSlash(pos);
+        }
+    }
+};
+} // namespace
+
+BlockParser::BlockParser(string &out) : out(out)
+{
+}
+
+void BlockParser::Feed(string_view text)
+{
+    size_t start = 0;
+    while (true)
+    {
+        auto end = text.find('\n', start);
+        auto line = text.substr(start, end == npos ? npos : end - start);
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        FeedLine(line);
+        if (end == npos)
+            break;
+        start = end + 1;
+    }
+}
+
+void BlockParser::FeedLine(string_view line)
+{
+    auto trimmed = TrimEnd(TrimStart(line));
+    if (block == Block::Code)
+    {
+        if (trimmed.compare(0, 3, "```") == 0 && trimmed.find_first_not_of('`') == npos)
+        {
+            out += "</code></pre>\n";
+            block = Block::None;
+            return;
+        }
+        AppendEscaped(line, out);
+        out += '\n';
+        return;
+    }
+
+    if (trimmed.empty())
+    {
+        CloseBlock();
+        CloseList();
+        return;
+    }
+
+    if (trimmed.compare(0, 3, "```") == 0)
+    {
+        CloseBlock();
+        CloseList();
+        auto info = TrimStart(trimmed.substr(trimmed.find_first_not_of('`') == npos ? trimmed.size() : trimmed.find_first_not_of('`')));
+        auto language = info.substr(0, std::min(info.find_first_of(" \t"), info.size()));
+        bool plain = std::all_of(language.begin(), language.end(), [](char c)
+                                 { return IsAlpha(c) || IsDigit(c) || c == '-' || c == '_' || c == '+'; });
+        out += "<pre><code";
+        if (!language.empty() && plain)
+        {
+            out += " class=\"language-";
+            out += language;
+            out += '"';
+        }
+        out += '>';
+        block = Block::Code;
+        return;
+    }
+
+    if (trimmed[0] == '#')
+    {
+        size_t level = trimmed.find_first_not_of('#');
+        if (level == npos)
+            level = trimmed.size();
+        if (level <= 6)
+        {
+            CloseBlock();
+            CloseList();
+            char tag = static_cast<char>('0' + level);
+            out += "<h";
+            out += tag;
+            out += '>';
+            ParseInline(TrimStart(trimmed.substr(level)), out);
+            out += "</h";
+            out += tag;
+            out += ">\n";
+            return;
+        }
+    }
+
+    if (trimmed == "/hline" || (trimmed[0] == '<' && trimmed.size() > 1 && (IsAlpha(trimmed[1]) || trimmed[1] == '/' || trimmed[1] == '!')))
+    {
+        CloseBlock();
+        CloseList();
+        ParseInline(trimmed, out);
+        out += '\n';
+        return;
+    }
+
+    bool ordered = false;
+    string_view content;
+    if (ListMarker(trimmed, ordered, content))
+    {
+        CloseBlock();
+        auto kind = ordered ? List::Ordered : List::Unordered;
+        if (list != kind)
+        {
+            CloseList();
+            out += ordered ? "<ol>\n" : "<ul>\n";
+            list = kind;
+        }
+        block = Block::Item;
+        pending.assign(content.data(), content.size());
+        return;
+    }
+
+    if (trimmed[0] == '>')
+    {
+        content = TrimStart(trimmed.substr(1));
+        if (block == Block::Quote)
+        {
+            pending += '\n';
+            pending += content;
+            return;
+        }
+        CloseBlock();
+        CloseList();
+        block = Block::Quote;
+        pending.assign(content.data(), content.size());
+        return;
+    }
+
+    // Lazy continuation of the open paragraph, quote or list item
+    if (block != Block::None)
+    {
+        pending += '\n';
+        pending += trimmed;
+        return;
+    }
+    CloseList();
+    block = Block::Paragraph;
+    pending.assign(trimmed.data(), trimmed.size());
+}
+
+void BlockParser::CloseBlock()
+{
+    const char *open = nullptr;
+    const char *close = nullptr;
+    switch (block)
+    {
+    case Block::None:
+        return;
+    case Block::Code:
+        out += "</code></pre>\n";
+        block = Block::None;
+        return;
+    case Block::Paragraph:
+        open = "<p>";
+        close = "</p>\n";
+        break;
+    case Block::Quote:
+        open = "<blockquote>";
+        close = "</blockquote>\n";
+        break;
+    case Block::Item:
+        open = "<li>";
+        close = "</li>\n";
+        break;
+    }
+    out += open;
+    ParseInline(pending, out);
+    out += close;
+    pending.clear();
+    block = Block::None;
+}
+
+void BlockParser::CloseList()
+{
+    if (list != List::None)
+        out += list == List::Ordered ? "</ol>\n" : "</ul>\n";
+    list = List::None;
+}
+
+void BlockParser::Finish()
+{
+    CloseBlock();
+    CloseList();
+}
+
+void BlockParser::ParseInline(string_view text, string &out)
+{
+    InlineScanner(text, out).Run();
+}
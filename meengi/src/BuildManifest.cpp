@@ -0,0 +1,226 @@
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "BuildManifest.h"
+#include "FileHelpers.h"
+#include "LayoutParser.h"
+
+using std::string;
+
+namespace
+{
+const char *manifestHeader = "meengi-manifest 3";
+
+const char *DependencyName(LayoutDependency dependency)
+{
+    switch (dependency)
+    {
+    case LayoutDependency::Children:
+        return "children";
+    case LayoutDependency::Ancestors:
+        return "ancestors";
+    case LayoutDependency::Tree:
+        return "tree";
+    case LayoutDependency::Subtree:
+        return "subtree";
+    }
+    return "";
+}
+
+bool DependencyFromName(const string &name, LayoutDependency &out)
+{
+    for (auto dependency : {LayoutDependency::Children, LayoutDependency::Ancestors, LayoutDependency::Tree, LayoutDependency::Subtree})
+    {
+        if (name == DependencyName(dependency))
+        {
+            out = dependency;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t HashSubtree(LayoutTree &layout, Node *node, uint64_t hash)
+{
+    hash = HashBytes(node->name, hash);
+    hash = HashBytes("(", hash);
+    for (auto child : layout.Children(node))
+        hash = HashSubtree(layout, child, hash);
+    return HashBytes(")", hash);
+}
+} // namespace
+
+bool BuildManifest::Load(const string &path)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+        return false;
+
+    string line;
+    if (!getline(file, line) || line != manifestHeader)
+        return false;
+
+    PageRecord *current = nullptr;
+    while (getline(file, line))
+    {
+        auto split = line.find(' ');
+        if (split == string::npos)
+            return false;
+        string key = line.substr(0, split);
+        string value = line.substr(split + 1);
+
+        uint64_t hash = 0;
+        if (key == "page")
+        {
+            current = &pages[value];
+            continue;
+        }
+        else if (key == "layout" || key == "templates" || key == "options")
+        {
+            if (!FromHex(value, hash))
+                return false;
+            (key == "layout" ? layoutHash : key == "templates" ? templatesHash : optionsHash) = hash;
+            continue;
+        }
+        // "file <hash> <size> <mtime> <path>\t<output>"
+        else if (key == "file")
+        {
+            std::istringstream fields(value);
+            string hex;
+            AssetRecord record;
+            fields >> hex >> record.size >> record.mtime;
+            auto pathStart = value.find(' ', value.find(' ', hex.size() + 1) + 1);
+            auto outputStart = value.find('\t');
+            if (!fields || !FromHex(hex, record.hash) || pathStart == string::npos || outputStart == string::npos || outputStart < pathStart)
+                return false;
+            record.output = value.substr(outputStart + 1);
+            assets[value.substr(pathStart + 1, outputStart - pathStart - 1)] = std::move(record);
+            continue;
+        }
+
+        if (current == nullptr)
+            return false;
+
+        // "warning <line> <file>\t<message>"
+        if (key == "warning")
+        {
+            auto fileStart = value.find(' ');
+            auto messageStart = value.find('\t');
+            if (fileStart == string::npos || messageStart == string::npos || messageStart < fileStart)
+                return false;
+
+            Warning warning;
+            warning.line = std::strtoull(value.c_str(), nullptr, 10);
+            warning.file = value.substr(fileStart + 1, messageStart - fileStart - 1);
+            warning.message = value.substr(messageStart + 1);
+            current->warnings.push_back(std::move(warning));
+            continue;
+        }
+
+        // "terms <word> <word> ..."
+        if (key == "terms")
+        {
+            std::istringstream words(value);
+            string word;
+            while (words >> word)
+                current->terms.push_back(word);
+            continue;
+        }
+
+        // The remaining entries are "<key> <hex> <name>"
+        auto nameStart = value.find(' ');
+        string hex = value.substr(0, nameStart);
+        string name = nameStart == string::npos ? "" : value.substr(nameStart + 1);
+        if (!FromHex(hex, hash))
+            return false;
+
+        LayoutDependency dependency;
+        if (key == "source")
+            current->source = hash;
+        else if (key == "output")
+            current->output = hash;
+        else if (key == "template")
+            current->templates[name] = hash;
+        else if (key == "depends" && DependencyFromName(name, dependency))
+            current->layout[dependency] = hash;
+        else if (key == "asset")
+            current->assets[name] = hash;
+        else
+            return false;
+    }
+    return true;
+}
+
+bool BuildManifest::Save(const string &path) const
+{
+    std::ostringstream out;
+    out << manifestHeader << '\n';
+    out << "layout " << ToHex(layoutHash) << '\n';
+    out << "templates " << ToHex(templatesHash) << '\n';
+    out << "options " << ToHex(optionsHash) << '\n';
+    for (const auto &[path, record] : assets)
+        out << "file " << ToHex(record.hash) << ' ' << record.size << ' ' << record.mtime << ' ' << path << '\t' << record.output << '\n';
+
+    for (const auto &[name, record] : pages)
+    {
+        out << "page " << name << '\n';
+        out << "source " << ToHex(record.source) << '\n';
+        out << "output " << ToHex(record.output) << '\n';
+        for (const auto &[templateName, hash] : record.templates)
+            out << "template " << ToHex(hash) << ' ' << templateName << '\n';
+        for (const auto &[dependency, hash] : record.layout)
+            out << "depends " << ToHex(hash) << ' ' << DependencyName(dependency) << '\n';
+        for (const auto &[path, hash] : record.assets)
+            out << "asset " << ToHex(hash) << ' ' << path << '\n';
+        for (const auto &warning : record.warnings)
+            out << "warning " << warning.line << ' ' << warning.file << '\t' << warning.message << '\n';
+        if (!record.terms.empty())
+        {
+            out << "terms";
+            for (const auto &term : record.terms)
+                out << ' ' << term;
+            out << '\n';
+        }
+    }
+
+    return WriteFileAtomically(path, out.str());
+}
+
+LayoutHasher::LayoutHasher(LayoutTree &layout, Node *startNode) : layout(layout), startNode(startNode)
+{
+}
+
+uint64_t LayoutHasher::Hash(LayoutDependency dependency, Node *node)
+{
+    uint64_t hash = HashBytes(DependencyName(dependency));
+    switch (dependency)
+    {
+    case LayoutDependency::Children:
+        for (auto child : layout.Children(node))
+        {
+            hash = HashBytes(child->name, hash);
+            hash = HashBytes("\n", hash);
+        }
+        break;
+    case LayoutDependency::Ancestors:
+        for (auto cur = node; cur != nullptr; cur = layout.Parent(cur))
+        {
+            hash = HashBytes(cur->name, hash);
+            hash = HashBytes("\n", hash);
+        }
+        break;
+    case LayoutDependency::Tree:
+        if (!treeHashed)
+        {
+            treeHash = HashSubtree(layout, startNode, hash);
+            treeHashed = true;
+        }
+        hash = treeHash;
+        break;
+    case LayoutDependency::Subtree:
+        hash = HashSubtree(layout, node, hash);
+        break;
+    }
+    return hash;
+}
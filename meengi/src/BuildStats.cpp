@@ -0,0 +1,352 @@
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "BuildStats.h"
+#include "GeneratorConfig.h"
+
+using std::string;
+using std::vector;
+
+namespace
+{
+const char *phaseNames[] = {"layout parse", "template compile", "page read", "template expand", "shorthand", "minify", "page write", "manifest", "assets", "compress", "search index"};
+const char *counterNames[] = {"pages", "pages rendered", "pages written", "pages unchanged", "template expansions", "max template depth", "bytes in", "bytes out", "bytes saved by minify", "warnings", "template cache hits", "template cache misses", "assets copied", "assets unchanged", "pages compressed", "bytes compressed", "search terms", "compiled templates", "snapshot loads", "lines reused"};
+
+constexpr size_t phaseCount = static_cast<size_t>(Phase::Count);
+constexpr size_t counterCount = static_cast<size_t>(Counter::Count);
+constexpr size_t slowestPages = 5;
+
+// Pages and events are numbered in the order they were recorded, a window reports those from its serial on
+struct PageTime
+{
+    uint64_t serial;
+    uint64_t nanoseconds;
+    string name;
+};
+
+struct TraceEvent
+{
+    uint64_t serial;
+    const char *name;
+    string detail;
+    size_t thread;
+    int64_t start;
+    int64_t duration;
+};
+
+struct StatsState
+{
+    bool enabled = false;
+    bool tracing = false;
+    BuildStats::Clock::time_point origin = BuildStats::Clock::now();
+
+    std::atomic<uint64_t> phaseNs[phaseCount] = {};
+    std::atomic<uint64_t> phaseCalls[phaseCount] = {};
+    std::atomic<uint64_t> counters[counterCount] = {};
+
+    std::mutex lock;
+    uint64_t nextSerial = 0;
+    std::multiset<uint64_t> windows;
+    vector<PageTime> pages;
+    vector<TraceEvent> events;
+};
+
+StatsState &GetState()
+{
+    static StatsState state;
+    return state;
+}
+
+// Small stable ids read better in the trace viewer than std::thread::id
+size_t ThreadId()
+{
+    static std::atomic<size_t> next{1};
+    thread_local size_t id = next++;
+    return id;
+}
+
+// Entries no open window reports anymore, both vectors are in serial order
+template <typename Entry>
+void DropBefore(vector<Entry> &entries, uint64_t serial)
+{
+    auto end = std::partition_point(entries.begin(), entries.end(), [&](const Entry &entry)
+                                    { return entry.serial < serial; });
+    entries.erase(entries.begin(), end);
+}
+
+// Reset in between leaves the counters below what the window saw
+uint64_t Since(uint64_t now, uint64_t then)
+{
+    return now >= then ? now - then : now;
+}
+
+int64_t Microseconds(BuildStats::Clock::duration duration)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+void WriteJsonString(std::ostream &out, std::string_view text)
+{
+    static const char digits[] = "0123456789abcdef";
+    out << '"';
+    for (unsigned char c : text)
+    {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (c < 0x20)
+            out << "\\u00" << digits[c >> 4] << digits[c & 0xf];
+        else
+            out << c;
+    }
+    out << '"';
+}
+} // namespace
+
+void BuildStats::Enable(bool trace)
+{
+    auto &state = GetState();
+    state.enabled = true;
+    state.tracing = trace;
+    Reset();
+}
+
+void BuildStats::Disable()
+{
+    auto &state = GetState();
+    state.enabled = false;
+    state.tracing = false;
+}
+
+bool BuildStats::Enabled()
+{
+    return GetState().enabled;
+}
+
+bool BuildStats::Tracing()
+{
+    return GetState().tracing;
+}
+
+void BuildStats::Reset()
+{
+    auto &state = GetState();
+    for (size_t i = 0; i < phaseCount; i++)
+    {
+        state.phaseNs[i] = 0;
+        state.phaseCalls[i] = 0;
+    }
+    for (auto &counter : state.counters)
+        counter = 0;
+
+    std::lock_guard<std::mutex> guard(state.lock);
+    state.pages.clear();
+    state.events.clear();
+    state.origin = Clock::now();
+}
+
+void BuildStats::AddPhase(Phase phase, uint64_t nanoseconds, uint64_t calls)
+{
+    auto &state = GetState();
+    if (!state.enabled)
+        return;
+    state.phaseNs[static_cast<size_t>(phase)] += nanoseconds;
+    state.phaseCalls[static_cast<size_t>(phase)] += calls;
+}
+
+void BuildStats::Add(Counter counter, uint64_t value)
+{
+    auto &state = GetState();
+    if (state.enabled)
+        state.counters[static_cast<size_t>(counter)] += value;
+}
+
+void BuildStats::Max(Counter counter, uint64_t value)
+{
+    auto &state = GetState();
+    if (!state.enabled)
+        return;
+    auto &current = state.counters[static_cast<size_t>(counter)];
+    uint64_t seen = current.load();
+    while (seen < value && !current.compare_exchange_weak(seen, value))
+    {
+    }
+}
+
+void BuildStats::AddPage(std::string_view name, uint64_t nanoseconds)
+{
+    auto &state = GetState();
+    if (!state.enabled)
+        return;
+
+    std::lock_guard<std::mutex> guard(state.lock);
+    if (!state.windows.empty())
+        state.pages.push_back({state.nextSerial++, nanoseconds, string(name)});
+}
+
+void BuildStats::AddTraceEvent(const char *name, std::string_view detail, Clock::time_point start, Clock::time_point end)
+{
+    auto &state = GetState();
+    if (!state.tracing)
+        return;
+
+    TraceEvent event{0, name, string(detail), ThreadId(), Microseconds(start - state.origin), Microseconds(end - start)};
+    std::lock_guard<std::mutex> guard(state.lock);
+    if (state.windows.empty())
+        return;
+    event.serial = state.nextSerial++;
+    state.events.push_back(std::move(event));
+}
+
+uint64_t BuildStats::Get(Counter counter)
+{
+    return GetState().counters[static_cast<size_t>(counter)];
+}
+
+void BuildStats::PrintSummary(std::ostream &out, const StatsWindow &window)
+{
+    auto &state = GetState();
+    auto flags = out.flags();
+
+    std::chrono::duration<double, std::milli> wall = Clock::now() - window.start;
+    out << std::left << std::setw(22) << "wall time" << std::right << std::setw(12) << std::fixed << std::setprecision(3) << wall.count() << "\n\n";
+    out << std::left << std::setw(22) << "Phase" << std::right << std::setw(12) << "Total ms" << std::setw(10) << "Calls" << '\n';
+    for (size_t i = 0; i < phaseCount; i++)
+    {
+        out << std::left << std::setw(22) << phaseNames[i] << std::right << std::setw(12) << std::fixed << std::setprecision(3)
+            << Since(state.phaseNs[i], window.phaseNs[i]) / 1e6 << std::setw(10) << Since(state.phaseCalls[i], window.phaseCalls[i]) << '\n';
+    }
+
+    out << '\n'
+        << std::left << std::setw(22) << "Counter" << std::right << std::setw(12) << "Value" << '\n';
+    for (size_t i = 0; i < counterCount; i++)
+    {
+        uint64_t value = i == static_cast<size_t>(Counter::MaxTemplateDepth) ? state.counters[i].load() : Since(state.counters[i], window.counters[i]);
+        out << std::left << std::setw(22) << counterNames[i] << std::right << std::setw(12) << value << '\n';
+    }
+
+    // Only the slowest few are listed, slowest first
+    vector<const PageTime *> pages;
+    std::lock_guard<std::mutex> guard(state.lock);
+    for (const auto &page : state.pages)
+    {
+        if (page.serial >= window.serial)
+            pages.push_back(&page);
+    }
+    auto listed = std::min(pages.size(), slowestPages);
+    std::partial_sort(pages.begin(), pages.begin() + listed, pages.end(), [](const PageTime *a, const PageTime *b)
+                      { return a->nanoseconds > b->nanoseconds; });
+    if (listed > 0)
+    {
+        out << '\n'
+            << std::left << std::setw(34) << "Slowest pages" << std::right << std::setw(10) << "ms" << '\n';
+        for (size_t i = 0; i < listed; i++)
+            out << std::left << std::setw(34) << pages[i]->name << std::right << std::setw(10) << std::fixed << std::setprecision(3) << pages[i]->nanoseconds / 1e6 << '\n';
+    }
+    out.flags(flags);
+}
+
+bool BuildStats::WriteTrace(const string &path, const StatsWindow &window)
+{
+    auto &state = GetState();
+    std::ofstream out(path, std::ios::trunc);
+    if (!out.is_open())
+        return false;
+
+    std::lock_guard<std::mutex> guard(state.lock);
+    auto first = std::partition_point(state.events.begin(), state.events.end(), [&](const TraceEvent &event)
+                                      { return event.serial < window.serial; });
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    for (auto it = first; it != state.events.end(); ++it)
+    {
+        const auto &event = *it;
+        out << (it == first ? "\n" : ",\n") << "{\"name\": ";
+        WriteJsonString(out, event.name);
+        out << ", \"cat\": \"meengi\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread
+            << ", \"ts\": " << event.start << ", \"dur\": " << event.duration;
+        if (!event.detail.empty())
+        {
+            out << ", \"args\": {\"page\": ";
+            WriteJsonString(out, event.detail);
+            out << "}";
+        }
+        out << "}";
+    }
+    out << "\n]}\n";
+    return out.good();
+}
+
+void BuildStats::Report(const GeneratorConfig &config, const StatsWindow &window)
+{
+    if (!Enabled())
+        return;
+
+    if (config.stats)
+        PrintSummary(std::cout, window);
+    if (!config.tracePath.empty() && !WriteTrace(config.tracePath, window))
+        std::cerr << "Failed to write trace to " << config.tracePath << std::endl;
+}
+
+StatsWindow::StatsWindow() : start(BuildStats::Clock::now())
+{
+    auto &state = GetState();
+    {
+        std::lock_guard<std::mutex> guard(state.lock);
+        serial = state.nextSerial;
+        state.windows.insert(serial);
+    }
+    for (size_t i = 0; i < phaseCount; i++)
+    {
+        phaseNs[i] = state.phaseNs[i];
+        phaseCalls[i] = state.phaseCalls[i];
+    }
+    for (size_t i = 0; i < counterCount; i++)
+        counters[i] = state.counters[i];
+}
+
+StatsWindow::~StatsWindow()
+{
+    auto &state = GetState();
+    std::lock_guard<std::mutex> guard(state.lock);
+    state.windows.erase(state.windows.find(serial));
+    auto oldest = state.windows.empty() ? state.nextSerial : *state.windows.begin();
+    DropBefore(state.pages, oldest);
+    DropBefore(state.events, oldest);
+}
+
+PhaseTimer::PhaseTimer(Phase phase, std::string_view detail) : phase(phase), detail(detail), active(BuildStats::Enabled())
+{
+    if (active)
+        start = BuildStats::Clock::now();
+}
+
+PhaseTimer::~PhaseTimer()
+{
+    if (!active)
+        return;
+    auto end = BuildStats::Clock::now();
+    BuildStats::AddPhase(phase, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    BuildStats::AddTraceEvent(phaseNames[static_cast<size_t>(phase)], detail, start, end);
+}
+
+void PhaseTimer::SetDetail(std::string_view value)
+{
+    detail = value;
+}
+
+TraceSpan::TraceSpan(const char *name, std::string_view detail) : name(name), detail(detail), active(BuildStats::Tracing())
+{
+    if (active)
+        start = BuildStats::Clock::now();
+}
+
+TraceSpan::~TraceSpan()
+{
+    if (active)
+        BuildStats::AddTraceEvent(name, detail, start, BuildStats::Clock::now());
+}
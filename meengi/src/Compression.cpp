@@ -0,0 +1,95 @@
+#include "Compression.h"
+
+#ifdef MEENGI_HAS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef MEENGI_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace
+{
+#ifdef MEENGI_HAS_ZLIB
+// deflate with a gzip wrapper (window bits + 16); zlib leaves the header's mtime at 0 so equal pages give equal files
+bool Gzip(std::string_view data, std::string &out)
+{
+    z_stream stream{};
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    out.resize(deflateBound(&stream, data.size()));
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    stream.avail_in = data.size();
+    stream.next_out = reinterpret_cast<Bytef *>(&out[0]);
+    stream.avail_out = out.size();
+
+    bool ok = deflate(&stream, Z_FINISH) == Z_STREAM_END;
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return ok;
+}
+#endif
+
+#ifdef MEENGI_HAS_ZSTD
+bool Zstd(std::string_view data, std::string &out)
+{
+    out.resize(ZSTD_compressBound(data.size()));
+    auto size = ZSTD_compress(&out[0], out.size(), data.data(), data.size(), ZSTD_maxCLevel());
+    if (ZSTD_isError(size))
+        return false;
+    out.resize(size);
+    return true;
+}
+#endif
+} // namespace
+
+bool EncodingAvailable(Encoding encoding)
+{
+    switch (encoding)
+    {
+    case Encoding::Gzip:
+#ifdef MEENGI_HAS_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    case Encoding::Zstd:
+#ifdef MEENGI_HAS_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+const char *EncodingExtension(Encoding encoding)
+{
+    return encoding == Encoding::Gzip ? ".gz" : ".zst";
+}
+
+const char *EncodingName(Encoding encoding)
+{
+    return encoding == Encoding::Gzip ? "gzip" : "zstd";
+}
+
+bool Compress(Encoding encoding, std::string_view data, std::string &out)
+{
+    switch (encoding)
+    {
+    case Encoding::Gzip:
+#ifdef MEENGI_HAS_ZLIB
+        return Gzip(data, out);
+#else
+        break;
+#endif
+    case Encoding::Zstd:
+#ifdef MEENGI_HAS_ZSTD
+        return Zstd(data, out);
+#else
+        break;
+#endif
+    }
+    out.clear();
+    return false;
+}
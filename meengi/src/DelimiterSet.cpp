@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "DelimiterSet.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MEENGI_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+constexpr size_t npos = std::string_view::npos;
+constexpr size_t blockSize = 64;
+
+ScanLevel BestLevel()
+{
+#ifdef MEENGI_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return ScanLevel::Avx2;
+    return ScanLevel::Sse2; // part of x86-64
+#else
+    return ScanLevel::Scalar;
+#endif
+}
+
+const ScanLevel bestLevel = BestLevel();
+std::atomic<ScanLevel> level{bestLevel};
+
+uint64_t BitmapScalar(const char *block, const bool *table)
+{
+    uint64_t mask = 0;
+    for (size_t i = 0; i < blockSize; i++)
+        mask |= static_cast<uint64_t>(table[static_cast<unsigned char>(block[i])]) << i;
+    return mask;
+}
+
+#ifdef MEENGI_SCAN_X86
+__attribute__((target("sse2"))) uint64_t BitmapSse2(const char *block, const char *delimiters, size_t count)
+{
+    __m128i chunks[4];
+    __m128i hits[4];
+    for (size_t i = 0; i < 4; i++)
+    {
+        chunks[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16 * i));
+        hits[i] = _mm_setzero_si128();
+    }
+    for (size_t d = 0; d < count; d++)
+    {
+        auto delimiter = _mm_set1_epi8(delimiters[d]);
+        for (size_t i = 0; i < 4; i++)
+            hits[i] = _mm_or_si128(hits[i], _mm_cmpeq_epi8(chunks[i], delimiter));
+    }
+    uint64_t mask = 0;
+    for (size_t i = 0; i < 4; i++)
+        mask |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(hits[i]))) << (16 * i);
+    return mask;
+}
+
+__attribute__((target("avx2"))) uint64_t BitmapAvx2(const char *block, const char *delimiters, size_t count)
+{
+    auto low = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block));
+    auto high = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + 32));
+    auto lowHits = _mm256_setzero_si256();
+    auto highHits = _mm256_setzero_si256();
+    for (size_t d = 0; d < count; d++)
+    {
+        auto delimiter = _mm256_set1_epi8(delimiters[d]);
+        lowHits = _mm256_or_si256(lowHits, _mm256_cmpeq_epi8(low, delimiter));
+        highHits = _mm256_or_si256(highHits, _mm256_cmpeq_epi8(high, delimiter));
+    }
+    return static_cast<uint32_t>(_mm256_movemask_epi8(lowHits)) | static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(highHits))) << 32;
+}
+#endif
+} // namespace
+
+DelimiterSet::DelimiterSet(std::string_view set)
+{
+    for (char c : set)
+    {
+        auto &seen = table[static_cast<unsigned char>(c)];
+        if (seen)
+            continue;
+        seen = true;
+        if (count < sizeof(delimiters))
+            delimiters[count] = c;
+        count++;
+    }
+}
+
+uint64_t DelimiterSet::Bitmap(const char *block) const
+{
+#ifdef MEENGI_SCAN_X86
+    if (count <= sizeof(delimiters))
+    {
+        switch (level.load(std::memory_order_relaxed))
+        {
+        case ScanLevel::Avx2:
+            return BitmapAvx2(block, delimiters, count);
+        case ScanLevel::Sse2:
+            return BitmapSse2(block, delimiters, count);
+        case ScanLevel::Scalar:
+            break;
+        }
+    }
+#endif
+    return BitmapScalar(block, table);
+}
+
+size_t DelimiterSet::Find(std::string_view text, size_t from) const
+{
+    size_t pos = from;
+    for (; pos + blockSize <= text.size(); pos += blockSize)
+    {
+        auto mask = Bitmap(text.data() + pos);
+        if (mask != 0)
+            return pos + __builtin_ctzll(mask);
+    }
+    if (pos >= text.size())
+        return npos;
+
+    // The last partial block is copied so nothing past the end of text is read
+    char tail[blockSize] = {};
+    size_t size = text.size() - pos;
+    std::memcpy(tail, text.data() + pos, size);
+    auto mask = Bitmap(tail) & ((uint64_t(1) << size) - 1);
+    return mask == 0 ? npos : pos + __builtin_ctzll(mask);
+}
+
+ScanLevel DelimiterSet::Level()
+{
+    return level.load(std::memory_order_relaxed);
+}
+
+void DelimiterSet::SetLevel(ScanLevel requested)
+{
+    level.store(std::min(requested, bestLevel), std::memory_order_relaxed);
+}
+
+const char *DelimiterSet::LevelName(ScanLevel scanLevel)
+{
+    switch (scanLevel)
+    {
+    case ScanLevel::Avx2:
+        return "avx2";
+    case ScanLevel::Sse2:
+        return "sse2";
+    case ScanLevel::Scalar:
+        break;
+    }
+    return "scalar";
+}
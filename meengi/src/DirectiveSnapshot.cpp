@@ -0,0 +1,376 @@
+#include <algorithm>
+#include <cstring>
+
+#include "DirectiveSnapshot.h"
+#include "FileHelpers.h"
+#include "MappedFile.h"
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+namespace
+{
+constexpr char magic[8] = {'M', 'E', 'E', 'N', 'G', 'I', 'S', 'N'};
+constexpr uint32_t byteOrder = 0x01020304;
+// Invocations only ever hold literal and slot parts, so ops nest one level deep
+constexpr int maxOpDepth = 2;
+
+// Numbers are stored as they are in memory, the byte order mark keeps a snapshot from another machine out
+class Writer
+{
+public:
+    string out;
+
+    template <typename T>
+    void Number(T value)
+    {
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        out.append(bytes, sizeof(T));
+    }
+
+    void Text(string_view text)
+    {
+        Number<uint32_t>(text.size());
+        out += text;
+    }
+
+    template <typename T>
+    void Array(const vector<T> &values)
+    {
+        Number<uint32_t>(values.size());
+        out.append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+    }
+
+    void Warnings(const vector<Warning> &warnings)
+    {
+        Number<uint32_t>(warnings.size());
+        for (const auto &warning : warnings)
+        {
+            Text(warning.message);
+            Text(warning.file);
+            Number<uint64_t>(warning.line);
+        }
+    }
+
+    void Ops(const vector<TemplateOp> &ops)
+    {
+        Number<uint32_t>(ops.size());
+        for (const auto &op : ops)
+        {
+            Number<uint8_t>(static_cast<uint8_t>(op.kind));
+            Number<uint64_t>(op.slot);
+            Text(op.text);
+            Text(op.name);
+            Number<uint32_t>(op.args.size());
+            for (const auto &arg : op.args)
+                Text(arg);
+            Ops(op.parts);
+        }
+    }
+};
+
+// Reads back what Writer wrote. Every read is bounds checked, a failed one leaves ok false and reads zeros.
+class Reader
+{
+private:
+    string_view data;
+    size_t pos = 0;
+
+public:
+    bool ok = true;
+
+    explicit Reader(string_view data, size_t pos = 0) : data(data), pos(pos)
+    {
+        ok = pos <= data.size();
+    }
+
+    bool Has(size_t bytes) const
+    {
+        return ok && data.size() - pos >= bytes;
+    }
+
+    template <typename T>
+    T Number()
+    {
+        T value{};
+        if (!Has(sizeof(T)))
+        {
+            ok = false;
+            return value;
+        }
+        std::memcpy(&value, data.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+
+    string_view Bytes(size_t size)
+    {
+        if (!Has(size))
+        {
+            ok = false;
+            return {};
+        }
+        auto bytes = data.substr(pos, size);
+        pos += size;
+        return bytes;
+    }
+
+    string_view Text()
+    {
+        return Bytes(Number<uint32_t>());
+    }
+
+    template <typename T>
+    bool Array(vector<T> &values)
+    {
+        auto count = Number<uint32_t>();
+        if (!Has(size_t(count) * sizeof(T)))
+            return ok = false;
+        values.resize(count);
+        std::memcpy(values.data(), data.data() + pos, count * sizeof(T));
+        pos += count * sizeof(T);
+        return true;
+    }
+
+    bool Warnings(vector<Warning> &warnings)
+    {
+        auto count = Number<uint32_t>();
+        for (uint32_t i = 0; i < count && ok; i++)
+        {
+            Warning warning;
+            warning.message = string(Text());
+            warning.file = string(Text());
+            warning.line = Number<uint64_t>();
+            warnings.push_back(std::move(warning));
+        }
+        return ok;
+    }
+
+    bool Ops(vector<TemplateOp> &ops, int depth)
+    {
+        auto count = Number<uint32_t>();
+        if ((count > 0 && depth > maxOpDepth) || !Has(count))
+            return ok = false;
+        ops.resize(count);
+        for (auto &op : ops)
+        {
+            auto kind = Number<uint8_t>();
+            if (kind > static_cast<uint8_t>(TemplateOp::Kind::Invoke))
+                return ok = false;
+            op.kind = static_cast<TemplateOp::Kind>(kind);
+            op.slot = Number<uint64_t>();
+            op.text = string(Text());
+            op.name = string(Text());
+            auto args = Number<uint32_t>();
+            for (uint32_t i = 0; i < args && ok; i++)
+                op.args.emplace_back(Text());
+            if (!ok || !Ops(op.parts, depth + 1))
+                return ok = false;
+        }
+        return ok;
+    }
+};
+
+struct Header
+{
+    uint64_t layoutHash = 0;
+    uint64_t templatesHash = 0;
+    uint64_t layoutSection = 0;
+    uint64_t templatesSection = 0; // 0 when the templates weren't stored
+};
+
+// The header ends with a hash of everything after it, literal text is taken as it is so a flipped byte must not slip through
+constexpr size_t headerSize = sizeof(magic) + 2 * sizeof(uint32_t) + 5 * sizeof(uint64_t);
+
+// Maps path and checks its header
+bool Open(MappedFile &file, const string &path, Header &header)
+{
+    if (path.empty() || !file.Open(path))
+        return false;
+    Reader reader(file.Text());
+    auto mark = reader.Bytes(sizeof(magic));
+    if (!reader.ok || std::memcmp(mark.data(), magic, sizeof(magic)) != 0)
+        return false;
+    if (reader.Number<uint32_t>() != DirectiveSnapshot::version || reader.Number<uint32_t>() != byteOrder)
+        return false;
+    header.layoutHash = reader.Number<uint64_t>();
+    header.templatesHash = reader.Number<uint64_t>();
+    header.layoutSection = reader.Number<uint64_t>();
+    header.templatesSection = reader.Number<uint64_t>();
+    auto checksum = reader.Number<uint64_t>();
+    return reader.ok && HashBytes(file.Text().substr(headerSize)) == checksum;
+}
+
+// Slots must name a placeholder of the template, the interpreter indexes ArgsOrder with them
+bool SlotsFit(const vector<TemplateOp> &ops, size_t slots)
+{
+    for (const auto &op : ops)
+    {
+        if ((op.kind == TemplateOp::Kind::Slot && op.slot >= slots) || !SlotsFit(op.parts, slots))
+            return false;
+    }
+    return true;
+}
+} // namespace
+
+std::unique_ptr<LayoutParser> DirectiveSnapshot::LoadLayout(const string &path, uint64_t layoutHash, vector<Warning> &warnings)
+{
+    MappedFile file;
+    Header header;
+    if (!Open(file, path, header) || header.layoutHash != layoutHash)
+        return nullptr;
+
+    Reader reader(file.Text(), header.layoutSection);
+    auto nodeCount = reader.Number<uint32_t>();
+    auto placeholderRoot = reader.Number<uint8_t>();
+    vector<uint32_t> nodeFields;
+    vector<NodeId> childIds;
+    if (!reader.Array(nodeFields) || !reader.Array(childIds) || nodeCount == 0 || nodeFields.size() != size_t(nodeCount) * 5)
+        return nullptr;
+    auto names = reader.Text();
+    vector<Warning> layoutWarnings;
+    if (!reader.Warnings(layoutWarnings))
+        return nullptr;
+
+    std::unique_ptr<LayoutParser> parser(new LayoutParser());
+    LayoutTree &tree = parser->tree;
+    tree.names.reset(new char[names.size() + 1]);
+    std::copy(names.begin(), names.end(), tree.names.get());
+    tree.childIds = std::move(childIds);
+    tree.nodes.assign(nodeCount, Node());
+    tree.index.clear();
+    tree.index.reserve(nodeCount);
+    for (NodeId id = 0; id < nodeCount; id++)
+    {
+        const uint32_t *fields = nodeFields.data() + size_t(id) * 5;
+        Node &node = tree.nodes[id];
+        if (fields[0] > names.size() || fields[1] > names.size() - fields[0] || (fields[2] != NoNode && fields[2] >= nodeCount) ||
+            fields[3] > tree.childIds.size() || fields[4] > tree.childIds.size() - fields[3])
+            return nullptr;
+        node.name = string_view(tree.names.get() + fields[0], fields[1]);
+        node.id = id;
+        node.parent = fields[2];
+        node.firstChild = fields[3];
+        node.childCount = fields[4];
+        if (id != 0 || !placeholderRoot)
+            tree.index.emplace(node.name, id);
+    }
+    if (std::any_of(tree.childIds.begin(), tree.childIds.end(), [&](NodeId child)
+                    { return child >= nodeCount; }))
+        return nullptr;
+
+    warnings = std::move(layoutWarnings);
+    return parser;
+}
+
+std::unique_ptr<TemplateParser> DirectiveSnapshot::LoadTemplates(const string &path, uint64_t templatesHash, vector<Warning> &warnings)
+{
+    MappedFile file;
+    Header header;
+    if (!Open(file, path, header) || header.templatesHash != templatesHash || header.templatesSection == 0)
+        return nullptr;
+
+    Reader reader(file.Text(), header.templatesSection);
+    auto parser = std::make_unique<TemplateParser>();
+    auto count = reader.Number<uint32_t>();
+    for (uint32_t i = 0; i < count && reader.ok; i++)
+    {
+        string name(reader.Text());
+        Template temp;
+        temp.hash = reader.Number<uint64_t>();
+        temp.cacheable = reader.Number<uint8_t>() != 0;
+        reader.Array(temp.ArgsOrder);
+        auto slices = reader.Number<uint32_t>();
+        for (uint32_t s = 0; s < slices && reader.ok; s++)
+            temp.ContentSalami.emplace_back(reader.Text());
+        if (!reader.Ops(temp.Ops, 1) || temp.ContentSalami.size() != temp.ArgsOrder.size() + 1 || !SlotsFit(temp.Ops, temp.ArgsOrder.size()) ||
+            std::any_of(temp.ArgsOrder.begin(), temp.ArgsOrder.end(), [](int arg)
+                        { return arg < 0; }))
+            return nullptr;
+
+        temp.arity = Max(temp.ArgsOrder);
+        for (const auto &slice : temp.ContentSalami)
+            temp.literalBytes += slice.size();
+        temp.BindArgViews();
+        parser->TemplateMap.emplace(std::move(name), std::move(temp));
+    }
+    vector<Warning> templateWarnings;
+    if (!reader.ok || !reader.Warnings(templateWarnings))
+        return nullptr;
+
+    parser->IndexTemplates();
+    warnings = std::move(templateWarnings);
+    return parser;
+}
+
+bool DirectiveSnapshot::Save(const string &path, uint64_t layoutHash, const LayoutTree &layout, const vector<Warning> &layoutWarnings,
+                             uint64_t templatesHash, const TemplateParser &templates, const vector<Warning> &templateWarnings)
+{
+    Writer writer;
+    writer.out.append(magic, sizeof(magic));
+    writer.Number<uint32_t>(version);
+    writer.Number<uint32_t>(byteOrder);
+    writer.Number<uint64_t>(layoutHash);
+    writer.Number<uint64_t>(templatesHash);
+    size_t sections = writer.out.size();
+    writer.Number<uint64_t>(0);
+    writer.Number<uint64_t>(0);
+    writer.Number<uint64_t>(0);
+
+    auto setSection = [&](size_t slot)
+    {
+        uint64_t offset = writer.out.size();
+        std::memcpy(&writer.out[sections + slot * sizeof(uint64_t)], &offset, sizeof(offset));
+    };
+
+    // Names are stored as offsets into the names block, which Build filled in node order
+    setSection(0);
+    const char *names = layout.names.get();
+    size_t nameBytes = 0;
+    vector<uint32_t> nodeFields;
+    nodeFields.reserve(layout.nodes.size() * 5);
+    for (const auto &node : layout.nodes)
+    {
+        nodeFields.insert(nodeFields.end(), {static_cast<uint32_t>(node.name.data() - names), static_cast<uint32_t>(node.name.size()), node.parent,
+                                             node.firstChild, node.childCount});
+        nameBytes = std::max(nameBytes, static_cast<size_t>(node.name.data() - names) + node.name.size());
+    }
+    bool placeholderRoot = layout.index.find(layout.nodes[0].name) == layout.index.end() || layout.index.at(layout.nodes[0].name) != 0;
+    writer.Number<uint32_t>(layout.nodes.size());
+    writer.Number<uint8_t>(placeholderRoot);
+    writer.Array(nodeFields);
+    writer.Array(layout.childIds);
+    writer.Text(string_view(names, nameBytes));
+    writer.Warnings(layoutWarnings);
+
+    if (templates.GetCompiledCount() == 0)
+    {
+        setSection(1);
+        vector<const string *> order;
+        for (const auto &entry : templates.TemplateMap)
+            order.push_back(&entry.first);
+        std::sort(order.begin(), order.end(), [](const string *a, const string *b)
+                  { return *a < *b; });
+
+        writer.Number<uint32_t>(order.size());
+        for (const auto *name : order)
+        {
+            const Template &temp = templates.TemplateMap.at(*name);
+            writer.Text(*name);
+            writer.Number<uint64_t>(temp.hash);
+            writer.Number<uint8_t>(temp.cacheable);
+            writer.Array(temp.ArgsOrder);
+            writer.Number<uint32_t>(temp.ContentSalami.size());
+            for (const auto &slice : temp.ContentSalami)
+                writer.Text(slice);
+            writer.Ops(temp.Ops);
+        }
+        writer.Warnings(templateWarnings);
+    }
+
+    uint64_t checksum = HashBytes(string_view(writer.out).substr(headerSize));
+    std::memcpy(&writer.out[headerSize - sizeof(checksum)], &checksum, sizeof(checksum));
+    return WriteFileAtomically(path, writer.out);
+}
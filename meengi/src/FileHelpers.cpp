@@ -1,9 +1,23 @@
 #include "FileHelpers.h"
-#include "GeneratorConfig.h"
+#include "DelimiterSet.h"
 #include <stdlib.h>
 #include <cctype>
 #include <filesystem>
 #include <exception>
+#include <atomic>
+#include <cerrno>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MEENGI_HAS_POSIX_IO 1
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
 
 using std::string;
 using std::vector;
@@ -11,99 +25,77 @@ using std::ios;
 
 vector<string> GetLinesFromFile(const string &path, bool ignore_comments)
 {
-    std::fstream file;
     vector<string> ret = vector<string>();
-    file.open(path.c_str(), ios::in);
-    if (file.is_open())
-    {
-        string line;
-        while (getline(file, line))
-        {
-            bool isComment = false;
-
-            if (ignore_comments && line.size() > 1)
-            {
-                string lineStart = line.substr(0, 2);
-                if (lineStart == "//")
-                    isComment = true;
-            }
-            if (!isComment)
-                ret.push_back(line);
-        }
-    }
-    file.close();
-    return ret;
-}
-
-string ExtractBetween(const string &target, const string &start, const string &end)
-{
-    string ret = "";
-    size_t p_start, p_end;
-    p_start = target.find(start);
-    if (p_start != string::npos)
-    {
-        if (end == "\n")
-        {
-            p_end = target.size();
-        }
-        else
-            p_end = target.find(end, p_start);
-
-        if (p_end != string::npos)
-            ret = target.substr(p_start + start.size(), p_end - p_start - start.size());
-    }
-    return ret;
-}
-
-string ExtractBetween(const string &target, const size_t &p_start, const string &end)
-{
-    string ret = "";
-    size_t p_end;
-    if (p_start != string::npos)
-    {
-        if (end == "\n")
-        {
-            p_end = target.size();
-        }
-        else
-            p_end = target.find(end, p_start);
-
-        if (p_end != string::npos)
-            ret = target.substr(p_start, p_end - p_start);
-    }
-    return ret;
-}
-
-vector<string> TokenizeBetween(const string &input, const string &tokens)
-{
-    vector<string> ret = vector<string>();
-    auto pos = input.find_first_of(tokens);
-    if (pos != string::npos)
-    {
-        while (pos != string::npos && pos < input.size())
-        {
-            auto pos_n = input.find_first_of(tokens, pos + 1);
-            if (pos_n != string::npos)
-                ret.push_back(input.substr(pos + 1, pos_n - pos - 1));
-            pos = pos_n;
-        }
-    }
-    return ret;
-}
-
-void warn(const string &warning)
-{
-    std::ofstream warningfile;
-    warningfile.open(GetGeneratorConfig().warningsFile, ios::app);
-    warningfile << warning << '\n';
-    warningfile.close();
-}
-
-bool toInt(const string &str, int &out)
-{
-    bool success = true;
-    int val;
-
+    MappedFile file(path);
+    LineReader reader(file.Text(), ignore_comments);
+    std::string_view line;
+    while (reader.Next(line))
+        ret.emplace_back(line);
+    return ret;
+}
+
+string ExtractBetween(const string &target, const string &start, const string &end)
+{
+    string ret = "";
+    size_t p_start, p_end;
+    p_start = target.find(start);
+    if (p_start != string::npos)
+    {
+        if (end == "\n")
+        {
+            p_end = target.size();
+        }
+        else
+            p_end = target.find(end, p_start);
+
+        if (p_end != string::npos)
+            ret = target.substr(p_start + start.size(), p_end - p_start - start.size());
+    }
+    return ret;
+}
+
+string ExtractBetween(const string &target, const size_t &p_start, const string &end)
+{
+    string ret = "";
+    size_t p_end;
+    if (p_start != string::npos)
+    {
+        if (end == "\n")
+        {
+            p_end = target.size();
+        }
+        else
+            p_end = target.find(end, p_start);
+
+        if (p_end != string::npos)
+            ret = target.substr(p_start, p_end - p_start);
+    }
+    return ret;
+}
+
+vector<string> TokenizeBetween(const string &input, const string &tokens)
+{
+    vector<string> ret = vector<string>();
+    DelimiterSet delimiters(tokens);
+    auto pos = delimiters.Find(input);
+    if (pos != string::npos)
+    {
+        while (pos != string::npos && pos < input.size())
+        {
+            auto pos_n = delimiters.Find(input, pos + 1);
+            if (pos_n != string::npos)
+                ret.push_back(input.substr(pos + 1, pos_n - pos - 1));
+            pos = pos_n;
+        }
+    }
+    return ret;
+}
+
+bool toInt(const string &str, int &out)
+{
+    bool success = true;
+    int val;
+
     try
     {
         val = std::stoi(str);
@@ -113,23 +105,16 @@ bool toInt(const string &str, int &out)
         warn("Caught Failure in toInt while converting " + str + ": " + e.what());
         success = false;
     }
-    if (success)
-    {
-        out = val;
-    }
-    return success;
-}
-
-void ClearPreviousWarnings()
-{
-    std::ofstream warningfile;
-    warningfile.open(GetGeneratorConfig().warningsFile, std::ios::trunc);
-    warningfile.close();
+    if (success)
+    {
+        out = val;
+    }
+    return success;
 }
-void ClearPreviousFiles()
+
+void ClearPreviousFiles(const std::string &outputDir)
 {
     namespace fs = std::filesystem;
-    auto outputDir = fs::path(GetGeneratorConfig().outputDir);
     std::error_code ec;
     if (fs::exists(outputDir, ec) && fs::is_directory(outputDir, ec))
     {
@@ -141,54 +126,268 @@ void ClearPreviousFiles()
             }
         }
     }
-    ClearPreviousWarnings();
 }
-
-void ReadTemplateTitle(const string &iLine, string &templateName, vector<string> &argsList)
-{
-    templateName = ExtractBetween(iLine, "$", "(");
-    argsList = TokenizeBetween(iLine, ",()");
-}
+
+namespace
+{
+namespace fs = std::filesystem;
+
+// Hidden and unique per process and call, several workers may write into the same directory
+fs::path TempPathFor(const fs::path &target)
+{
+    static std::atomic<uint64_t> counter{0};
+    string name = "." + target.filename().string() + "." + std::to_string(counter++);
+#ifdef MEENGI_HAS_POSIX_IO
+    name += "." + std::to_string(getpid());
+#endif
+    return target.parent_path() / (name + ".tmp");
+}
+
+// Moves the finished temp file over target, or drops it if writing it failed
+bool CommitTemp(const fs::path &temp, const fs::path &target, bool ok)
+{
+    std::error_code ec;
+    if (ok)
+    {
+        fs::rename(temp, target, ec);
+        ok = !ec;
+    }
+    if (!ok)
+        fs::remove(temp, ec);
+    return ok;
+}
+
+#ifdef MEENGI_HAS_POSIX_IO
+bool WriteAll(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        auto written = ::write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// Shares the source's blocks when the filesystem can (reflink), lets the kernel copy otherwise,
+// and only moves the bytes through user space as a last resort
+bool CopyContents(int in, int out, size_t size)
+{
+#ifdef __linux__
+    if (::ioctl(out, FICLONE, in) == 0)
+        return true;
+
+    size_t copied = 0;
+    while (copied < size)
+    {
+        auto done = ::copy_file_range(in, nullptr, out, nullptr, size - copied, 0);
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+            break;
+        copied += done;
+    }
+    if (copied == size)
+        return true;
+    if (copied != 0)
+        return false;
+#endif
+
+    char buffer[1 << 16];
+    while (true)
+    {
+        auto got = ::read(in, buffer, sizeof(buffer));
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0)
+            return false;
+        if (got == 0)
+            return true;
+        if (!WriteAll(out, buffer, got))
+            return false;
+    }
+}
+#endif
+} // namespace
+
+bool WriteFileAtomically(const string &path, std::string_view data)
+{
+    fs::path target(path);
+    fs::path temp = TempPathFor(target);
+
+#ifdef MEENGI_HAS_POSIX_IO
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0)
+        return false;
+    bool ok = WriteAll(fd, data.data(), data.size());
+    if (::close(fd) != 0)
+        ok = false;
+#else
+    bool ok;
+    {
+        std::ofstream file(temp, ios::binary | ios::trunc);
+        file.write(data.data(), data.size());
+        ok = file.good();
+    }
+#endif
+
+    return CommitTemp(temp, target, ok);
+}
+
+bool CopyFileAtomically(const string &from, const string &to)
+{
+    fs::path target(to);
+    fs::path temp = TempPathFor(target);
+
+#ifdef MEENGI_HAS_POSIX_IO
+    int in = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0)
+        return false;
+    int out = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (out < 0)
+    {
+        ::close(in);
+        return false;
+    }
+
+    struct stat info;
+    bool ok = ::fstat(in, &info) == 0 && CopyContents(in, out, info.st_size);
+    if (::close(out) != 0)
+        ok = false;
+    ::close(in);
+#else
+    std::error_code ec;
+    fs::copy_file(from, temp, fs::copy_options::overwrite_existing, ec);
+    bool ok = !ec;
+#endif
+
+    return CommitTemp(temp, target, ok);
+}
+
+void ReadTemplateTitle(const string &iLine, string &templateName, vector<string> &argsList)
+{
+    templateName = ExtractBetween(iLine, "$", "(");
+    argsList = TokenizeBetween(iLine, ",()");
+}
+void ReadTemplateTitle(std::string_view iLine, std::string_view &templateName, vector<std::string_view> &argsList)
+{
+    static const DelimiterSet delimiters(",()");
+    constexpr auto npos = std::string_view::npos;
+
+    templateName = std::string_view();
+    auto start = iLine.find('$');
+    auto end = start == npos ? npos : iLine.find('(', start);
+    if (end != npos)
+        templateName = iLine.substr(start + 1, end - start - 1);
+
+    argsList.clear();
+    auto pos = delimiters.Find(iLine);
+    while (pos != npos)
+    {
+        auto next = delimiters.Find(iLine, pos + 1);
+        if (next != npos)
+            argsList.push_back(iLine.substr(pos + 1, next - pos - 1));
+        pos = next;
+    }
+}
+
 void ReadTemplateText(const string &input, const vector<string> &argsList, vector<int> &argsOrder, vector<string> &salamiSlices)
 {
-    auto pos = input.find("$$");
-    size_t pos_last = 0;
-    while (pos != string::npos)
-    {
-        auto pos_arg_end = input.find("$$", pos + 1);
-        if (pos_arg_end != string::npos)
-        {
-            string arg = input.substr(pos + 2, pos_arg_end - pos - 2);
-
-            for (size_t i = 0; i < argsList.size(); i++)
-            {
-                if (arg == argsList[i])
-                {
-                    argsOrder.push_back(i);
-                    salamiSlices.push_back(ExtractBetween(input, pos_last, "$$"));
-                    pos_last = pos_arg_end + 2;
-                    break;
-                }
-            }
-            pos = input.find("$$", pos_arg_end + 1);
-        }
-        else
-            pos = input.find("$$", pos + 1);
-    }
-    salamiSlices.push_back(input.substr(pos_last));
-}
-
-// Need this to find out how many arguments do we have in a template
-size_t Max(const vector<int> &vec)
-{
-    int ret = -1;
-
-    for (auto val : vec)
-    {
-        if (val > ret)
-            ret = val;
-    }
-    return ret + 1;
+    auto pos = input.find("$$");
+    size_t pos_last = 0;
+    while (pos != string::npos)
+    {
+        auto pos_arg_end = input.find("$$", pos + 1);
+        if (pos_arg_end != string::npos)
+        {
+            string arg = input.substr(pos + 2, pos_arg_end - pos - 2);
+
+            for (size_t i = 0; i < argsList.size(); i++)
+            {
+                if (arg == argsList[i])
+                {
+                    argsOrder.push_back(i);
+                    salamiSlices.push_back(ExtractBetween(input, pos_last, "$$"));
+                    pos_last = pos_arg_end + 2;
+                    break;
+                }
+            }
+            pos = input.find("$$", pos_arg_end + 1);
+        }
+        else
+            pos = input.find("$$", pos + 1);
+    }
+    salamiSlices.push_back(input.substr(pos_last));
+}
+
+// Need this to find out how many arguments do we have in a template
+size_t Max(const vector<int> &vec)
+{
+    int ret = -1;
+
+    for (auto val : vec)
+    {
+        if (val > ret)
+            ret = val;
+    }
+    return ret + 1;
+}
+
+uint64_t HashBytes(std::string_view data, uint64_t seed)
+{
+    uint64_t hash = seed;
+    for (unsigned char c : data)
+    {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t HashFile(const string &path, bool map)
+{
+    MappedFile file(path, map);
+    if (!file.IsOpen())
+        return 0;
+    return HashBytes(file.Text());
+}
+
+string ToHex(uint64_t value)
+{
+    static const char digits[] = "0123456789abcdef";
+    string ret(16, '0');
+    for (int i = 15; i >= 0; i--)
+    {
+        ret[i] = digits[value & 0xf];
+        value >>= 4;
+    }
+    return ret;
+}
+
+bool FromHex(const string &str, uint64_t &out)
+{
+    if (str.empty() || str.size() > 16)
+        return false;
+
+    uint64_t value = 0;
+    for (char c : str)
+    {
+        value <<= 4;
+        if (c >= '0' && c <= '9')
+            value |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            value |= c - 'a' + 10;
+        else
+            return false;
+    }
+    out = value;
+    return true;
 }
 
 std::string Trim(const std::string &input)
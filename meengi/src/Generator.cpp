@@ -0,0 +1,147 @@
+#include "Generator.h"
+#include "BuildStats.h"
+#include "FileHelpers.h"
+#include "DirectiveSnapshot.h"
+#include "SourceWatch.h"
+
+Generator::Generator(const GeneratorConfig &config) : config(config), warnings(config.warningsFile, config.contentDir, config.warningsJson)
+{
+}
+
+const GeneratorConfig &Generator::Config() const
+{
+    return config;
+}
+
+WarningSink &Generator::Warnings()
+{
+    return warnings;
+}
+
+LayoutTree &Generator::Layout()
+{
+    std::lock_guard<std::mutex> guard(loadLock);
+    if (layout == nullptr)
+    {
+        PhaseTimer timer(Phase::LayoutParse);
+        layoutWarnings.clear();
+        layoutHash = HashFile(config.layoutPath, config.mapFiles);
+        if (!config.snapshotPath.empty())
+            layout = DirectiveSnapshot::LoadLayout(config.snapshotPath, layoutHash, layoutWarnings);
+        if (layout != nullptr)
+            BuildStats::Add(Counter::SnapshotLoads, 1);
+        else
+        {
+            WarningCapture capture(layoutWarnings);
+            layout = std::make_unique<LayoutParser>(config.layoutPath, config.mapFiles);
+            snapshotStale = true;
+        }
+    }
+    return layout->GetTree();
+}
+
+TemplateParser &Generator::Templates()
+{
+    std::lock_guard<std::mutex> guard(loadLock);
+    if (templates == nullptr)
+    {
+        PhaseTimer timer(Phase::TemplateCompile);
+        templateWarnings.clear();
+        templatesHash = HashFile(config.templatesPath, config.mapFiles);
+        // Templates compiled into the program (--emit-cpp) stand in for templates.md only while it is unchanged
+        auto compiled = CompiledTemplateSet::Linked();
+        if (compiled != nullptr && compiled->templatesHash == templatesHash)
+            templates = std::make_unique<TemplateParser>(*compiled);
+        else if (!config.snapshotPath.empty() && (templates = DirectiveSnapshot::LoadTemplates(config.snapshotPath, templatesHash, templateWarnings)) != nullptr)
+            BuildStats::Add(Counter::SnapshotLoads, 1);
+        else
+        {
+            WarningCapture capture(templateWarnings);
+            templates = std::make_unique<TemplateParser>(config.templatesPath, config.mapFiles);
+            snapshotStale = true;
+        }
+    }
+    return *templates;
+}
+
+// Only when both files still hash as they did when they were read, an edit in between is picked up next time
+void Generator::SaveSnapshot()
+{
+    std::lock_guard<std::mutex> guard(loadLock);
+    if (!snapshotStale || config.snapshotPath.empty() || layout == nullptr || templates == nullptr)
+        return;
+    snapshotStale = false;
+    if (HashFile(config.layoutPath, config.mapFiles) != layoutHash || HashFile(config.templatesPath, config.mapFiles) != templatesHash)
+        return;
+    PhaseTimer timer(Phase::Manifest);
+    DirectiveSnapshot::Save(config.snapshotPath, layoutHash, layout->GetTree(), layoutWarnings, templatesHash, *templates, templateWarnings);
+}
+
+// Waits for a running render, which still uses the old layout
+void Generator::ReloadLayout()
+{
+    std::lock_guard<std::mutex> render(renderLock);
+    std::lock_guard<std::mutex> guard(loadLock);
+    layout.reset();
+}
+
+void Generator::ReloadTemplates()
+{
+    std::lock_guard<std::mutex> render(renderLock);
+    std::lock_guard<std::mutex> guard(loadLock);
+    templates.reset();
+}
+
+void Generator::Reload(const SourceChanges &changes)
+{
+    if (changes.layout || changes.lost)
+        ReloadLayout();
+    if (changes.templates || changes.lost)
+        ReloadTemplates();
+}
+
+RenderSummary Generator::Render()
+{
+    BuildState state;
+    return Render(state);
+}
+
+RenderSummary Generator::Render(BuildState &state)
+{
+    std::lock_guard<std::mutex> guard(renderLock);
+    WarningScope scope(warnings);
+    warnings.Clear();
+
+    auto &tree = Layout();
+    BuildStats::Add(Counter::CompiledTemplates, Templates().GetCompiledCount());
+    for (const auto &warning : layoutWarnings)
+        warnings.Add(warning);
+    for (const auto &warning : templateWarnings)
+        warnings.Add(warning);
+
+    PageRenderer renderer(*this);
+    auto summary = renderer.Render(tree.Root(), state);
+    SaveSnapshot();
+    return summary;
+}
+
+bool Generator::RenderPage(std::string_view name, std::string &html, std::vector<Warning> &pageWarnings)
+{
+    std::lock_guard<std::mutex> guard(renderLock);
+    auto &tree = Layout();
+    // Like Render, drops the cached layout lists and pure expansions of another layout
+    Templates().BeginRender(layoutHash);
+    Node *node = tree.Find(name);
+    if (node == nullptr)
+        return false;
+
+    PageRenderer renderer(*this);
+    renderer.RenderToMemory(node, html, pageWarnings);
+    return true;
+}
+
+void Generator::LinkAssets()
+{
+    std::lock_guard<std::mutex> guard(renderLock);
+    assets.Link(config);
+}
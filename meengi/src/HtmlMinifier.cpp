@@ -0,0 +1,159 @@
+#include "HtmlMinifier.h"
+
+using std::string;
+using std::string_view;
+
+namespace
+{
+constexpr size_t npos = string_view::npos;
+
+bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+bool IsAlpha(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+char Lower(char c)
+{
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+// Elements whose content is whitespace sensitive (or not HTML at all)
+bool IsRawElement(string_view name)
+{
+    return name == "pre" || name == "textarea" || name == "script" || name == "style";
+}
+
+// Position of </name (any case) at or after from
+size_t FindClosingTag(string_view text, size_t from, string_view name)
+{
+    for (auto pos = text.find("</", from); pos != npos; pos = text.find("</", pos + 2))
+    {
+        size_t i = 0;
+        while (i < name.size() && pos + 2 + i < text.size() && Lower(text[pos + 2 + i]) == name[i])
+            i++;
+        if (i == name.size())
+            return pos;
+    }
+    return npos;
+}
+
+class MinifyScanner
+{
+private:
+    string_view text;
+    string &out;
+    size_t start;
+    bool pendingSpace = false; // whitespace seen since the last byte written
+
+    void FlushSpace()
+    {
+        if (pendingSpace && out.size() > start)
+            out += ' ';
+        pendingSpace = false;
+    }
+
+    // Copies a tag up to and including its '>', collapsing whitespace outside quotes.
+    // Returns the position after the tag and the lower case element name of an opening tag in name.
+    size_t CopyTag(size_t pos, string &name)
+    {
+        size_t nameStart = pos + 1;
+        size_t nameEnd = nameStart;
+        while (nameEnd < text.size() && (IsAlpha(text[nameEnd]) || (nameEnd > nameStart && text[nameEnd] >= '0' && text[nameEnd] <= '9')))
+            nameEnd++;
+        name.clear();
+        for (auto i = nameStart; i < nameEnd; i++)
+            name += Lower(text[i]);
+
+        char quote = 0;
+        bool space = false;
+        while (pos < text.size())
+        {
+            char c = text[pos];
+            if (quote != 0)
+            {
+                out += c;
+                if (c == quote)
+                    quote = 0;
+            }
+            else if (IsSpace(c))
+                space = true;
+            else
+            {
+                if (space && c != '>')
+                    out += ' ';
+                space = false;
+                out += c;
+                if (c == '"' || c == '\'')
+                    quote = c;
+                else if (c == '>')
+                    return pos + 1;
+            }
+            pos++;
+        }
+        return pos;
+    }
+
+public:
+    MinifyScanner(string_view text, string &out) : text(text), out(out), start(out.size())
+    {
+    }
+
+    void Run()
+    {
+        size_t pos = 0;
+        string name;
+        while (pos < text.size())
+        {
+            char c = text[pos];
+            if (IsSpace(c))
+            {
+                pendingSpace = true;
+                pos++;
+                continue;
+            }
+
+            if (c != '<' || pos + 1 >= text.size() || !(IsAlpha(text[pos + 1]) || text[pos + 1] == '/' || text[pos + 1] == '!'))
+            {
+                FlushSpace();
+                auto next = pos + 1;
+                while (next < text.size() && !IsSpace(text[next]) && text[next] != '<')
+                    next++;
+                out.append(text.data() + pos, next - pos);
+                pos = next;
+                continue;
+            }
+
+            // Comments go, conditional comments (<!--[if ...]>) stay since they are not really comments
+            if (text.compare(pos, 4, "<!--") == 0 && text.compare(pos, 5, "<!--[") != 0)
+            {
+                auto end = text.find("-->", pos + 4);
+                pos = end == npos ? text.size() : end + 3;
+                continue;
+            }
+
+            FlushSpace();
+            pos = CopyTag(pos, name);
+            if (text[pos - 1] == '>' && IsRawElement(name))
+            {
+                auto end = FindClosingTag(text, pos, name);
+                if (end == npos)
+                    end = text.size();
+                out.append(text.data() + pos, end - pos);
+                pos = end;
+            }
+        }
+    }
+};
+} // namespace
+
+size_t HtmlMinifier::Minify(string_view html, string &out)
+{
+    size_t before = out.size();
+    MinifyScanner(html, out).Run();
+    return html.size() - (out.size() - before);
+}
@@ -1,109 +1,190 @@
-#include <iostream>
+#include <algorithm>
 #include "LayoutParser.h"
 #include "FileHelpers.h"
-#include "GeneratorConfig.h"
 
 using std::string;
+using std::vector;
+
+namespace
+{
+// Name of the home page until layout.md names one
+constexpr std::string_view unnamedRoot = "Uninitialised";
+} // namespace
 
-Node::Node(std::string name, Node *parent) : name(name), parent(parent)
+Node::Node() : name(unnamedRoot)
 {
-    children = std::vector<Node *>();
 }
 
-void Node::AddChild(Node *child)
+Node::Node(std::string_view name) : name(name)
 {
-    children.push_back(child);
 }
 
-Node::Node() : name("Uninitialised"), parent(nullptr)
+LayoutTree::LayoutTree()
 {
-    children = std::vector<Node *>();
+    Builder empty;
+    Build(empty);
 }
 
-void Node::Print() const
+void LayoutTree::Build(const Builder &builder)
 {
-    std::cout << name << " -> { " << std::endl;
-    if (children.size() != 0)
+    size_t count = builder.names.size();
+    NodeId root = builder.root;
+    if (root == NoNode)
+        root = count;
+
+    // Outgoing edges per node in listing order, as a count/offset pass so no per-node vectors are needed
+    vector<uint32_t> edgeStart(count + 2, 0);
+    for (auto &edge : builder.edges)
+        edgeStart[edge.first + 1]++;
+    for (size_t i = 1; i < edgeStart.size(); i++)
+        edgeStart[i] += edgeStart[i - 1];
+    vector<NodeId> edgeTargets(builder.edges.size());
+    {
+        vector<uint32_t> fill(edgeStart.begin(), edgeStart.end() - 1);
+        for (auto &edge : builder.edges)
+            edgeTargets[fill[edge.first]++] = edge.second;
+    }
+
+    // BFS from the root decides where every node goes, unreachable nodes keep their listing order after it
+    vector<NodeId> order;
+    vector<NodeId> position(count + 1, NoNode);
+    order.reserve(count + 1);
+    order.push_back(root);
+    position[root] = 0;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        NodeId cur = order[i];
+        for (auto e = edgeStart[cur]; e < edgeStart[cur + 1]; e++)
+        {
+            NodeId child = edgeTargets[e];
+            if (position[child] == NoNode)
+            {
+                position[child] = order.size();
+                order.push_back(child);
+            }
+        }
+    }
+    for (NodeId i = 0; i < count; i++)
     {
-        for (auto child : children)
+        if (position[i] == NoNode)
         {
-            child->Print();
-            std::cout << " , " << std::endl;
+            position[i] = order.size();
+            order.push_back(i);
         }
     }
-    std::cout << " } " << std::endl;
+
+    size_t nameBytes = 0;
+    for (auto &name : builder.names)
+        nameBytes += name.size();
+    if (builder.root == NoNode)
+        nameBytes += unnamedRoot.size();
+    names.reset(new char[nameBytes + 1]);
+
+    nodes.assign(order.size(), Node());
+    childIds.clear();
+    childIds.reserve(builder.edges.size());
+    index.clear();
+    index.reserve(count);
+
+    char *next = names.get();
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        NodeId old = order[i];
+        Node &node = nodes[i];
+        std::string_view name = old == count ? unnamedRoot : std::string_view(builder.names[old]);
+        std::copy(name.begin(), name.end(), next);
+        node.name = std::string_view(next, name.size());
+        next += name.size();
+
+        node.id = i;
+        node.parent = old < count && builder.parents[old] != NoNode ? position[builder.parents[old]] : NoNode;
+        node.firstChild = childIds.size();
+        for (auto e = edgeStart[old]; e < edgeStart[old + 1]; e++)
+            childIds.push_back(position[edgeTargets[e]]);
+        node.childCount = childIds.size() - node.firstChild;
+
+        if (old != count)
+            index.emplace(node.name, i);
+    }
 }
 
-// Initialise the static variables
-LayoutParser *LayoutParser::instance = nullptr;
+Node *LayoutTree::Root()
+{
+    return &nodes[0];
+}
 
-LayoutParser *LayoutParser::GetInstance()
-{
-    if (instance == nullptr)
-        instance = new LayoutParser(GetGeneratorConfig().layoutPath);
-
-    return instance;
-}
+Node *LayoutTree::Find(std::string_view name)
+{
+    auto search = index.find(name);
+    if (search == index.end())
+        return nullptr;
+    return &nodes[search->second];
+}
 
-Node *LayoutParser::GetStartNode()
+Node *LayoutTree::Parent(const Node *node)
 {
-    return &LayoutParser::GetInstance()->StartNode;
+    if (node->parent == NoNode)
+        return nullptr;
+    return &nodes[node->parent];
 }
 
-const std::map<std::string, Node *> &LayoutParser::GetMap() const
+NodeRange LayoutTree::Children(const Node *node)
 {
-    return NodeMap;
-}
-
-Node *LayoutParser::FindNode(const std::string &name)
-{
-    auto &map = LayoutParser::GetInstance()->GetMap();
-    auto search = map.find(name);
-    if (search == map.end())
-        return nullptr;
-    return search->second;
-}
+    if (node->childCount == 0)
+        return NodeRange(nullptr, nullptr, nullptr);
+    const NodeId *first = childIds.data() + node->firstChild;
+    return NodeRange(nodes.data(), first, first + node->childCount);
+}
 
-void LayoutParser::SaveInMap(Node *node, const std::string str)
+size_t LayoutTree::Size() const
 {
-    if (node == nullptr)
-        return;
-
-    NodeMap[str] = node;
+    return nodes.size();
 }
 
-LayoutParser::LayoutParser(const std::string &path)
-{
-    auto lines = GetLinesFromFile(path);
-    Node *currentParent = nullptr;
-    for (auto line : lines)
+LayoutParser::LayoutParser()
+{
+}
+
+LayoutParser::LayoutParser(const std::string &path, bool map)
+{
+    MappedFile file(path, map);
+    WarningLocation location(path);
+    LayoutTree::Builder builder;
+    std::unordered_map<string, NodeId> ids;
+    NodeId currentParent = NoNode;
+    LineReader reader(file.Text());
+    std::string_view line;
+    while (reader.Next(line))
     {
+        location.SetLine(reader.LineNumber());
+
         bool isParent = false;
         bool isChild = false;
 
         auto pos = line.find("#");
         if (pos != string::npos)
         {
-            if (line[pos + 1] == '#')
+            if (pos + 1 < line.size() && line[pos + 1] == '#')
             {
                 isParent = true;
             }
             else
                 isChild = true;
         }
-        if (isParent)
-        {
-            string name = Trim(ExtractBetween(line, "##", "\n"));
-            Node *current = NodeMap[name];
+        if (isParent)
+        {
+            string name = Trim(ExtractBetween(string(line), "##", "\n"));
+            auto current = ids.find(name);
 
-            if (current == nullptr)
+            if (current == ids.end())
             {
-                if (StartNode.name == "Uninitialised")
+                if (builder.root == NoNode)
                 {
-                    StartNode.name = name;
-                    StartNode.parent = nullptr;
-                    SaveInMap(&StartNode, name);
-                    currentParent = &StartNode;
+                    builder.root = builder.names.size();
+                    ids.emplace(name, builder.root);
+                    builder.names.push_back(name);
+                    builder.parents.push_back(NoNode);
+                    currentParent = builder.root;
                 }
                 else
                 {
@@ -114,54 +195,54 @@ LayoutParser::LayoutParser(const std::string &path)
             }
             else
             {
-                currentParent = current;
+                currentParent = current->second;
             }
         }
-        else if (isChild)
-        {
-            string name = Trim(ExtractBetween(line, "#", "\n"));
+        else if (isChild)
+        {
+            string name = Trim(ExtractBetween(string(line), "#", "\n"));
 
-            auto current = NodeMap[name];
+            auto found = ids.find(name);
+            NodeId current;
 
-            if (current == nullptr)
+            if (found == ids.end())
             {
-                current = new Node(name);
-                SaveInMap(current, name);
+                current = builder.names.size();
+                ids.emplace(name, current);
+                builder.names.push_back(name);
+                builder.parents.push_back(NoNode);
             }
 
             // Child must not have been initiated before to avoid possible circular references
             else
             {
+                current = found->second;
                 string warning = "In layout, " + name + " Is listed under multiple PageTitles. Hence ignored after first encounter. Avoid listing single page under multiple pageTitles";
                 warn(warning);
             }
 
-            if (currentParent != nullptr)
+            if (currentParent != NoNode)
             {
-                current->parent = currentParent;
-                currentParent->AddChild(current);
+                builder.parents[current] = currentParent;
+                builder.edges.emplace_back(currentParent, current);
             }
         }
-    }
+    }
+
+    tree.Build(builder);
 }
 
-LayoutParser::~LayoutParser()
+LayoutTree &LayoutParser::GetTree()
 {
-    for (auto &entry : NodeMap)
-    {
-        if (entry.second != &StartNode)
-        {
-            delete entry.second;
-        }
-    }
-    NodeMap.clear();
+    return tree;
 }
 
-void LayoutParser::Reset()
+Node *LayoutParser::GetStartNode()
 {
-    if (instance != nullptr)
-    {
-        delete instance;
-        instance = nullptr;
-    }
+    return tree.Root();
 }
+
+Node *LayoutParser::FindNode(std::string_view name)
+{
+    return tree.Find(name);
+}
@@ -0,0 +1,118 @@
+#include <fstream>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MEENGI_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MappedFile.h"
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+MappedFile::MappedFile()
+{
+}
+
+MappedFile::MappedFile(const string &path, bool map)
+{
+    Open(path, map);
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+void MappedFile::Close()
+{
+#ifdef MEENGI_HAS_MMAP
+    if (mapped)
+        munmap(const_cast<char *>(data), size);
+#endif
+    data = nullptr;
+    size = 0;
+    mapped = false;
+    fallback.clear();
+}
+
+bool MappedFile::Open(const string &path, bool map)
+{
+    Close();
+
+#ifdef MEENGI_HAS_MMAP
+    if (!map)
+        return Read(path);
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        close(fd);
+        return false;
+    }
+
+    // Empty files can't be mapped but are still open
+    if (info.st_size > 0)
+    {
+        void *address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED)
+        {
+            close(fd);
+            return false;
+        }
+        madvise(address, info.st_size, MADV_SEQUENTIAL);
+        data = static_cast<const char *>(address);
+        size = info.st_size;
+        mapped = true;
+    }
+    else
+        data = "";
+    close(fd);
+    return true;
+#else
+    (void)map;
+    return Read(path);
+#endif
+}
+
+bool MappedFile::Read(const string &path)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+        return false;
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    fallback = buffer.str();
+    data = fallback.data();
+    size = fallback.size();
+    return true;
+}
+
+bool MappedFile::IsOpen() const
+{
+    return data != nullptr;
+}
+
+string_view MappedFile::Text() const
+{
+    return data == nullptr ? string_view() : string_view(data, size);
+}
+
+vector<string_view> MappedFile::Lines(bool ignore_comments) const
+{
+    vector<string_view> lines;
+    LineReader reader(Text(), ignore_comments);
+    string_view line;
+    while (reader.Next(line))
+        lines.push_back(line);
+    return lines;
+}
@@ -1,99 +1,609 @@
-#include <queue>
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include <set>
 #include <vector>
 #include <stdio.h>
 #include <filesystem>
 #include "PageRenderer.h"
+#include "Generator.h"
 #include "FileHelpers.h"
 #include "ShortHandParser.h"
-#include "GeneratorConfig.h"
+#include "ThreadPool.h"
+#include "BuildManifest.h"
+#include "BuildStats.h"
 
 using namespace std;
 
-TemplateParser PageRenderer::templateParser = TemplateParser();
-ShortHandParser PageRenderer::shortHandParser = ShortHandParser();
-Node *PageRenderer::currentNode = nullptr;
-bool PageRenderer::templatesInitialised = false;
+namespace
+{
+// Each worker hands its output, line and expansion buffers from page to page,
+// so they only grow until they fit the largest page instead of being allocated per page
+struct WorkerBuffers
+{
+    string output;
+    string line;
+    vector<string_view> lineArguments;
+    deque<string> scratchText;
+    deque<vector<string_view>> scratchArgs;
+    string compressed;
+    string minified;
+};
+thread_local WorkerBuffers workerBuffers;
+
+void AcquireBuffers(RenderContext &context)
+{
+    context.output.swap(workerBuffers.output);
+    context.output.clear();
+    context.lineBuffer.swap(workerBuffers.line);
+    context.lineArguments.swap(workerBuffers.lineArguments);
+    context.scratchText.swap(workerBuffers.scratchText);
+    context.scratchArgs.swap(workerBuffers.scratchArgs);
+}
+
+void ReleaseBuffers(RenderContext &context)
+{
+    workerBuffers.output.swap(context.output);
+    workerBuffers.line.swap(context.lineBuffer);
+    workerBuffers.lineArguments.swap(context.lineArguments);
+    workerBuffers.scratchText.swap(context.scratchText);
+    workerBuffers.scratchArgs.swap(context.scratchArgs);
+}
+} // namespace
+
+PageRenderer::PageRenderer(Generator &generator)
+    : config(generator.config), layout(generator.layout->GetTree()), templateParser(*generator.templates),
+      shortHandParser(generator.shortHandParser), assets(generator.assets), warnings(generator.warnings)
+{
+}
 
-string PageRenderer::GetInputPath(Node *node)
+string PageRenderer::GetInputPath(Node *node) const
 {
     namespace fs = std::filesystem;
-    fs::path path = fs::path(GetGeneratorConfig().contentDir) / (node->name + ".md");
+    fs::path path = fs::path(config.contentDir) / (string(node->name) + ".md");
     return path.string();
 }
 
-string PageRenderer::GetOutputPath(Node *node)
+string PageRenderer::GetOutputPath(Node *node) const
 {
     namespace fs = std::filesystem;
-    fs::path path = fs::path(GetGeneratorConfig().outputDir) / (node->name + ".html");
+    fs::path path = fs::path(config.outputDir) / (string(node->name) + ".html");
     return path.string();
 }
 
-Node *PageRenderer::GetCurrent() { return currentNode; }
+// With fragments kept (--watch) a line expanded the last time the page was rendered is taken from there,
+// and what expanding it recorded is replayed into the page
+const string &PageRenderer::ExpandLine(std::string_view line, size_t lineNumber, RenderContext &context) const
+{
+    string &expanded = context.lineBuffer;
+    expanded.clear();
+    if (context.fragments == nullptr)
+    {
+        templateParser.Parse(line, context, expanded);
+        return expanded;
+    }
+
+    auto found = context.fragments->find(line);
+    if (found == context.fragments->end() && context.previousFragments != nullptr)
+    {
+        auto previous = context.previousFragments->find(line);
+        if (previous != context.previousFragments->end())
+            found = context.fragments->insert(context.previousFragments->extract(previous)).position;
+    }
+    if (found != context.fragments->end())
+    {
+        const auto &fragment = found->second;
+        for (auto warning : fragment.warnings)
+        {
+            if (warning.line == fragment.line)
+                warning.line = lineNumber;
+            context.warnings.push_back(std::move(warning));
+        }
+        context.usedTemplates.insert(fragment.usedTemplates.begin(), fragment.usedTemplates.end());
+        context.layoutDependencies.insert(fragment.layoutDependencies.begin(), fragment.layoutDependencies.end());
+        BuildStats::Add(Counter::LinesReused, 1);
+        return fragment.expanded;
+    }
+
+    // The line records into empty sets, which are then merged into the page's
+    LineFragment fragment;
+    fragment.line = lineNumber;
+    size_t warnings = context.warnings.size();
+    set<string> usedAssets;
+    context.usedTemplates.swap(fragment.usedTemplates);
+    context.layoutDependencies.swap(fragment.layoutDependencies);
+    context.usedAssets.swap(usedAssets);
+    templateParser.Parse(line, context, expanded);
+    context.usedTemplates.swap(fragment.usedTemplates);
+    context.layoutDependencies.swap(fragment.layoutDependencies);
+    context.usedAssets.swap(usedAssets);
+    context.usedTemplates.insert(fragment.usedTemplates.begin(), fragment.usedTemplates.end());
+    context.layoutDependencies.insert(fragment.layoutDependencies.begin(), fragment.layoutDependencies.end());
+    context.usedAssets.insert(usedAssets.begin(), usedAssets.end());
 
-std::string PageRenderer::InterpretLine(const std::string &iLine)
-{
-    // We might want to change the newline character to <br> instead
-    // Or we can put a optional parameter in template.md if need arises
+    // Asset URLs can change between builds while the layout and templates don't, such lines are always expanded
+    if (usedAssets.empty())
+    {
+        fragment.expanded = expanded;
+        fragment.warnings.assign(context.warnings.begin() + warnings, context.warnings.end());
+        context.fragments->emplace(string(line), std::move(fragment));
+    }
+    return expanded;
+}
+
+// With --block-markdown the expanded line goes to the page's BlockParser instead of ShortHandParser,
+// which writes blocks to out once they end
+void PageRenderer::InterpretLine(std::string_view iLine, size_t lineNumber, RenderContext &context, std::string &out, BlockParser *blocks) const
+{
+    // We might want to change the newline character to <br> instead
+    // Or we can put a optional parameter in template.md if need arises
     // Same thing happens at TemplateParser::TemplateParser()
-    return shortHandParser.Parse(templateParser.Parse(iLine)) + "\n";
+    if (!BuildStats::Enabled())
+    {
+        const string &expanded = ExpandLine(iLine, lineNumber, context);
+        if (blocks != nullptr)
+            blocks->Feed(expanded);
+        else
+            shortHandParser.Parse(expanded, out);
+    }
+    else
+    {
+        auto start = BuildStats::Clock::now();
+        const string &expanded = ExpandLine(iLine, lineNumber, context);
+        auto expandedAt = BuildStats::Clock::now();
+        if (blocks != nullptr)
+            blocks->Feed(expanded);
+        else
+            shortHandParser.Parse(expanded, out);
+        auto end = BuildStats::Clock::now();
+        context.expandNs += std::chrono::duration_cast<std::chrono::nanoseconds>(expandedAt - start).count();
+        context.shortHandNs += std::chrono::duration_cast<std::chrono::nanoseconds>(end - expandedAt).count();
+    }
+    if (blocks == nullptr)
+        out += '\n';
+}
+
+void PageRenderer::RenderPage(RenderContext &context) const
+{
+    WarningCapture capture(context.warnings);
+    auto inputPath = GetInputPath(context.node);
+    WarningLocation location(inputPath);
+
+    // Lines are views into the mapped file, nothing is copied before expansion
+    MappedFile input;
+    {
+        PhaseTimer timer(Phase::PageRead, context.node->name);
+        input.Open(inputPath, config.mapFiles);
+    }
+
+    std::optional<BlockParser> blocks;
+    if (config.blockMarkdown)
+        blocks.emplace(context.output);
+
+    size_t lines = 0;
+    {
+        TraceSpan span("render", context.node->name);
+        LineReader reader(input.Text());
+        std::string_view line;
+        while (reader.Next(line))
+        {
+            location.SetLine(reader.LineNumber());
+            InterpretLine(line, reader.LineNumber(), context, context.output, blocks ? &*blocks : nullptr);
+            lines++;
+        }
+        if (blocks)
+            blocks->Finish();
+    }
+
+    if (config.minify)
+        MinifyPage(context);
+
+    BuildStats::AddPhase(Phase::TemplateExpand, context.expandNs, lines);
+    BuildStats::AddPhase(Phase::ShortHand, context.shortHandNs, lines);
+    BuildStats::Add(Counter::BytesIn, input.Text().size());
+    BuildStats::Add(Counter::TemplateExpansions, context.templateExpansions);
+    BuildStats::Max(Counter::MaxTemplateDepth, context.maxTemplateDepth);
+}
+
+// The whole page goes through the minifier in one pass, into the worker's spare buffer.
+// The page's trace event tells how many bytes it saved.
+void PageRenderer::MinifyPage(RenderContext &context) const
+{
+    string detail;
+    PhaseTimer timer(Phase::Minify, context.node->name);
+    auto &minified = workerBuffers.minified;
+    minified.clear();
+    context.minifiedBytes = HtmlMinifier::Minify(context.output, minified);
+    context.output.swap(minified);
+    BuildStats::Add(Counter::BytesMinified, context.minifiedBytes);
+
+    if (BuildStats::Tracing())
+    {
+        detail = string(context.node->name) + ": " + std::to_string(context.minifiedBytes) + " bytes saved";
+        timer.SetDetail(detail);
+    }
+}
+
+// Terms of skipped pages come from the manifest, so the merge only walks term lists, no page is read again.
+// The file is left alone when the index came out the same.
+void PageRenderer::WriteSearchIndex(const vector<Node *> &pages, const BuildManifest &manifest) const
+{
+    PhaseTimer timer(Phase::SearchIndex);
+    vector<string> names;
+    vector<const vector<string> *> terms;
+    names.reserve(pages.size());
+    terms.reserve(pages.size());
+    for (auto page : pages)
+    {
+        names.emplace_back(page->name);
+        terms.push_back(&manifest.pages.at(names.back()).terms);
+    }
+
+    string index = SearchIndex::Build(names, terms);
+    std::error_code ec;
+    auto size = filesystem::file_size(config.searchIndex, ec);
+    if (!ec && size == index.size() && HashFile(config.searchIndex) == HashBytes(index))
+        return;
+    filesystem::create_directories(filesystem::path(config.searchIndex).parent_path(), ec);
+    if (!WriteFileAtomically(config.searchIndex, index))
+        warn("Could not write the search index to " + config.searchIndex);
+}
+
+// Unchanged pages are not rewritten so their mtime stays put for rsync and CDN uploads. previousHash is
+// what the manifest recorded for the page, when it matches only the file size is checked.
+PageRenderer::PageWrite PageRenderer::WritePage(Node *node, const string &html, uint64_t hash, uint64_t previousHash) const
+{
+    PhaseTimer timer(Phase::PageWrite, node->name);
+    auto outputPath = GetOutputPath(node);
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    auto size = fs::file_size(outputPath, ec);
+    if (!ec && size == html.size() && (hash == previousHash || HashFile(outputPath) == hash))
+        return PageWrite::Unchanged;
+
+    fs::create_directories(fs::path(outputPath).parent_path(), ec);
+    if (!WriteFileAtomically(outputPath, html))
+    {
+        warn("Could not write " + outputPath);
+        return PageWrite::Failed;
+    }
+    BuildStats::Add(Counter::BytesOut, html.size());
+    return PageWrite::Written;
+}
+
+// Variants are redone whenever their page changed; for an unchanged page only missing ones are written.
+// A changed page loses the variants that are no longer asked for, so a server never sends stale HTML.
+// A variant that can't be written is removed too and false is returned, the page then has to be redone.
+bool PageRenderer::PrecompressPage(Node *node, const string &html, bool changed) const
+{
+    const auto &precompress = config.precompress;
+    auto outputPath = GetOutputPath(node);
+    std::error_code ec;
+    bool compressed = false;
+    bool complete = true;
+    for (auto encoding : {Encoding::Gzip, Encoding::Zstd})
+    {
+        string path = outputPath + EncodingExtension(encoding);
+        if (std::find(precompress.begin(), precompress.end(), encoding) == precompress.end())
+        {
+            if (changed)
+                filesystem::remove(path, ec);
+            continue;
+        }
+        if (!changed && filesystem::exists(path, ec))
+            continue;
+
+        PhaseTimer timer(Phase::Compress, node->name);
+        auto &buffer = workerBuffers.compressed;
+        if (Compress(encoding, html, buffer) && WriteFileAtomically(path, buffer))
+        {
+            BuildStats::Add(Counter::BytesCompressed, buffer.size());
+            compressed = true;
+        }
+        else
+        {
+            warn("Could not write " + path);
+            filesystem::remove(path, ec);
+            complete = false;
+        }
+    }
+    if (compressed)
+        BuildStats::Add(Counter::PagesCompressed, 1);
+    return complete;
 }
 
-void PageRenderer::EnsureTemplates()
+bool PageRenderer::IsUpToDate(const PageRecord &record, Node *node, uint64_t source, bool templatesChanged, bool layoutChanged, LayoutHasher &layoutHasher) const
 {
-    if (!templatesInitialised)
-        Configure();
+    auto outputPath = GetOutputPath(node);
+    if (record.source != source || !filesystem::exists(outputPath))
+        return false;
+    for (auto encoding : config.precompress)
+    {
+        if (!filesystem::exists(outputPath + EncodingExtension(encoding)))
+            return false;
+    }
+
+    string url;
+    for (const auto &[path, hash] : record.assets)
+    {
+        assets.Resolve(path, url);
+        if (HashBytes(url) != hash)
+            return false;
+    }
+
+    if (templatesChanged)
+    {
+        for (const auto &[name, hash] : record.templates)
+        {
+            if (templateParser.GetTemplateHash(name) != hash)
+                return false;
+        }
+    }
+
+    if (layoutChanged)
+    {
+        for (const auto &[dependency, hash] : record.layout)
+        {
+            if (layoutHasher.Hash(dependency, node) != hash)
+                return false;
+        }
+    }
+    return true;
 }
 
-void PageRenderer::Configure()
+// Pages that are no longer part of the layout, and their compressed variants
+void PageRenderer::RemoveStaleOutputs(const vector<Node *> &pages) const
 {
-    templateParser = TemplateParser(GetGeneratorConfig().templatesPath);
-    templatesInitialised = true;
+    namespace fs = std::filesystem;
+    set<string> names;
+    for (auto page : pages)
+        names.emplace(page->name);
+
+    std::error_code ec;
+    auto outputDir = fs::path(config.outputDir);
+    if (!fs::is_directory(outputDir, ec))
+        return;
+
+    for (const auto &entry : fs::directory_iterator(outputDir, ec))
+    {
+        if (!entry.is_regular_file())
+            continue;
+        auto page = entry.path();
+        if (page.extension() == EncodingExtension(Encoding::Gzip) || page.extension() == EncodingExtension(Encoding::Zstd))
+            page = page.stem();
+        if (page.extension() == ".html" && names.count(page.stem().string()) == 0)
+            fs::remove(entry.path(), ec);
+    }
 }
 
-void PageRenderer::Reset()
+void PageRenderer::RenderToMemory(Node *node, string &html, vector<Warning> &pageWarnings) const
 {
-    templatesInitialised = false;
-    templateParser = TemplateParser();
-    currentNode = nullptr;
+    RenderContext context;
+    context.node = node;
+    context.layout = &layout;
+    context.assets = &assets;
+    RenderPage(context);
+    html = std::move(context.output);
+    pageWarnings = std::move(context.warnings);
 }
 
-void PageRenderer::Render(Node *startNode)
+string PageRenderer::GetManifestPath() const
 {
-    EnsureTemplates();
+    namespace fs = std::filesystem;
+    return (fs::path(config.outputDir) / ".meengi-manifest").string();
+}
 
-    ofstream output;
-    queue<Node *> q;
-    q.push(startNode);
-
-    while (!q.empty())
-    {
-        Node *cur = q.front();
-        PageRenderer::currentNode = cur;
-        q.pop();
-        auto children = cur->children;
-        if (children.size() != 0)
+RenderSummary PageRenderer::Render(Node *startNode, BuildState &state)
+{
+    // Pages only share read-only state (layout, templates), so the BFS order is collected up front
+    // and every page is rendered with its own context. The list doubles as the BFS queue.
+    vector<Node *> pages;
+    pages.reserve(layout.Size());
+    pages.push_back(startNode);
+    for (size_t i = 0; i < pages.size(); i++)
+    {
+        for (auto child : layout.Children(pages[i]))
+            pages.push_back(child);
+    }
+
+    // A page is skipped when its markdown, the templates it expanded and the parts of the layout it walked
+    // all hash the same as on the previous build
+    if (!state.loaded)
+    {
+        state.loaded = true;
+        PhaseTimer timer(Phase::Manifest);
+        if (!config.incremental || !state.manifest.Load(GetManifestPath()))
+            state.manifest = BuildManifest();
+    }
+    const BuildManifest &previous = state.manifest;
+    bool incremental = config.incremental && !previous.pages.empty();
+
+    BuildManifest manifest;
+    manifest.layoutHash = HashFile(config.layoutPath, config.mapFiles);
+    manifest.templatesHash = HashFile(config.templatesPath, config.mapFiles);
+    bool templatesChanged = manifest.templatesHash != previous.templatesHash;
+    bool layoutChanged = manifest.layoutHash != previous.layoutHash;
+    // Pages rendered with other output options can't be kept
+    string options = config.minify ? "minify" : "";
+    if (config.blockMarkdown)
+        options += " blocks";
+    if (!config.searchIndex.empty())
+        options += " search";
+    manifest.optionsHash = HashBytes(options);
+    if (manifest.optionsHash != previous.optionsHash)
+        incremental = false;
+    templateParser.BeginRender(manifest.layoutHash);
+    // Lines expanded against other templates or another layout can't be reused
+    if (!state.keepFragments || templatesChanged || layoutChanged)
+        state.fragments.clear();
+
+    RemoveStaleOutputs(pages);
+
+    // Pages that use $Asset$ need the URLs of this build's copies
+    RenderSummary summary;
+    {
+        PhaseTimer timer(Phase::Assets);
+        summary.assets = assets.Sync(config, previous.assets, manifest.assets);
+    }
+
+    LayoutHasher layoutHasher(layout, startNode);
+    vector<uint64_t> sources(pages.size());
+    vector<bool> upToDate(pages.size(), false);
+    vector<size_t> pending;
+    for (size_t i = 0; i < pages.size(); i++)
+    {
+        string name(pages[i]->name);
+        auto record = previous.pages.find(name);
+
+        // --watch knows which markdown files changed, the others keep their recorded hash
+        if (state.trackSources && record != previous.pages.end() && state.changedSources.count(name) == 0)
+            sources[i] = record->second.source;
+        else
+            sources[i] = HashFile(GetInputPath(pages[i]), config.mapFiles);
+
+        if (incremental && record != previous.pages.end())
+            upToDate[i] = IsUpToDate(record->second, pages[i], sources[i], templatesChanged, layoutChanged, layoutHasher);
+        if (!upToDate[i])
+            pending.push_back(i);
+    }
+
+    vector<RenderContext> contexts(pages.size());
+    vector<PageFragments> fragments(state.keepFragments ? pages.size() : 0);
+    vector<uint64_t> outputs(pages.size(), 0);
+    // Pages whose HTML or one of its variants didn't make it to disk
+    vector<char> writeFailed(pages.size(), 0);
+    std::atomic<size_t> written{0};
+    std::atomic<size_t> failed{0};
+    auto renderPage = [&](size_t i)
+    {
+        size_t page = pending[i];
+        auto &context = contexts[page];
+        context.node = pages[page];
+        context.layout = &layout;
+        context.assets = &assets;
+        if (state.keepFragments)
         {
-            for (auto child : children)
-                q.push(child);
+            auto previousFragments = state.fragments.find(string(context.node->name));
+            if (previousFragments != state.fragments.end())
+                context.previousFragments = &previousFragments->second;
+            context.fragments = &fragments[page];
         }
+        AcquireBuffers(context);
+        TraceSpan span("page", context.node->name);
+        auto start = BuildStats::Enabled() ? BuildStats::Clock::now() : BuildStats::Clock::time_point();
+        RenderPage(context);
+        // Tokenizing here keeps the index off the critical path: it runs on the workers, right behind the render
+        if (!config.searchIndex.empty())
+        {
+            PhaseTimer timer(Phase::SearchIndex, context.node->name);
+            SearchIndex::Tokenize(context.output, context.terms);
+        }
+        if (BuildStats::Enabled())
+            BuildStats::AddPage(context.node->name, std::chrono::duration_cast<std::chrono::nanoseconds>(BuildStats::Clock::now() - start).count());
 
-        auto outputPath = GetOutputPath(cur);
-        namespace fs = std::filesystem;
-        fs::create_directories(fs::path(outputPath).parent_path());
+        outputs[page] = HashBytes(context.output);
+        auto record = previous.pages.find(string(context.node->name));
+        uint64_t previousHash = record == previous.pages.end() ? 0 : record->second.output;
+        {
+            WarningCapture capture(context.warnings);
+            auto result = WritePage(context.node, context.output, outputs[page], previousHash);
+            if (result == PageWrite::Written)
+                written++;
+            // A page that didn't make it to disk is neither compressed nor recorded as written, the next build retries it
+            if (result == PageWrite::Failed)
+            {
+                writeFailed[page] = 1;
+                failed++;
+            }
+            // Compressing right behind the write keeps the HTML in the worker's buffer, and other workers keep
+            // rendering meanwhile, so compression overlaps rendering instead of running as a separate pass
+            else if (!PrecompressPage(context.node, context.output, result == PageWrite::Written))
+                writeFailed[page] = 1;
+        }
+        ReleaseBuffers(context);
+    };
+
+    unsigned jobs = config.jobs;
+    if (jobs == 0)
+        jobs = ThreadPool::DefaultWorkers();
+
+    if (jobs > 1 && pending.size() > 1)
+    {
+        ThreadPool pool(jobs);
+        pool.ParallelFor(pending.size(), renderPage);
+    }
+    else
+    {
+        for (size_t i = 0; i < pending.size(); i++)
+            renderPage(i);
+    }
+
+    // Warnings go out in page order no matter which worker raised them,
+    // skipped pages replay the ones recorded when they were last rendered
+    for (size_t i = 0; i < pages.size(); i++)
+    {
+        PageRecord record;
+        if (upToDate[i])
+            record = previous.pages.at(string(pages[i]->name));
+        else
+        {
+            const auto &context = contexts[i];
+            // No source hash for a page that failed to write, or lost a variant, keeps it from counting as up to date
+            record.source = writeFailed[i] ? 0 : sources[i];
+            record.output = writeFailed[i] ? 0 : outputs[i];
+            for (const auto &name : context.usedTemplates)
+                record.templates[name] = templateParser.GetTemplateHash(name);
+            for (auto dependency : context.layoutDependencies)
+                record.layout[dependency] = layoutHasher.Hash(dependency, pages[i]);
+            string url;
+            for (const auto &path : context.usedAssets)
+            {
+                assets.Resolve(path, url);
+                record.assets[path] = HashBytes(url);
+            }
+            record.warnings = context.warnings;
+            record.terms = std::move(contexts[i].terms);
+        }
+
+        for (const auto &warning : record.warnings)
+            warnings.Add(warning);
+        manifest.pages[string(pages[i]->name)] = std::move(record);
+    }
+    if (!config.searchIndex.empty())
+        WriteSearchIndex(pages, manifest);
+    {
+        PhaseTimer timer(Phase::Manifest);
+        manifest.Save(GetManifestPath());
+    }
+    warnings.Flush();
+    BuildStats::Add(Counter::Pages, pages.size());
+    BuildStats::Add(Counter::PagesRendered, pending.size());
+    BuildStats::Add(Counter::PagesWritten, written);
+    BuildStats::Add(Counter::PagesUnchanged, pending.size() - written - failed);
 
-        output.open(outputPath, ios::app);
-        if (output.is_open())
+    state.manifest = std::move(manifest);
+    state.changedSources.clear();
+    if (state.keepFragments)
+    {
+        // Rendered pages keep the lines they have now, lines that went away are dropped
+        std::map<string, PageFragments> kept;
+        for (size_t i = 0; i < pages.size(); i++)
         {
-            auto inputLines = GetLinesFromFile(GetInputPath(cur));
-
-            if (inputLines.size() > 0 && output.is_open())
-            {
-                for (auto line : inputLines)
-                {
-                    output << InterpretLine(line);
-                }
-            }
-            output.close();
-        }
-    }
-}
+            string name(pages[i]->name);
+            auto previousFragments = state.fragments.find(name);
+            if (!upToDate[i])
+                kept[name] = std::move(fragments[i]);
+            else if (previousFragments != state.fragments.end())
+                kept[name] = std::move(previousFragments->second);
+        }
+        state.fragments = std::move(kept);
+    }
+
+    summary.pages = pages.size();
+    summary.rendered = pending.size();
+    summary.written = written;
+    for (auto i : pending)
+        summary.minifiedBytes += contexts[i].minifiedBytes;
+    summary.unchanged = pending.size() - written - failed;
+    return summary;
+}
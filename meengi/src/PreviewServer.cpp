@@ -0,0 +1,435 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "PreviewServer.h"
+#include "FileHelpers.h"
+#include "SourceWatch.h"
+
+namespace fs = std::filesystem;
+using std::string;
+
+namespace
+{
+int HexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c = std::tolower(static_cast<unsigned char>(c));
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+// Request target to a path relative to the site, false for malformed targets and paths leaving the site
+bool DecodeTarget(const string &target, string &path)
+{
+    auto end = target.find_first_of("?#");
+    string raw = target.substr(0, end);
+    if (raw.empty() || raw[0] != '/')
+        return false;
+
+    string decoded;
+    for (size_t i = 0; i < raw.size(); i++)
+    {
+        if (raw[i] == '%')
+        {
+            if (i + 2 >= raw.size() || HexValue(raw[i + 1]) < 0 || HexValue(raw[i + 2]) < 0)
+                return false;
+            decoded += static_cast<char>(HexValue(raw[i + 1]) * 16 + HexValue(raw[i + 2]));
+            i += 2;
+        }
+        else
+            decoded += raw[i];
+    }
+    if (decoded.find('\0') != string::npos)
+        return false;
+
+    // //etc/passwd or /%2Fetc would otherwise name a file outside the site
+    fs::path relative = fs::path(decoded.substr(1)).lexically_normal();
+    if (relative.has_root_name() || relative.has_root_directory())
+        return false;
+    path = relative.generic_string();
+    if (path == ".")
+        path.clear();
+    return path.compare(0, 2, "..") != 0;
+}
+
+// Whether file, symlinks resolved, still lies under root
+bool IsUnder(const fs::path &file, const fs::path &root)
+{
+    std::error_code ec;
+    auto resolvedRoot = fs::weakly_canonical(root, ec);
+    if (ec)
+        return false;
+    auto resolvedFile = fs::weakly_canonical(file, ec);
+    if (ec)
+        return false;
+    auto relative = resolvedFile.lexically_relative(resolvedRoot);
+    return !relative.empty() && relative.native().compare(0, 2, "..") != 0;
+}
+
+string ContentType(const fs::path &path)
+{
+    static const std::map<string, string> types = {
+        {".html", "text/html; charset=utf-8"}, {".css", "text/css; charset=utf-8"}, {".js", "text/javascript; charset=utf-8"},
+        {".json", "application/json"}, {".txt", "text/plain; charset=utf-8"}, {".md", "text/plain; charset=utf-8"},
+        {".png", "image/png"}, {".jpg", "image/jpeg"}, {".jpeg", "image/jpeg"}, {".gif", "image/gif"},
+        {".webp", "image/webp"}, {".svg", "image/svg+xml"}, {".ico", "image/x-icon"}, {".pdf", "application/pdf"},
+        {".woff", "font/woff"}, {".woff2", "font/woff2"}};
+    string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c)
+                   { return std::tolower(c); });
+    auto found = types.find(extension);
+    return found == types.end() ? "application/octet-stream" : found->second;
+}
+
+const char *Reason(int status)
+{
+    switch (status)
+    {
+    case 200:
+        return "OK";
+    case 400:
+        return "Bad Request";
+    case 404:
+        return "Not Found";
+    case 405:
+        return "Method Not Allowed";
+    }
+    return "Internal Server Error";
+}
+
+PreviewResponse ErrorResponse(int status)
+{
+    PreviewResponse response;
+    response.status = status;
+    response.contentType = "text/plain; charset=utf-8";
+    response.body = std::make_shared<const string>(string(Reason(status)) + "\n");
+    return response;
+}
+} // namespace
+
+PreviewServer::PreviewServer(Generator &generator) : generator(generator)
+{
+}
+
+size_t PreviewServer::Renders() const
+{
+    return renders;
+}
+
+// Files under the assets directory are served at the asset URL, everything else from next to the content
+// directory, where e.g. links/ sits
+bool PreviewServer::ResolveFile(const string &path, PreviewResponse &response) const
+{
+    const auto &config = generator.Config();
+    fs::path root = fs::path(config.contentDir).parent_path();
+    fs::path file = root / path;
+
+    string prefix = config.assetsUrl;
+    prefix.erase(0, prefix.find_first_not_of('/'));
+    if (!config.assetsDir.empty() && prefix.find("://") == string::npos && path.compare(0, prefix.size(), prefix) == 0)
+    {
+        root = config.assetsDir;
+        file = root / path.substr(prefix.size());
+    }
+
+    std::error_code ec;
+    if (!IsUnder(file, root) || !fs::is_regular_file(file, ec))
+        return false;
+    response.filePath = file.string();
+    response.fileSize = fs::file_size(file, ec);
+    response.contentType = ContentType(file);
+    return !ec;
+}
+
+PreviewResponse PreviewServer::Get(const string &target)
+{
+    string path;
+    if (!DecodeTarget(target, path))
+        return ErrorResponse(400);
+
+    // / is the home page, /name.html and /name the page called name
+    string name = path;
+    bool page = name.empty() || fs::path(name).extension().empty();
+    if (name.size() > 5 && name.compare(name.size() - 5, 5, ".html") == 0)
+    {
+        name.resize(name.size() - 5);
+        page = true;
+    }
+    if (name.empty())
+        name = string(generator.Layout().Root()->name);
+
+    if (page)
+    {
+        PreviewResponse response;
+        auto cached = pages.find(name);
+        if (cached == pages.end())
+        {
+            string html;
+            auto start = std::chrono::steady_clock::now();
+            if (generator.RenderPage(name, html, response.warnings))
+            {
+                renders++;
+                response.renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                cached = pages.emplace(name, std::make_shared<const string>(std::move(html))).first;
+            }
+        }
+        if (cached != pages.end())
+        {
+            response.contentType = "text/html; charset=utf-8";
+            response.body = cached->second;
+            return response;
+        }
+    }
+
+    PreviewResponse response;
+    if (ResolveFile(path, response))
+        return response;
+    return ErrorResponse(404);
+}
+
+void PreviewServer::Invalidate(const SourceChanges &changes)
+{
+    generator.Reload(changes);
+    if (changes.layout || changes.templates || changes.lost)
+        pages.clear();
+    else
+    {
+        for (const auto &name : changes.pages)
+            pages.erase(name);
+    }
+}
+
+void PreviewServer::Invalidate(const std::set<string> &changedPaths)
+{
+    SourceChanges changes;
+    for (const auto &path : changedPaths)
+        changes.Add(generator.Config(), path);
+    Invalidate(changes);
+}
+
+void PreviewServer::InvalidateAll()
+{
+    SourceChanges changes;
+    changes.lost = true;
+    Invalidate(changes);
+}
+
+#ifdef __linux__
+namespace
+{
+bool SendAll(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        auto sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+bool SendFile(int fd, const string &path, uint64_t size)
+{
+    int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0)
+        return false;
+    off_t offset = 0;
+    bool ok = true;
+    while (ok && static_cast<uint64_t>(offset) < size)
+        ok = sendfile(fd, file, &offset, size - offset) > 0;
+    close(file);
+    return ok;
+}
+
+string HeaderValue(const string &headers, const string &name)
+{
+    string lower = headers;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c)
+                   { return std::tolower(c); });
+    auto pos = lower.find("\r\n" + name + ":");
+    if (pos == string::npos)
+        return "";
+    pos += name.size() + 3;
+    auto end = lower.find("\r\n", pos);
+    return Trim(lower.substr(pos, end - pos));
+}
+
+struct Connection
+{
+    int fd;
+    string buffer;
+};
+} // namespace
+
+void PreviewServer::Respond(int client, const string &method, const string &target, bool keepAlive)
+{
+    PreviewResponse response;
+    if (method.empty())
+        response = ErrorResponse(400);
+    else if (method == "GET" || method == "HEAD")
+        response = Get(target);
+    else
+        response = ErrorResponse(405);
+
+    // A file can vanish between the lookup and the open, fstat tells before the headers go out
+    struct stat info;
+    if (!response.filePath.empty() && (stat(response.filePath.c_str(), &info) != 0 || static_cast<uint64_t>(info.st_size) != response.fileSize))
+        response = ErrorResponse(404);
+
+    uint64_t length = response.body ? response.body->size() : response.fileSize;
+    string headers = "HTTP/1.1 " + std::to_string(response.status) + " " + Reason(response.status) + "\r\n";
+    headers += "Content-Type: " + response.contentType + "\r\n";
+    headers += "Content-Length: " + std::to_string(length) + "\r\n";
+    headers += "Cache-Control: no-store\r\n";
+    if (response.status == 405)
+        headers += "Allow: GET, HEAD\r\n";
+    headers += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+
+    bool ok = SendAll(client, headers.data(), headers.size());
+    if (ok && method != "HEAD")
+    {
+        if (response.body)
+            ok = SendAll(client, response.body->data(), response.body->size());
+        else if (!response.filePath.empty())
+            ok = SendFile(client, response.filePath, response.fileSize);
+    }
+
+    if (response.renderMs >= 0)
+    {
+        std::cout << "Rendered " << target << " in " << response.renderMs << " ms" << std::endl;
+        for (const auto &warning : response.warnings)
+            std::cerr << generator.Warnings().Format(warning) << std::endl;
+    }
+    else if (response.status != 200)
+        std::cout << method << " " << target << " " << response.status << std::endl;
+    (void)ok;
+}
+
+int PreviewServer::Run(uint16_t port)
+{
+    const auto &config = generator.Config();
+    generator.LinkAssets();
+
+    int server = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (server < 0 || bind(server, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(server, 16) != 0)
+    {
+        std::cerr << "Cannot listen on 127.0.0.1:" << port << std::endl;
+        return 1;
+    }
+
+    SourceWatch watch(config);
+    if (!watch.Open())
+        return 1;
+
+    std::cout << "Serving " << config.contentDir << " on http://127.0.0.1:" << port << "/" << std::endl;
+
+    // One thread: the listening socket, the inotify descriptor and every open connection are polled together.
+    // Requests are small and pages come from the cache or one render, so nothing waits long.
+    std::vector<Connection> connections;
+    char buffer[16 * 1024];
+    while (true)
+    {
+        std::vector<pollfd> fds = {{server, POLLIN, 0}, {watch.Descriptor(), POLLIN, 0}};
+        for (const auto &connection : connections)
+            fds.push_back({connection.fd, POLLIN, 0});
+        if (poll(fds.data(), fds.size(), -1) < 0)
+            continue;
+
+        if (fds[1].revents & POLLIN)
+        {
+            SourceChanges changes;
+            watch.Read(changes);
+            if (!changes.Empty())
+                Invalidate(changes);
+        }
+
+        std::vector<Connection> open;
+        for (size_t i = 0; i < connections.size(); i++)
+        {
+            auto &connection = connections[i];
+            bool keep = true;
+            if (fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                auto length = recv(connection.fd, buffer, sizeof(buffer), 0);
+                keep = length > 0;
+                if (keep)
+                    connection.buffer.append(buffer, length);
+            }
+
+            // Pipelined requests are answered in order; requests with a body are not supported
+            size_t end;
+            while (keep && (end = connection.buffer.find("\r\n\r\n")) != string::npos)
+            {
+                string headers = connection.buffer.substr(0, end + 2);
+                connection.buffer.erase(0, end + 4);
+
+                auto lineEnd = headers.find("\r\n");
+                string line = headers.substr(0, lineEnd);
+                auto first = line.find(' ');
+                auto second = line.rfind(' ');
+                if (first == string::npos || second == first)
+                {
+                    Respond(connection.fd, "", "", false);
+                    keep = false;
+                    break;
+                }
+                string method = line.substr(0, first);
+                string target = line.substr(first + 1, second - first - 1);
+                string version = line.substr(second + 1);
+                string connectionHeader = HeaderValue(headers, "connection");
+                string contentLength = HeaderValue(headers, "content-length");
+                bool hasBody = (!contentLength.empty() && contentLength != "0") || !HeaderValue(headers, "transfer-encoding").empty();
+
+                keep = !hasBody && (version == "HTTP/1.1" ? connectionHeader != "close" : connectionHeader == "keep-alive");
+                Respond(connection.fd, hasBody ? "" : method, target, keep);
+            }
+            if (connection.buffer.size() > sizeof(buffer))
+                keep = false;
+
+            if (keep)
+                open.push_back(std::move(connection));
+            else
+                close(connection.fd);
+        }
+        connections = std::move(open);
+
+        if (fds[0].revents & POLLIN)
+        {
+            int client = accept4(server, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client >= 0)
+                connections.push_back({client, ""});
+        }
+    }
+}
+#else
+int PreviewServer::Run(uint16_t)
+{
+    std::cerr << "--serve needs inotify and is only available on Linux" << std::endl;
+    return 1;
+}
+#endif
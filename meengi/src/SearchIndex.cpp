@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <unordered_set>
+
+#include "SearchIndex.h"
+#include "BuildStats.h"
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+namespace
+{
+constexpr size_t npos = string_view::npos;
+constexpr size_t minTermLength = 2;
+constexpr size_t maxTermLength = 64;
+
+bool IsWordByte(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+bool IsAlpha(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+char Lower(char c)
+{
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+// Whether the tag starting at pos ("<name") is name, in any case
+bool IsTag(string_view html, size_t pos, string_view name)
+{
+    if (pos + 1 + name.size() > html.size())
+        return false;
+    for (size_t i = 0; i < name.size(); i++)
+    {
+        if (Lower(html[pos + 1 + i]) != name[i])
+            return false;
+    }
+    size_t end = pos + 1 + name.size();
+    return end == html.size() || !IsAlpha(html[end]);
+}
+
+// Position just past the markup starting at the '<' at pos, or pos + 1 when it is a lone '<'
+size_t SkipMarkup(string_view html, size_t pos)
+{
+    if (html.compare(pos, 4, "<!--") == 0)
+    {
+        auto end = html.find("-->", pos + 4);
+        return end == npos ? html.size() : end + 3;
+    }
+    if (pos + 1 >= html.size() || !(IsAlpha(html[pos + 1]) || html[pos + 1] == '/' || html[pos + 1] == '!'))
+        return pos + 1;
+
+    auto end = html.find('>', pos);
+    if (end == npos)
+        return html.size();
+    end++;
+
+    // Script and style content is not text
+    for (string_view raw : {"script", "style"})
+    {
+        if (!IsTag(html, pos, raw))
+            continue;
+        for (auto close = html.find("</", end); close != npos; close = html.find("</", close + 2))
+        {
+            if (IsTag(html, close + 1, raw))
+            {
+                auto closeEnd = html.find('>', close);
+                return closeEnd == npos ? html.size() : closeEnd + 1;
+            }
+        }
+        return html.size();
+    }
+    return end;
+}
+
+void AppendJsonString(string &out, string_view text)
+{
+    out += '"';
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            const char *hex = "0123456789abcdef";
+            out += "\\u00";
+            out += hex[(c >> 4) & 0xf];
+            out += hex[c & 0xf];
+        }
+        else
+            out += c;
+    }
+    out += '"';
+}
+} // namespace
+
+void SearchIndex::Tokenize(string_view html, vector<string> &terms)
+{
+    // Words are lowercased into a per-thread copy of the text and deduplicated as views into it,
+    // only the distinct ones are sorted and become strings
+    thread_local string lowered;
+    thread_local std::unordered_set<string_view> words;
+    thread_local vector<string_view> sorted;
+    lowered.assign(html.data(), html.size());
+    words.clear();
+
+    size_t i = 0;
+    while (i < html.size())
+    {
+        char c = html[i];
+        if (IsWordByte(static_cast<unsigned char>(c)))
+        {
+            size_t start = i;
+            for (; i < html.size() && IsWordByte(static_cast<unsigned char>(html[i])); i++)
+                lowered[i] = Lower(html[i]);
+            if (i - start >= minTermLength && i - start <= maxTermLength)
+                words.emplace(lowered.data() + start, i - start);
+            continue;
+        }
+
+        if (c == '<')
+            i = SkipMarkup(html, i);
+        else if (c == '&')
+        {
+            // &amp; &#39; ... are word breaks, whatever they stand for
+            auto semicolon = html.substr(0, i + 12).find(';', i);
+            bool entity = semicolon != npos;
+            for (size_t j = i + 1; entity && j < semicolon; j++)
+                entity = IsAlpha(html[j]) || (html[j] >= '0' && html[j] <= '9') || html[j] == '#';
+            i = entity ? semicolon + 1 : i + 1;
+        }
+        else
+            i++;
+    }
+
+    sorted.assign(words.begin(), words.end());
+    std::sort(sorted.begin(), sorted.end());
+    terms.assign(sorted.begin(), sorted.end());
+}
+
+string SearchIndex::Build(const vector<string> &pages, const vector<const vector<string> *> &terms)
+{
+    // Every page's terms are sorted, so a k-way merge over the pages yields the words in order and, with ties
+    // going to the lower page, each posting list in page order. Nothing is hashed or sorted again.
+    struct Cursor
+    {
+        string_view term;
+        uint32_t page;
+        size_t next;
+    };
+    auto after = [](const Cursor &a, const Cursor &b)
+    { return a.term != b.term ? a.term > b.term : a.page > b.page; };
+    vector<Cursor> heap;
+    for (size_t page = 0; page < terms.size(); page++)
+    {
+        if (!terms[page]->empty())
+            heap.push_back({terms[page]->front(), static_cast<uint32_t>(page), 1});
+    }
+    std::make_heap(heap.begin(), heap.end(), after);
+
+    string out = "{\"version\":1,\"pages\":[";
+    for (size_t i = 0; i < pages.size(); i++)
+    {
+        if (i > 0)
+            out += ',';
+        AppendJsonString(out, pages[i]);
+    }
+    out += "],\"terms\":{";
+
+    size_t words = 0;
+    string_view word;
+    uint32_t previous = 0;
+    char digits[16];
+    while (!heap.empty())
+    {
+        std::pop_heap(heap.begin(), heap.end(), after);
+        auto &cursor = heap.back();
+        if (words == 0 || cursor.term != word)
+        {
+            if (words > 0)
+                out += "],";
+            word = cursor.term;
+            AppendJsonString(out, word);
+            out += ":[";
+            previous = 0;
+            words++;
+        }
+        else
+            out += ',';
+        auto end = std::to_chars(digits, digits + sizeof(digits), cursor.page - previous).ptr;
+        out.append(digits, end);
+        previous = cursor.page;
+
+        const auto &list = *terms[cursor.page];
+        if (cursor.next < list.size())
+        {
+            cursor.term = list[cursor.next++];
+            std::push_heap(heap.begin(), heap.end(), after);
+        }
+        else
+            heap.pop_back();
+    }
+    if (words > 0)
+        out += ']';
+    out += "}}\n";
+    BuildStats::Add(Counter::SearchTerms, words);
+    return out;
+}
@@ -1,33 +1,363 @@
 #include "ShortHandParser.h"
+#include "DelimiterSet.h"
+#include <regex>
 
 using std::regex;
 using std::string;
+using std::string_view;
 using std::regex_replace;
 
+namespace
+{
+constexpr size_t npos = string_view::npos;
+
+// Characters the scanner has to stop at, everything else is copied as is
+const DelimiterSet interesting("*`#/\n\r");
+const DelimiterSet lineBreaks("\n\r");
+const DelimiterSet codeStops("`#\n\r");
+
+// Same set as \s in std::regex
+bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+// '.' in std::regex stops at these
+bool IsLineBreak(char c)
+{
+    return c == '\n' || c == '\r';
+}
+
+// The scanner reproduces the old chain of regex_replace calls in a single walk:
+//   blockquote -> bold -> italic -> heading -> code -> /nl -> /hline
+// Every pass only swaps its delimiters for tags, so each delimiter can be resolved against the
+// original text with a lookahead that stops at the end of the line. The only thing that changes
+// line structure is the heading pass, whose \s* can swallow line breaks, which matters for the
+// code pass only (bold and italic ran before it).
+class ShortHandScanner
+{
+private:
+    string_view text;
+    string &out;
+
+    size_t lineEnd = 0;     // end of the current source line, bold and italic never cross it
+    size_t boldClose = npos;   // position of the pending closing **
+    size_t italicClose = npos; // position of the pending closing *
+    size_t codeClose = npos;   // position of the pending closing ```
+    bool boldDead = false;  // no ** pair left on this line
+    bool codeDead = false;  // no ``` pair left on this line
+    bool heading = false;   // inside <h1> until the next line break
+
+    size_t NextBreak(size_t from) const
+    {
+        auto pos = lineBreaks.Find(text, from);
+        return pos == npos ? text.size() : pos;
+    }
+
+    size_t FindOnLine(size_t from, string_view delim) const
+    {
+        if (from >= lineEnd)
+            return npos;
+        auto pos = text.substr(0, lineEnd).find(delim, from);
+        return pos;
+    }
+
+    // Skips \s* after a heading marker; crossing a line break starts a new source line
+    size_t SkipHeadingSpace(size_t pos)
+    {
+        bool crossed = false;
+        while (pos < text.size() && IsSpace(text[pos]))
+        {
+            if (IsLineBreak(text[pos]))
+                crossed = true;
+            pos++;
+        }
+        if (crossed)
+        {
+            boldDead = false;
+            lineEnd = NextBreak(pos);
+        }
+        return pos;
+    }
+
+    // Next '*' on this line that the bold pass leaves behind
+    size_t NextFreeStar(size_t from) const
+    {
+        size_t close = boldClose;
+        bool dead = boldDead;
+        size_t pos = from;
+        while (pos < lineEnd)
+        {
+            pos = text.find('*', pos);
+            if (pos == npos || pos >= lineEnd)
+                return npos;
+
+            if (pos == close)
+            {
+                close = npos;
+                pos += 2;
+                continue;
+            }
+            if (close == npos && !dead && pos + 1 < lineEnd && text[pos + 1] == '*')
+            {
+                auto found = FindOnLine(pos + 2, "**");
+                if (found != npos)
+                {
+                    close = found;
+                    pos += 2;
+                    continue;
+                }
+                dead = true;
+            }
+            return pos;
+        }
+        return npos;
+    }
+
+    // Closing ``` for the code pass, which sees the text after headings swallowed their whitespace
+    size_t FindCodeClose(size_t from) const
+    {
+        bool inHeading = heading;
+        size_t pos = from;
+        while (pos < text.size())
+        {
+            pos = codeStops.Find(text, pos);
+            if (pos == npos)
+                return npos;
+
+            char c = text[pos];
+            if (c == '`')
+            {
+                if (text.compare(pos, 3, "```") == 0)
+                    return pos;
+                pos++;
+            }
+            else if (c == '#')
+            {
+                pos++;
+                if (!inHeading)
+                {
+                    inHeading = true;
+                    while (pos < text.size() && IsSpace(text[pos]))
+                        pos++;
+                }
+            }
+            else
+                return npos;
+        }
+        return npos;
+    }
+
+    size_t OnStar(size_t pos)
+    {
+        if (boldClose == npos && !boldDead && pos + 1 < lineEnd && text[pos + 1] == '*')
+        {
+            auto close = FindOnLine(pos + 2, "**");
+            if (close != npos)
+            {
+                out += "<b>";
+                boldClose = close;
+                return pos + 2;
+            }
+            boldDead = true;
+        }
+
+        auto partner = NextFreeStar(pos + 1);
+        if (partner != npos)
+        {
+            out += "<i>";
+            italicClose = partner;
+        }
+        else
+            out += '*';
+        return pos + 1;
+    }
+
+    size_t OnBacktick(size_t pos)
+    {
+        if (codeClose == npos && !codeDead && text.compare(pos, 3, "```") == 0)
+        {
+            auto close = FindCodeClose(pos + 3);
+            if (close != npos)
+            {
+                out += "<pre>";
+                codeClose = close;
+                return pos + 3;
+            }
+            codeDead = true;
+        }
+        out += '`';
+        return pos + 1;
+    }
+
+    size_t OnSlash(size_t pos)
+    {
+        if (text.compare(pos, 3, "/nl") == 0)
+        {
+            out += "<br><br>";
+            return pos + 3;
+        }
+        if (text.compare(pos, 6, "/hline") == 0)
+        {
+            out += "<div class=\" hrcls\"><hr></ div>";
+            return pos + 6;
+        }
+        out += '/';
+        return pos + 1;
+    }
+
+    size_t OnLineBreak(size_t pos)
+    {
+        if (heading)
+        {
+            out += "</h1>";
+            heading = false;
+        }
+        boldDead = false;
+        codeDead = false;
+        out += text[pos];
+        lineEnd = NextBreak(pos + 1);
+        return pos + 1;
+    }
+
+public:
+    ShortHandScanner(string_view text, string &out) : text(text), out(out)
+    {
+    }
+
+    void Run()
+    {
+        size_t pos = 0;
+        bool quote = false;
+
+        // Blockquote only applies when the rest of the text is a single line
+        if (!text.empty() && text[0] == '>')
+        {
+            size_t start = 1;
+            while (start < text.size() && IsSpace(text[start]))
+                start++;
+            if (lineBreaks.Find(text, start) == npos)
+            {
+                out += "<blockquote>";
+                pos = start;
+                quote = true;
+            }
+        }
+
+        lineEnd = NextBreak(pos);
+        while (pos < text.size())
+        {
+            if (pos == boldClose)
+            {
+                out += "</b>";
+                boldClose = npos;
+                pos += 2;
+                continue;
+            }
+            if (pos == italicClose)
+            {
+                out += "</i>";
+                italicClose = npos;
+                pos += 1;
+                continue;
+            }
+            if (pos == codeClose)
+            {
+                out += "</pre>";
+                codeClose = npos;
+                pos += 3;
+                continue;
+            }
+
+            switch (text[pos])
+            {
+            case '*':
+                pos = OnStar(pos);
+                break;
+            case '`':
+                pos = OnBacktick(pos);
+                break;
+            case '#':
+                if (!heading)
+                {
+                    out += "<h1>";
+                    heading = true;
+                    pos = SkipHeadingSpace(pos + 1);
+                }
+                else
+                    out += text[pos++];
+                break;
+            case '/':
+                pos = OnSlash(pos);
+                break;
+            case '\n':
+            case '\r':
+                pos = OnLineBreak(pos);
+                break;
+            default:
+            {
+                auto next = interesting.Find(text, pos);
+                if (next == npos)
+                    next = text.size();
+                out.append(text.data() + pos, next - pos);
+                pos = next;
+            }
+            }
+        }
+
+        if (quote)
+            out += "</blockquote>";
+        if (heading)
+            out += "</h1>";
+    }
+};
+} // namespace
+
 ShortHandParser::ShortHandParser() {};
 
-string ShortHandParser::Parse(const string &iLine)
+string ShortHandParser::Parse(const string &iLine) const
+{
+    string ret;
+    ret.reserve(iLine.size() + 16);
+    Parse(string_view(iLine), ret);
+    return ret;
+}
+
+void ShortHandParser::Parse(string_view iLine, string &out) const
+{
+    ShortHandScanner(iLine, out).Run();
+}
+
+string ShortHandParser::ParseRegex(const string &iLine) const
 {
+    static const regex blockquote("^>\\s*(.*)$");
+    static const regex bold("\\*\\*(.*?)\\*\\*");
+    static const regex italic("\\*(.*?)\\*");
+    static const regex heading("#\\s*(.*)");
+    static const regex code("```(.*?)```");
+    static const regex newLine("/nl");
+    static const regex hline("/hline");
+
     string modifiedLine = iLine;
 
     // Replace blockquote (handle blockquote separately)
-    modifiedLine = regex_replace(modifiedLine, regex("^>\\s*(.*)$"), "<blockquote>$1</blockquote>");
+    modifiedLine = regex_replace(modifiedLine, blockquote, "<blockquote>$1</blockquote>");
 
     // Replace bold and italic (these must be processed separately to handle inner text)
-    modifiedLine = regex_replace(modifiedLine, regex("\\*\\*(.*?)\\*\\*"), "<b>$1</b>");
-    modifiedLine = regex_replace(modifiedLine, regex("\\*(.*?)\\*"), "<i>$1</i>");
+    modifiedLine = regex_replace(modifiedLine, bold, "<b>$1</b>");
+    modifiedLine = regex_replace(modifiedLine, italic, "<i>$1</i>");
 
     // Replace headings (this is for # heading style, ensuring it's processed separately)
-    modifiedLine = regex_replace(modifiedLine, regex("#\\s*(.*)"), "<h1>$1</h1>");
+    modifiedLine = regex_replace(modifiedLine, heading, "<h1>$1</h1>");
 
     // Replace code block (using triple backticks for preformatted text)
-    modifiedLine = regex_replace(modifiedLine, regex("```(.*?)```"), "<pre>$1</pre>");
+    modifiedLine = regex_replace(modifiedLine, code, "<pre>$1</pre>");
 
     // Replace // with <br><br>
-    modifiedLine = regex_replace(modifiedLine, regex("/nl"), "<br><br>");
+    modifiedLine = regex_replace(modifiedLine, newLine, "<br><br>");
 
     // Replace /hline with <div class=\"hrcls\"><hr></ div>
-    modifiedLine = regex_replace(modifiedLine, regex("/hline"), "<div class=\" hrcls\"><hr></ div>");
+    modifiedLine = regex_replace(modifiedLine, hline, "<div class=\" hrcls\"><hr></ div>");
 
     return modifiedLine; // Return the modified line with HTML tags
 };
@@ -0,0 +1,107 @@
+#include <chrono>
+#include <iostream>
+
+#ifdef __linux__
+#include <poll.h>
+#endif
+
+#include "SiteWatcher.h"
+#include "FileHelpers.h"
+#include "BuildStats.h"
+
+using std::string;
+
+SiteWatcher::SiteWatcher(Generator &generator) : generator(generator)
+{
+    state.trackSources = true;
+    state.keepFragments = true;
+}
+
+RenderSummary SiteWatcher::Build()
+{
+    StatsWindow window;
+    auto summary = generator.Render(state);
+    BuildStats::Report(generator.Config(), window);
+    return summary;
+}
+
+RenderSummary SiteWatcher::Rebuild(const SourceChanges &changes)
+{
+    auto started = std::chrono::steady_clock::now();
+    const auto &config = generator.Config();
+    StatsWindow window;
+
+    generator.Reload(changes);
+    if (changes.lost)
+    {
+        // A fresh state loads the manifest from disk again and, not tracking sources, hashes every page's markdown
+        state = BuildState();
+        state.keepFragments = true;
+    }
+    else
+        state.changedSources.insert(changes.pages.begin(), changes.pages.end());
+
+    auto summary = generator.Render(state);
+    state.trackSources = true;
+    BuildStats::Report(config, window);
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - started;
+    std::cout << "Rebuilt " << summary.rendered << " of " << summary.pages << " pages (" << summary.written << " written) in " << elapsed.count() << " ms" << std::endl;
+    return summary;
+}
+
+RenderSummary SiteWatcher::Rebuild(const std::set<string> &changedPaths)
+{
+    SourceChanges changes;
+    for (const auto &path : changedPaths)
+        changes.Add(generator.Config(), path);
+    return Rebuild(changes);
+}
+
+RenderSummary SiteWatcher::RebuildAll()
+{
+    SourceChanges changes;
+    changes.lost = true;
+    return Rebuild(changes);
+}
+
+#ifdef __linux__
+int SiteWatcher::Run()
+{
+    const auto &config = generator.Config();
+    auto summary = Build();
+    std::cout << "Built " << summary.rendered << " of " << summary.pages << " pages (" << summary.written << " written), watching " << config.contentDir << std::endl;
+
+    SourceWatch watch(config);
+    if (!watch.Open())
+        return 1;
+
+    while (true)
+    {
+        SourceChanges changes;
+
+        // Block for the first event, then give the editor a moment to finish writing before rebuilding
+        int timeout = -1;
+        while (true)
+        {
+            pollfd pfd = {watch.Descriptor(), POLLIN, 0};
+            int ready = poll(&pfd, 1, timeout);
+            if (ready < 0)
+                return 1;
+            if (ready == 0)
+                break;
+            watch.Read(changes);
+            timeout = 20;
+        }
+
+        if (!changes.Empty())
+            Rebuild(changes);
+    }
+}
+#else
+int SiteWatcher::Run()
+{
+    std::cerr << "--watch needs inotify and is only available on Linux" << std::endl;
+    return 1;
+}
+#endif
@@ -0,0 +1,110 @@
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "SourceWatch.h"
+
+namespace fs = std::filesystem;
+using std::string;
+
+namespace
+{
+bool SamePath(const fs::path &a, const fs::path &b)
+{
+    std::error_code ec;
+    return fs::weakly_canonical(a, ec) == fs::weakly_canonical(b, ec);
+}
+} // namespace
+
+void SourceChanges::Add(const GeneratorConfig &config, const string &changed)
+{
+    fs::path path(changed);
+    if (SamePath(path, config.layoutPath))
+        layout = true;
+    else if (SamePath(path, config.templatesPath))
+        templates = true;
+    else if (path.extension() == ".md" && SamePath(path.parent_path(), config.contentDir))
+        pages.insert(path.stem().string());
+}
+
+bool SourceChanges::Empty() const
+{
+    return !layout && !templates && !lost && pages.empty();
+}
+
+SourceWatch::SourceWatch(const GeneratorConfig &config) : config(config)
+{
+}
+
+#ifdef __linux__
+SourceWatch::~SourceWatch()
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+bool SourceWatch::Open()
+{
+    fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (fd < 0)
+    {
+        std::cerr << "Failed to start inotify" << std::endl;
+        return false;
+    }
+
+    std::set<fs::path> directories = {fs::path(config.contentDir),
+                                      fs::path(config.layoutPath).parent_path(),
+                                      fs::path(config.templatesPath).parent_path()};
+    for (const auto &dir : directories)
+    {
+        int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_MOVED_FROM);
+        if (wd >= 0)
+            watched[wd] = dir;
+        else
+            std::cerr << "Cannot watch " << dir << std::endl;
+    }
+    return true;
+}
+
+void SourceWatch::Read(SourceChanges &changes)
+{
+    alignas(inotify_event) char events[64 * 1024];
+    ssize_t length;
+    while ((length = read(fd, events, sizeof(events))) > 0)
+    {
+        for (char *pos = events; pos < events + length;)
+        {
+            auto event = reinterpret_cast<inotify_event *>(pos);
+            // The queue overflowed (wd is -1 then), the events that didn't fit are gone
+            if (event->mask & IN_Q_OVERFLOW)
+                changes.lost = true;
+            auto dir = watched.find(event->wd);
+            if (dir != watched.end() && event->len > 0)
+                changes.Add(config, (dir->second / event->name).string());
+            pos += sizeof(inotify_event) + event->len;
+        }
+    }
+}
+#else
+SourceWatch::~SourceWatch()
+{
+}
+
+bool SourceWatch::Open()
+{
+    std::cerr << "Watching needs inotify and is only available on Linux" << std::endl;
+    return false;
+}
+
+void SourceWatch::Read(SourceChanges &)
+{
+}
+#endif
+
+int SourceWatch::Descriptor() const
+{
+    return fd;
+}
@@ -0,0 +1,155 @@
+#include <algorithm>
+
+#include "TemplateCompiler.h"
+#include "FileHelpers.h"
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+namespace
+{
+// text as a C++ string_view literal, broken into one piece per line of text. Anything but printable ASCII
+// is an octal escape, which is never longer than three digits so it can't run into the next character.
+string Quote(string_view text, string_view indent)
+{
+    string out = "\"";
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        unsigned char c = text[i];
+        if (c == '\n')
+        {
+            out += "\\n";
+            if (i + 1 < text.size())
+            {
+                out += "\"\n";
+                out += indent;
+                out += "    \"";
+            }
+        }
+        else if (c == '\t')
+            out += "\\t";
+        else if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += static_cast<char>(c);
+        }
+        else if (c < 0x20 || c >= 0x7f)
+        {
+            out += '\\';
+            out += static_cast<char>('0' + (c >> 6));
+            out += static_cast<char>('0' + ((c >> 3) & 7));
+            out += static_cast<char>('0' + (c & 7));
+        }
+        else
+            out += static_cast<char>(c);
+    }
+    out += "\"sv";
+    return out;
+}
+
+string Hex(uint64_t value)
+{
+    return "0x" + ToHex(value) + "ull";
+}
+} // namespace
+
+void TemplateCompiler::EmitOps(const Template &temp, const vector<TemplateOp> &ops, string_view target, string_view indent, string &out)
+{
+    auto line = [&](const string &code)
+    {
+        out += indent;
+        out += code;
+        out += '\n';
+    };
+
+    for (const auto &op : ops)
+    {
+        switch (op.kind)
+        {
+        case TemplateOp::Kind::Literal:
+            line(string(target) + " += " + Quote(op.text, indent) + ";");
+            break;
+        case TemplateOp::Kind::Slot:
+        {
+            // Template::Parse: the first arity placeholders are filled when their argument was passed,
+            // the ones after only when all arity arguments were
+            auto argument = std::to_string(temp.ArgsOrder[op.slot]);
+            if (op.slot < temp.arity)
+                line("if (inputArgs.size() > " + argument + ")");
+            else
+                line("if (inputArgs.size() >= " + std::to_string(temp.arity) + ")");
+            line("    " + string(target) + " += inputArgs[" + argument + "];");
+            break;
+        }
+        case TemplateOp::Kind::Invoke:
+            line("{");
+            if (op.parts.empty())
+            {
+                string args = "TemplateArgs()";
+                if (!op.args.empty())
+                {
+                    string values;
+                    for (const auto &arg : op.args)
+                        values += (values.empty() ? "" : ", ") + Quote(arg, indent);
+                    line("    static constexpr std::string_view invokeArgs[] = {" + values + "};");
+                    args = "TemplateArgs(invokeArgs, " + std::to_string(op.args.size()) + ")";
+                }
+                line("    parser.InvokeCompiled(" + Quote(op.name, indent) + ", " + args + ", context, " + string(target) + ");");
+            }
+            else
+            {
+                line("    ExpansionScratch invocation(context);");
+                EmitOps(temp, op.parts, "invocation.text", string(indent) + "    ", out);
+                line("    parser.InvokeCompiled(invocation, context, " + string(target) + ");");
+            }
+            line("}");
+            break;
+        }
+    }
+}
+
+string TemplateCompiler::EmitCpp(const TemplateParser &parser, uint64_t templatesHash)
+{
+    vector<string> names;
+    for (const auto &entry : parser.TemplateMap)
+        names.push_back(entry.first);
+    std::sort(names.begin(), names.end());
+
+    string out = "// Generated by meengi --emit-cpp from templates.md, do not edit.\n"
+                 "// Linked into meengi, it expands these templates instead of reading templates.md for as long as\n"
+                 "// templates.md hashes to the value at the end.\n"
+                 "#include \"TemplateParser.h\"\n"
+                 "\n"
+                 "using namespace std::string_view_literals;\n"
+                 "\n"
+                 "namespace\n"
+                 "{\n";
+
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        const Template &temp = parser.TemplateMap.at(names[i]);
+        out += "// $" + names[i] + "$\n";
+        out += "void Expand" + std::to_string(i) + "(const TemplateParser &parser, TemplateArgs inputArgs, RenderContext &context, std::string &out)\n{\n";
+        EmitOps(temp, temp.GetOps(), "out", "    ", out);
+        out += "}\n\n";
+    }
+
+    string templates = "nullptr";
+    if (!names.empty())
+    {
+        out += "const CompiledTemplate templates[] = {\n";
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            out += "    {" + Quote(names[i], "    ") + ", " + Hex(parser.GetTemplateHash(names[i])) + ", " + (parser.IsCacheable(names[i]) ? "true" : "false") +
+                   ", Expand" + std::to_string(i) + "},\n";
+        }
+        out += "};\n\n";
+        templates = "templates";
+    }
+
+    out += "const CompiledTemplateSet compiledTemplates = {" + Hex(templatesHash) + ", " + templates + ", " + std::to_string(names.size()) + "};\n";
+    out += "const bool linked = (CompiledTemplateSet::Link(&compiledTemplates), true);\n";
+    out += "} // namespace\n";
+    return out;
+}
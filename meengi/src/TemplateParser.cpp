@@ -1,225 +1,849 @@
+#include <algorithm>
+#include <mutex>
+
 #include "TemplateParser.h"
 #include "FileHelpers.h"
-#include "PageRenderer.h"
-#include "GeneratorConfig.h"
+#include "LayoutParser.h"
+#include "BuildStats.h"
+#include "AssetPipeline.h"
 
 using std::string;
+using std::string_view;
 using std::vector;
 
 Template::Template(const vector<int> &argOrder, const vector<string> &contentSalami) : ArgsOrder(argOrder), ContentSalami(contentSalami)
-{
-}
-
-Template::Template()
-{
-}
-
-// First content salami slice + ArgOrder[0]th argument + second content salami slice + ArgOrder[1]th argument ...
-// If less arguments are passed then rest are assumed to be empty
-// If more arguments are passed then extra are ignored
-string Template::Parse(const vector<string> &inputArgs)
-{
-    string ret = ContentSalami[0];
-
-    int n = (Max(ArgsOrder) > inputArgs.size()) ? Max(ArgsOrder) : ArgsOrder.size();
-    int i;
-    for (i = 0; i < n; i++)
-    {
-        if (ArgsOrder[i] < (int)inputArgs.size())
-            ret += inputArgs[ArgsOrder[i]];
-        ret += ContentSalami[i + 1];
-    }
-
-    // Less than required arguments were given
-    i++;
-    while (i < (int)ContentSalami.size())
-        ret += ContentSalami[i++];
-
-    return ret;
-}
-
-std::set<string> TemplateParser::currentTemplates = std::set<string>();
-TemplateParser::TemplateParser() : TemplateParser(GetGeneratorConfig().templatesPath)
-{
-}
-
-TemplateParser::TemplateParser(const std::string &templatePath)
-{
-    auto Lines = GetLinesFromFile(templatePath);
-
-    bool foundTemplate = false;
-    vector<string> args = vector<string>();
-
-    string title;
-    string templateText;
-
-    for (auto line : Lines)
-    {
+{
+    hash = HashBytes("");
+    for (size_t i = 0; i < ContentSalami.size(); i++)
+    {
+        hash = HashBytes(ContentSalami[i], hash);
+        if (i < ArgsOrder.size())
+            hash = HashBytes("$$" + std::to_string(ArgsOrder[i]) + "$$", hash);
+    }
+    Compile();
+}
+
+uint64_t Template::Hash() const
+{
+    return hash;
+}
+
+const vector<TemplateOp> &Template::GetOps() const
+{
+    return Ops;
+}
+
+bool Template::GetInvokedNames(std::set<string> &names) const
+{
+    for (const auto &op : Ops)
+    {
+        if (op.kind != TemplateOp::Kind::Invoke)
+            continue;
+        if (op.parts.empty())
+        {
+            names.insert(op.name);
+            continue;
+        }
+
+        // Placeholders only in the arguments still leave a fixed name
+        string prefix;
+        for (const auto &part : op.parts)
+        {
+            if (part.kind != TemplateOp::Kind::Literal)
+                break;
+            prefix += part.text;
+        }
+        if (prefix.find('(') == string::npos)
+            return false;
+        names.insert(ExtractBetween(prefix, "$", "("));
+    }
+    return true;
+}
+
+Template::Template(const Template &other)
+    : ArgsOrder(other.ArgsOrder), ContentSalami(other.ContentSalami), hash(other.hash), cacheable(other.cacheable), compiled(other.compiled)
+{
+    Compile();
+}
+
+Template &Template::operator=(const Template &other)
+{
+    ArgsOrder = other.ArgsOrder;
+    ContentSalami = other.ContentSalami;
+    hash = other.hash;
+    cacheable = other.cacheable;
+    compiled = other.compiled;
+    Compile();
+    return *this;
+}
+
+Template::Template(const CompiledTemplate &compiledTemplate) : hash(compiledTemplate.hash), cacheable(compiledTemplate.cacheable), compiled(compiledTemplate.expand)
+{
+}
+
+CompiledTemplate::Expand Template::Compiled() const
+{
+    return compiled;
+}
+
+void Template::SetCacheable(bool value)
+{
+    cacheable = value;
+}
+
+bool Template::IsCacheable() const
+{
+    return cacheable;
+}
+
+namespace
+{
+void AddLiteral(vector<TemplateOp> &ops, string &text)
+{
+    if (text.empty())
+        return;
+    TemplateOp op;
+    op.text = std::move(text);
+    ops.push_back(std::move(op));
+    text.clear();
+}
+
+TemplateOp MakeInvocation(vector<TemplateOp> &parts)
+{
+    TemplateOp op;
+    op.kind = TemplateOp::Kind::Invoke;
+
+    bool literal = true;
+    for (const auto &part : parts)
+        literal = literal && part.kind == TemplateOp::Kind::Literal;
+
+    if (literal)
+    {
+        string text;
+        for (const auto &part : parts)
+            text += part.text;
+        ReadTemplateTitle(text, op.name, op.args);
+    }
+    else
+        op.parts = std::move(parts);
+    return op;
+}
+} // namespace
+
+// Splits the body into literal runs, placeholders and $name(args)$ invocations.
+// '$' only ever comes from the salami slices, so pairing them up across slices gives the invocations;
+// an invocation keeps its placeholders as parts. A '$' left without a partner is plain text.
+void Template::Compile()
+{
+    arity = Max(ArgsOrder);
+    literalBytes = 0;
+    for (const auto &slice : ContentSalami)
+        literalBytes += slice.size();
+    Ops.clear();
+
+    bool open = false;
+    string text;
+    vector<TemplateOp> parts;
+
+    for (size_t i = 0; i < ContentSalami.size(); i++)
+    {
+        const string &slice = ContentSalami[i];
+        size_t pos = 0;
+        while (true)
+        {
+            auto dollar = slice.find('$', pos);
+            if (dollar == string::npos)
+            {
+                text.append(slice, pos, string::npos);
+                break;
+            }
+
+            text.append(slice, pos, dollar - pos);
+            if (!open)
+            {
+                AddLiteral(Ops, text);
+                text = "$";
+                open = true;
+            }
+            else
+            {
+                AddLiteral(parts, text);
+                Ops.push_back(MakeInvocation(parts));
+                parts.clear();
+                open = false;
+            }
+            pos = dollar + 1;
+        }
+
+        if (i < ArgsOrder.size())
+        {
+            auto &target = open ? parts : Ops;
+            AddLiteral(target, text);
+            TemplateOp slot;
+            slot.kind = TemplateOp::Kind::Slot;
+            slot.slot = i;
+            target.push_back(slot);
+        }
+    }
+
+    if (open)
+    {
+        AddLiteral(parts, text);
+        for (auto &part : parts)
+            Ops.push_back(std::move(part));
+    }
+    else
+        AddLiteral(Ops, text);
+
+    BindArgViews();
+}
+
+// Only once Ops stays put, moving a short string would move its characters
+void Template::BindArgViews()
+{
+    for (auto &op : Ops)
+        op.argViews.assign(op.args.begin(), op.args.end());
+}
+
+void Template::AppendArgument(size_t slot, TemplateArgs inputArgs, string &out) const
+{
+    // Same as Parse: with fewer arguments than the template takes only the first arity placeholders are filled
+    size_t n = (arity > inputArgs.size()) ? arity : ArgsOrder.size();
+    if (slot < n && ArgsOrder[slot] < (int)inputArgs.size())
+        out += inputArgs[ArgsOrder[slot]];
+}
+
+Template::Template()
+{
+}
+
+// First content salami slice + ArgOrder[0]th argument + second content salami slice + ArgOrder[1]th argument ...
+// If less arguments are passed then rest are assumed to be empty
+// If more arguments are passed then extra are ignored
+string Template::Parse(TemplateArgs inputArgs) const
+{
+    string ret;
+    Parse(inputArgs, ret);
+    return ret;
+}
+
+void Template::Parse(TemplateArgs inputArgs, string &out) const
+{
+    if (ContentSalami.empty())
+        return;
+
+    size_t n = (arity > inputArgs.size()) ? arity : ArgsOrder.size();
+    n = std::min(n, ArgsOrder.size());
+
+    // The output size is known before anything is copied, out grows at most once
+    size_t size = literalBytes;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (ArgsOrder[i] < (int)inputArgs.size())
+            size += inputArgs[ArgsOrder[i]].size();
+    }
+    out.reserve(out.size() + size);
+
+    out += ContentSalami[0];
+    size_t i;
+    for (i = 0; i < n; i++)
+    {
+        if (ArgsOrder[i] < (int)inputArgs.size())
+            out += inputArgs[ArgsOrder[i]];
+        out += ContentSalami[i + 1];
+    }
+
+    // Less than required arguments were given
+    i++;
+    while (i < ContentSalami.size())
+        out += ContentSalami[i++];
+}
+
+TemplateParser::TemplateParser()
+{
+}
+
+TemplateParser::TemplateParser(const std::string &templatePath, bool map)
+{
+    MappedFile file(templatePath, map);
+
+    bool foundTemplate = false;
+    vector<string> args = vector<string>();
+
+    string title;
+    string templateText;
+
+    LineReader reader(file.Text());
+    std::string_view line;
+    while (reader.Next(line))
+    {
         if (line.find("#") != string::npos)
         {
             if (!foundTemplate)
             {
-                ReadTemplateTitle(line, title, args);
+                ReadTemplateTitle(string(line), title, args);
                 foundTemplate = true;
-            }
-            else
-            {
-                // Add template to the template map
-                vector<int> argsOrder;
-                vector<string> salamiSlices;
-
-                // Remove extra \n added at the end
-                ReadTemplateText(templateText.substr(0, templateText.size() - 1), args, argsOrder, salamiSlices);
-
-                TemplateMap[title] = Template(argsOrder, salamiSlices);
-
-                templateText = "";
-                foundTemplate = false;
-            }
-        }
-        else if (foundTemplate)
-        {
-            templateText += line;
-            // We might want to change the newline character to <br> instead
-            // Or we can put a optional parameter in template.md if need arises
-            // Same thing happens at PageRenderer::InterpretLine
-
-            // Need to remove extra \n added at the end
-            templateText += "\n";
-        }
-    }
-}
-
-string TemplateParser::ParseTemplate(const string &name, const vector<string> &inputArgs)
-{
-    string output;
-
-    auto temp = TemplateMap.find(name);
-
-    if (temp != TemplateMap.end())
-    {
-        output = (temp->second).Parse(inputArgs);
-    }
-    // System templates to fetch info about current page name.
-    else if (name == "PageName")
-        output = PageRenderer::GetCurrent()->name;
-
-    // Maintaining list of encountered templates in nested cases
-    TemplateParser::currentTemplates.insert(name);
-    output = TemplateParser::Parse(output);
-    TemplateParser::currentTemplates.erase(name);
-
-    return output;
-}
-
-string TemplateParser::Parse(const string &iLine)
-{
-    auto pos_start = iLine.find("$");
-    string ret = iLine;
-
-    if (pos_start != string::npos)
-    {
-        auto pos_end = iLine.find("$", pos_start + 1);
-        if (pos_end != string::npos)
-        {
-            string temp = iLine.substr(pos_start, pos_end - pos_start);
-
-            string templateName = ExtractBetween(temp, "$", "(");
-
-            // Making sure no infinite loops
-            if (TemplateParser::currentTemplates.find(templateName) == TemplateParser::currentTemplates.end())
-            {
-                vector<string> argsList = TokenizeBetween(temp, ",()");
-                string newText = "";
-                // Parse the special templates
-                if (templateName == "ChildList")
-                    newText = ParseChildList(PageRenderer::GetCurrent(), argsList);
-
-                else if (templateName == "NavigList")
-                    newText = ParseNavigList(PageRenderer::GetCurrent(), argsList);
-
-                else if (templateName == "TreeMap")
-                    newText = PasrseTreeMap(LayoutParser::GetStartNode(), argsList);
-
-                else if (templateName == "TreeMapPartial")
-                    newText = PasrseTreeMap(PageRenderer::GetCurrent(), argsList);
-
-                else
-                    newText = ParseTemplate(templateName, argsList);
-
-                // Look for more templates in that line
-                return TemplateParser::Parse(ret.replace(pos_start, pos_end - pos_start + 1, newText));
-            }
-            // remove the infinite loops
-            else
-                ret.replace(pos_start, pos_end - pos_start + 1, "");
-        }
-    }
-    return ret;
-}
-
-string TemplateParser::ParseChildList(Node *node, vector<string> args)
-{
-    auto children = node->children;
-
-    string childList = "";
-    for (auto child : children)
-        childList += ParseTemplate("ChildListItem", vector<string>{child->name});
-
-    vector<string> templateArgs = vector<string>{childList};
-    templateArgs.insert(templateArgs.end(), args.begin(), args.end());
-
-    return ParseTemplate("ChildList", templateArgs);
-}
-
-string TemplateParser::ParseNavigList(Node *node, vector<string> args)
-{
-    auto curParent = node;
-
-    string parentList = "";
-
-    while (curParent != nullptr)
-    {
-        parentList += ParseTemplate("NavigItem", vector<string>{curParent->name});
-        curParent = curParent->parent;
-    }
-
-    vector<string> templateArgs = vector<string>{parentList};
-    templateArgs.insert(templateArgs.end(), args.begin(), args.end());
-
-    return ParseTemplate("NavigList", templateArgs);
-}
-
-string TemplateParser::PasrseTreeMap(Node *node, vector<string> args)
-{
-    string map = "";
-
-    auto curLevel = node->children;
-    for (auto curLevelNode : curLevel)
-        map += ParseTreeMapLevel(curLevelNode, 1);
-
-    vector<string> templateArgs = vector<string>{map};
-    templateArgs.insert(templateArgs.end(), args.begin(), args.end());
-
-    string ret = ParseTemplate("TreeMap", templateArgs);
-    return ret;
-}
-
-string TemplateParser::ParseTreeMapLevel(Node *node, int lvl)
-{
-    string titleTemplateName = "";
-
-    if (lvl == 1)
-        titleTemplateName = "TreeMapTitle1";
-    else
-        titleTemplateName = "TreeMapTitle2";
-
-    string childMap = "";
-    for (auto child : node->children)
-    {
-        childMap += ParseTreeMapLevel(child, lvl + 1);
-    }
-
-    string ret = ParseTemplate(titleTemplateName, vector<string>{node->name, childMap});
-    return ret;
-}
+            }
+            else
+            {
+                // Add template to the template map
+                vector<int> argsOrder;
+                vector<string> salamiSlices;
+
+                // Remove extra \n added at the end
+                ReadTemplateText(templateText.substr(0, templateText.size() - 1), args, argsOrder, salamiSlices);
+
+                TemplateMap[title] = Template(argsOrder, salamiSlices);
+
+                templateText = "";
+                foundTemplate = false;
+            }
+        }
+        else if (foundTemplate)
+        {
+            templateText += line;
+            // We might want to change the newline character to <br> instead
+            // Or we can put a optional parameter in template.md if need arises
+            // Same thing happens at PageRenderer::InterpretLine
+
+            // Need to remove extra \n added at the end
+            templateText += "\n";
+        }
+    }
+
+    ClassifyTemplates();
+    IndexTemplates();
+}
+
+namespace
+{
+const CompiledTemplateSet *linkedTemplates = nullptr;
+} // namespace
+
+void CompiledTemplateSet::Link(const CompiledTemplateSet *set)
+{
+    linkedTemplates = set;
+}
+
+const CompiledTemplateSet *CompiledTemplateSet::Linked()
+{
+    return linkedTemplates;
+}
+
+// Which templates are pure was worked out when the code was generated
+TemplateParser::TemplateParser(const CompiledTemplateSet &compiledTemplates)
+{
+    for (size_t i = 0; i < compiledTemplates.count; i++)
+    {
+        const auto &compiled = compiledTemplates.templates[i];
+        TemplateMap.emplace(string(compiled.name), Template(compiled));
+    }
+    compiledCount = TemplateMap.size();
+    IndexTemplates();
+}
+
+void TemplateParser::ClassifyTemplates()
+{
+    // Invocations that make the output depend on the page being rendered (or on the build's assets)
+    auto pageDependent = [&](const string &name)
+    {
+        if (name == "PageName" || name == "Asset")
+            return TemplateMap.find(name) == TemplateMap.end();
+        return name == "ChildList" || name == "NavigList" || name == "TreeMapPartial";
+    };
+
+    // Template -> templates it expands. $TreeMap$ expands its three layout templates.
+    std::unordered_map<string, std::set<string>> edges;
+    std::set<string> impure;
+    for (const auto &[name, temp] : TemplateMap)
+    {
+        std::set<string> invoked;
+        if (!temp.GetInvokedNames(invoked))
+            impure.insert(name);
+
+        auto &targets = edges[name];
+        for (const auto &target : invoked)
+        {
+            if (pageDependent(target))
+                impure.insert(name);
+            else if (target == "TreeMap")
+                targets.insert({"TreeMap", "TreeMapTitle1", "TreeMapTitle2"});
+            else
+                targets.insert(target);
+        }
+    }
+
+    // A template on a cycle expands differently depending on which templates are already active
+    for (auto &[name, temp] : TemplateMap)
+    {
+        std::set<string> reached;
+        vector<string> stack(edges[name].begin(), edges[name].end());
+        while (!stack.empty())
+        {
+            auto current = stack.back();
+            stack.pop_back();
+            if (!reached.insert(current).second)
+                continue;
+            auto next = edges.find(current);
+            if (next != edges.end())
+                stack.insert(stack.end(), next->second.begin(), next->second.end());
+        }
+
+        bool pure = impure.count(name) == 0 && reached.count(name) == 0;
+        for (const auto &target : reached)
+            pure = pure && impure.count(target) == 0;
+        temp.SetCacheable(pure);
+    }
+}
+
+void TemplateParser::IndexTemplates()
+{
+    templateIndex.clear();
+    for (const auto &[name, temp] : TemplateMap)
+        templateIndex.emplace(name, &temp);
+
+    treeFragmentsCacheable = IsPureOrMissing("TreeMapTitle1") && IsPureOrMissing("TreeMapTitle2");
+    treeMapsCacheable = treeFragmentsCacheable && IsPureOrMissing("TreeMap");
+}
+
+// A template that isn't defined always expands to nothing
+bool TemplateParser::IsPureOrMissing(const string &name) const
+{
+    auto temp = TemplateMap.find(name);
+    return temp == TemplateMap.end() || temp->second.IsCacheable();
+}
+
+const Template *TemplateParser::FindTemplate(string_view name) const
+{
+    auto temp = templateIndex.find(name);
+    return temp == templateIndex.end() ? nullptr : temp->second;
+}
+
+bool TemplateParser::IsCacheable(const string &name) const
+{
+    auto temp = TemplateMap.find(name);
+    return temp != TemplateMap.end() && temp->second.IsCacheable();
+}
+
+void TemplateParser::BeginRender(uint64_t layoutHash)
+{
+    cache->hits = 0;
+    cache->misses = 0;
+    if (layoutHash != cache->layoutHash)
+    {
+        ClearCache();
+        cache->layoutHash = layoutHash;
+    }
+}
+
+void TemplateParser::ClearCache()
+{
+    std::unique_lock<std::shared_mutex> guard(cache->lock);
+    cache->entries.clear();
+    cache->layoutEntries.clear();
+    cache->hits = 0;
+    cache->misses = 0;
+}
+
+void TemplateParser::EnableCache(bool enabled)
+{
+    ClearCache();
+    cache->enabled = enabled;
+}
+
+uint64_t TemplateParser::GetCacheHits() const
+{
+    return cache->hits;
+}
+
+uint64_t TemplateParser::GetCacheMisses() const
+{
+    return cache->misses;
+}
+
+namespace
+{
+bool IsActive(const RenderContext &context, string_view name)
+{
+    return std::find(context.activeTemplates.begin(), context.activeTemplates.end(), name) != context.activeTemplates.end();
+}
+
+// A page uses a handful of templates over and over, only the first use of each is stored
+void RecordUse(RenderContext &context, string_view name)
+{
+    if (context.usedTemplates.find(name) == context.usedTemplates.end())
+        context.usedTemplates.emplace(name);
+}
+
+// Memoization keys are built in one buffer per thread, Memoize copies a key before expanding
+string &KeyBuffer()
+{
+    thread_local string key;
+    key.clear();
+    return key;
+}
+
+void AppendKeyArgs(string &key, TemplateArgs args)
+{
+    for (auto arg : args)
+    {
+        key += '\0';
+        key += arg;
+    }
+}
+} // namespace
+
+// Pure expansions don't care about the page or the active templates, so a miss is expanded in a
+// blank context and what it recorded is replayed into every page that hits the entry
+template <typename Expand>
+void TemplateParser::Memoize(std::unordered_map<string, CachedExpansion> &entries, const string &key, RenderContext &context, string &out,
+                             const Expand &expand) const
+{
+    const CachedExpansion *entry = nullptr;
+    CachedExpansion fresh;
+    string ownKey;
+    {
+        std::shared_lock<std::shared_mutex> guard(cache->lock);
+        auto found = entries.find(key);
+        if (found != entries.end())
+            entry = &found->second;
+    }
+
+    if (entry != nullptr)
+    {
+        cache->hits++;
+        BuildStats::Add(Counter::TemplateCacheHits, 1);
+    }
+    else
+    {
+        cache->misses++;
+        BuildStats::Add(Counter::TemplateCacheMisses, 1);
+
+        // key may be a buffer the expansion builds keys in too
+        ownKey = key;
+        RenderContext scratch;
+        scratch.layout = context.layout;
+        scratch.assets = context.assets;
+        expand(scratch, fresh.output);
+
+        fresh.usedTemplates = std::move(scratch.usedTemplates);
+        fresh.layoutDependencies = std::move(scratch.layoutDependencies);
+        fresh.templateExpansions = scratch.templateExpansions;
+        fresh.depth = scratch.maxTemplateDepth;
+        entry = &fresh;
+    }
+
+    out += entry->output;
+    context.usedTemplates.insert(entry->usedTemplates.begin(), entry->usedTemplates.end());
+    context.layoutDependencies.insert(entry->layoutDependencies.begin(), entry->layoutDependencies.end());
+    context.templateExpansions += entry->templateExpansions;
+    context.maxTemplateDepth = std::max(context.maxTemplateDepth, context.activeTemplates.size() + entry->depth);
+
+    // Another page may have filled the entry meanwhile, both expansions are identical
+    if (entry == &fresh)
+    {
+        std::unique_lock<std::shared_mutex> guard(cache->lock);
+        entries.emplace(std::move(ownKey), std::move(fresh));
+    }
+}
+
+uint64_t TemplateParser::GetTemplateHash(const string &name) const
+{
+    auto temp = TemplateMap.find(name);
+    if (temp == TemplateMap.end())
+        return 0;
+    return temp->second.Hash();
+}
+
+void TemplateParser::ExpandTemplate(string_view name, TemplateArgs inputArgs, RenderContext &context, string &out) const
+{
+    RecordUse(context, name);
+
+    // Making sure no infinite loops
+    if (IsActive(context, name))
+        return;
+
+    auto temp = FindTemplate(name);
+    if (temp != nullptr && temp->IsCacheable() && cache->enabled)
+    {
+        string &key = KeyBuffer();
+        key += name;
+        AppendKeyArgs(key, inputArgs);
+
+        Memoize(cache->entries, key, context, out, [&](RenderContext &scratch, string &result)
+                {
+            scratch.activeTemplates.push_back(name);
+            scratch.usedTemplates.emplace(name);
+            scratch.templateExpansions = 1;
+            scratch.maxTemplateDepth = 1;
+            ExpandBody(*temp, inputArgs, scratch, result); });
+        return;
+    }
+
+    // Maintaining list of encountered templates in nested cases
+    context.activeTemplates.push_back(name);
+    context.templateExpansions++;
+    context.maxTemplateDepth = std::max(context.maxTemplateDepth, context.activeTemplates.size());
+    if (temp != nullptr)
+        ExpandBody(*temp, inputArgs, context, out);
+
+    // System templates to fetch info about current page name.
+    else if (name == "PageName" && context.node != nullptr)
+        out += context.node->name;
+
+    // URL of a file under the assets directory, fingerprinted if the asset stage renames copies.
+    // The only expansion that still allocates, for the lookup and the page's asset list.
+    else if (name == "Asset")
+    {
+        string path = inputArgs.empty() ? "" : string(inputArgs[0]);
+        string url = path;
+        if (context.assets != nullptr && !context.assets->Resolve(path, url))
+            warn("Asset " + path + " is not in the assets directory");
+        context.usedAssets.insert(path);
+        out += url;
+    }
+    context.activeTemplates.pop_back();
+}
+
+void TemplateParser::ExpandOps(const Template &temp, const vector<TemplateOp> &ops, TemplateArgs inputArgs, RenderContext &context, string &out) const
+{
+    for (const auto &op : ops)
+    {
+        switch (op.kind)
+        {
+        case TemplateOp::Kind::Literal:
+            out += op.text;
+            break;
+        case TemplateOp::Kind::Slot:
+            temp.AppendArgument(op.slot, inputArgs, out);
+            break;
+        case TemplateOp::Kind::Invoke:
+            if (op.parts.empty())
+                Invoke(op.name, op.argViews, context, out);
+            else
+            {
+                // Placeholders inside the invocation, name and arguments depend on this expansion's arguments
+                ExpansionScratch scratch(context);
+                ExpandOps(temp, op.parts, inputArgs, context, scratch.text);
+                string_view name;
+                ReadTemplateTitle(scratch.text, name, scratch.args);
+                Invoke(name, scratch.args, context, out);
+            }
+            break;
+        }
+    }
+}
+
+void TemplateParser::ExpandBody(const Template &temp, TemplateArgs inputArgs, RenderContext &context, string &out) const
+{
+    if (temp.Compiled() != nullptr)
+        temp.Compiled()(*this, inputArgs, context, out);
+    else
+        ExpandOps(temp, temp.GetOps(), inputArgs, context, out);
+}
+
+size_t TemplateParser::GetCompiledCount() const
+{
+    return compiledCount;
+}
+
+void TemplateParser::InvokeCompiled(string_view name, TemplateArgs args, RenderContext &context, string &out) const
+{
+    Invoke(name, args, context, out);
+}
+
+// Same as a placeholder invocation in ExpandOps
+void TemplateParser::InvokeCompiled(ExpansionScratch &invocation, RenderContext &context, string &out) const
+{
+    string_view name;
+    ReadTemplateTitle(invocation.text, name, invocation.args);
+    Invoke(name, invocation.args, context, out);
+}
+
+void TemplateParser::Invoke(string_view name, TemplateArgs inputArgs, RenderContext &context, string &out) const
+{
+    // remove the infinite loops
+    if (IsActive(context, name))
+        return;
+
+    // Parse the special templates
+    // These also depend on the part of the layout they walk
+    if (name == "ChildList")
+    {
+        context.layoutDependencies.insert(LayoutDependency::Children);
+        ParseChildList(context.node, inputArgs, context, out);
+    }
+    else if (name == "NavigList")
+    {
+        context.layoutDependencies.insert(LayoutDependency::Ancestors);
+        ParseNavigList(context.node, inputArgs, context, out);
+    }
+    else if (name == "TreeMap")
+    {
+        context.layoutDependencies.insert(LayoutDependency::Tree);
+        PasrseTreeMap(context.layout == nullptr ? nullptr : context.layout->Root(), inputArgs, context, out);
+    }
+    else if (name == "TreeMapPartial")
+    {
+        context.layoutDependencies.insert(LayoutDependency::Subtree);
+        PasrseTreeMap(context.node, inputArgs, context, out);
+    }
+    else
+        ExpandTemplate(name, inputArgs, context, out);
+}
+
+string TemplateParser::Parse(const string &iLine) const
+{
+    RenderContext context;
+    return Parse(iLine, context);
+}
+
+string TemplateParser::Parse(const string &iLine, RenderContext &context) const
+{
+    string ret;
+    ret.reserve(iLine.size());
+    Parse(string_view(iLine), context, ret);
+    return ret;
+}
+
+// Every $...$ pair is an invocation, text around them is copied and expansions are appended in place
+// The name and arguments are views into the line, nothing is copied before the expansion itself
+void TemplateParser::Parse(string_view iLine, RenderContext &context, string &out) const
+{
+    size_t pos = 0;
+    while (pos < iLine.size())
+    {
+        auto pos_start = iLine.find('$', pos);
+        if (pos_start == string_view::npos)
+            break;
+        auto pos_end = iLine.find('$', pos_start + 1);
+        if (pos_end == string_view::npos)
+            break;
+
+        out.append(iLine.data() + pos, pos_start - pos);
+
+        string_view templateName;
+        ReadTemplateTitle(iLine.substr(pos_start, pos_end - pos_start), templateName, context.lineArguments);
+        Invoke(templateName, context.lineArguments, context, out);
+
+        pos = pos_end + 1;
+    }
+    out.append(iLine.data() + pos, iLine.size() - pos);
+}
+
+namespace
+{
+// Pages rendered without a layout (tests, lines parsed outside of any page) have no children, parents or home page
+NodeRange ChildrenOf(const RenderContext &context, const Node *node)
+{
+    if (context.layout == nullptr)
+        return NodeRange(nullptr, nullptr, nullptr);
+    return context.layout->Children(node);
+}
+
+Node *ParentOf(const RenderContext &context, const Node *node)
+{
+    return context.layout == nullptr ? nullptr : context.layout->Parent(node);
+}
+} // namespace
+
+void TemplateParser::ParseChildList(Node *node, TemplateArgs args, RenderContext &context, string &out) const
+{
+    if (node == nullptr)
+        return;
+
+    ExpansionScratch childList(context);
+    for (auto child : ChildrenOf(context, node))
+    {
+        string_view item[] = {child->name};
+        ExpandTemplate("ChildListItem", TemplateArgs(item, 1), context, childList.text);
+    }
+
+    childList.args.push_back(childList.text);
+    childList.args.insert(childList.args.end(), args.begin(), args.end());
+
+    ExpandTemplate("ChildList", childList.args, context, out);
+}
+
+void TemplateParser::ParseNavigList(Node *node, TemplateArgs args, RenderContext &context, string &out) const
+{
+    auto curParent = node;
+
+    ExpansionScratch parentList(context);
+
+    while (curParent != nullptr)
+    {
+        string_view item[] = {curParent->name};
+        ExpandTemplate("NavigItem", TemplateArgs(item, 1), context, parentList.text);
+        curParent = ParentOf(context, curParent);
+    }
+
+    parentList.args.push_back(parentList.text);
+    parentList.args.insert(parentList.args.end(), args.begin(), args.end());
+
+    ExpandTemplate("NavigList", parentList.args, context, out);
+}
+
+// Node names are unique in the layout, and the cache only lives as long as layout.md hashes the same
+void TemplateParser::PasrseTreeMap(Node *node, TemplateArgs args, RenderContext &context, string &out) const
+{
+    if (node == nullptr)
+        return;
+
+    if (!treeMapsCacheable || !cache->enabled)
+    {
+        ExpandTreeMap(node, args, context, out);
+        return;
+    }
+
+    string &key = KeyBuffer();
+    key += "map:";
+    key += node->name;
+    AppendKeyArgs(key, args);
+    Memoize(cache->layoutEntries, key, context, out, [&](RenderContext &scratch, string &result)
+            { ExpandTreeMap(node, args, scratch, result); });
+}
+
+void TemplateParser::ExpandTreeMap(Node *node, TemplateArgs args, RenderContext &context, string &out) const
+{
+    ExpansionScratch map(context);
+
+    for (auto curLevelNode : ChildrenOf(context, node))
+        ParseTreeMapLevel(curLevelNode, 1, context, map.text);
+
+    map.args.push_back(map.text);
+    map.args.insert(map.args.end(), args.begin(), args.end());
+
+    ExpandTemplate("TreeMap", map.args, context, out);
+}
+
+// Below the first level a node's fragment looks the same at any depth, so it is shared between
+// $TreeMap$ and every $TreeMapPartial$ that shows it
+void TemplateParser::ParseTreeMapLevel(Node *node, int lvl, RenderContext &context, string &out) const
+{
+    if (!treeFragmentsCacheable || !cache->enabled)
+    {
+        ExpandTreeMapLevel(node, lvl, context, out);
+        return;
+    }
+
+    string &key = KeyBuffer();
+    key += lvl == 1 ? "top:" : "nested:";
+    key += node->name;
+    Memoize(cache->layoutEntries, key, context, out, [&](RenderContext &scratch, string &result)
+            { ExpandTreeMapLevel(node, lvl, scratch, result); });
+}
+
+void TemplateParser::ExpandTreeMapLevel(Node *node, int lvl, RenderContext &context, string &out) const
+{
+    string_view titleTemplateName = lvl == 1 ? "TreeMapTitle1" : "TreeMapTitle2";
+
+    ExpansionScratch childMap(context);
+    for (auto child : ChildrenOf(context, node))
+    {
+        ParseTreeMapLevel(child, lvl + 1, context, childMap.text);
+    }
+
+    string_view titleArgs[] = {node->name, childMap.text};
+    ExpandTemplate(titleTemplateName, TemplateArgs(titleArgs, 2), context, out);
+}
@@ -0,0 +1,146 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned workers)
+{
+    if (workers == 0)
+        workers = 1;
+
+    for (unsigned i = 0; i < workers; i++)
+        queues.push_back(std::make_unique<Queue>());
+
+    for (unsigned i = 0; i < workers; i++)
+        threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto &thread : threads)
+        thread.join();
+}
+
+size_t ThreadPool::Size() const
+{
+    return threads.size();
+}
+
+unsigned ThreadPool::DefaultWorkers()
+{
+    unsigned count = std::thread::hardware_concurrency();
+    return count == 0 ? 1 : count;
+}
+
+void ThreadPool::WorkerLoop(size_t id)
+{
+    size_t seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(stateLock);
+            wake.wait(guard, [&]()
+                      { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        RunTasks(id);
+
+        {
+            std::lock_guard<std::mutex> guard(stateLock);
+            busyWorkers--;
+        }
+        done.notify_all();
+    }
+}
+
+// Own queue first (front), then steal from the back of the others
+bool ThreadPool::PopTask(size_t id, size_t &task)
+{
+    {
+        auto &own = *queues[id];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty())
+        {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < queues.size(); i++)
+    {
+        auto &victim = *queues[(id + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty())
+        {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+// No tasks are added while a job runs, so an empty sweep means this worker is done
+void ThreadPool::RunTasks(size_t id)
+{
+    size_t task;
+    while (PopTask(id, task))
+    {
+        try
+        {
+            (*job)(task);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> guard(stateLock);
+            if (!failure)
+                failure = std::current_exception();
+        }
+    }
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)> &fn)
+{
+    if (count == 0)
+        return;
+
+    // Contiguous blocks keep neighbouring tasks on the same worker until stealing kicks in
+    size_t workers = queues.size();
+    for (size_t w = 0; w < workers; w++)
+    {
+        size_t begin = count * w / workers;
+        size_t end = count * (w + 1) / workers;
+        std::lock_guard<std::mutex> guard(queues[w]->lock);
+        for (size_t i = begin; i < end; i++)
+            queues[w]->tasks.push_back(i);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        job = &fn;
+        failure = nullptr;
+        busyWorkers = threads.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> guard(stateLock);
+        done.wait(guard, [&]()
+                  { return busyWorkers == 0; });
+        job = nullptr;
+        error = failure;
+        failure = nullptr;
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+}
@@ -0,0 +1,198 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "WarningSink.h"
+#include "BuildStats.h"
+
+using std::string;
+using std::vector;
+
+namespace
+{
+// Writing every warning on its own costs an open/close per warning
+constexpr size_t flushThreshold = 512;
+
+thread_local vector<Warning> *capturedWarnings = nullptr;
+thread_local WarningSink *scopeSink = nullptr;
+thread_local const string *currentFile = nullptr;
+thread_local size_t currentLine = 0;
+
+string DedupKey(const Warning &warning)
+{
+    return warning.file + '\0' + std::to_string(warning.line) + '\0' + warning.message;
+}
+
+// Inside the content directory files are shown relative to it, so warnings don't depend on where the site lives
+string DisplayPath(const string &file, const string &contentDir)
+{
+    namespace fs = std::filesystem;
+    if (contentDir.empty())
+        return file;
+    auto relative = fs::path(file).lexically_relative(contentDir);
+    if (relative.empty() || *relative.begin() == "..")
+        return file;
+    return relative.generic_string();
+}
+
+string JsonString(const string &text)
+{
+    static const char digits[] = "0123456789abcdef";
+    string out = "\"";
+    for (unsigned char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (c < 0x20)
+        {
+            out += "\\u00";
+            out += digits[c >> 4];
+            out += digits[c & 0xf];
+        }
+        else
+            out += c;
+    }
+    return out + '"';
+}
+
+string FormatWarning(const Warning &warning, bool json, const string &contentDir)
+{
+    if (json)
+    {
+        string out = "{\"message\": " + JsonString(warning.message);
+        if (!warning.file.empty())
+            out += ", \"file\": " + JsonString(DisplayPath(warning.file, contentDir));
+        if (warning.line != 0)
+            out += ", \"line\": " + std::to_string(warning.line);
+        return out + "}";
+    }
+
+    if (warning.file.empty())
+        return warning.message;
+    string out = DisplayPath(warning.file, contentDir);
+    if (warning.line != 0)
+        out += ":" + std::to_string(warning.line);
+    return out + ": " + warning.message;
+}
+} // namespace
+
+WarningSink::WarningSink(const string &path, const string &contentDir, bool json) : path(path), contentDir(contentDir), json(json)
+{
+}
+
+WarningSink::~WarningSink()
+{
+    Flush();
+}
+
+string WarningSink::Format(const Warning &warning) const
+{
+    return FormatWarning(warning, json, contentDir);
+}
+
+void WarningSink::WritePending()
+{
+    if (pending.empty())
+        return;
+
+    string text;
+    for (const auto &warning : pending)
+    {
+        text += Format(warning);
+        text += '\n';
+    }
+    pending.clear();
+
+    std::ofstream warningfile(path, std::ios::app);
+    warningfile << text;
+}
+
+void WarningSink::Add(const Warning &warning)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!seen.insert(DedupKey(warning)).second)
+        return;
+    pending.push_back(warning);
+    BuildStats::Add(Counter::Warnings, 1);
+    if (pending.size() >= flushThreshold)
+        WritePending();
+}
+
+void WarningSink::Flush()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    WritePending();
+}
+
+void WarningSink::Clear()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    pending.clear();
+    seen.clear();
+
+    std::ofstream warningfile;
+    warningfile.open(path, std::ios::trunc);
+    warningfile.close();
+}
+
+void warn(const string &warning)
+{
+    Warning entry;
+    entry.message = warning;
+    if (currentFile != nullptr)
+    {
+        entry.file = *currentFile;
+        entry.line = currentLine;
+    }
+    warn(entry);
+}
+
+void warn(const Warning &warning)
+{
+    if (capturedWarnings != nullptr)
+        capturedWarnings->push_back(warning);
+    else if (scopeSink != nullptr)
+        scopeSink->Add(warning);
+    else
+        std::cerr << "warning: " << FormatWarning(warning, false, "") << std::endl;
+}
+
+WarningCapture::WarningCapture(vector<Warning> &sink) : previous(capturedWarnings)
+{
+    capturedWarnings = &sink;
+}
+
+WarningCapture::~WarningCapture()
+{
+    capturedWarnings = previous;
+}
+
+WarningScope::WarningScope(WarningSink &sink) : previous(scopeSink)
+{
+    scopeSink = &sink;
+}
+
+WarningScope::~WarningScope()
+{
+    scopeSink = previous;
+}
+
+WarningLocation::WarningLocation(const string &file) : file(file), previousFile(currentFile), previousLine(currentLine)
+{
+    currentFile = &this->file;
+    currentLine = 0;
+}
+
+WarningLocation::~WarningLocation()
+{
+    currentFile = previousFile;
+    currentLine = previousLine;
+}
+
+void WarningLocation::SetLine(size_t line)
+{
+    currentLine = line;
+}
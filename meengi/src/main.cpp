@@ -1,12 +1,17 @@
+#include <algorithm>
 #include <filesystem>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
 #include "GeneratorConfig.h"
-#include "LayoutParser.h"
-#include "PageRenderer.h"
+#include "Generator.h"
 #include "FileHelpers.h"
+#include "SiteWatcher.h"
+#include "PreviewServer.h"
+#include "BuildStats.h"
+#include "TemplateCompiler.h"
 
 namespace
 {
@@ -24,6 +29,25 @@ struct CLIOptions
     bool outputProvided = false;
     std::string warningsFile;
     bool warningsProvided = false;
+    bool warningsJson = false;
+    unsigned jobs = 1;
+    bool fullRebuild = false;
+    bool watch = false;
+    bool serve = false;
+    uint16_t port = 8000;
+    bool stats = false;
+    std::string tracePath;
+    std::string assetsDir;
+    std::string assetsOutputDir;
+    std::string assetsUrl;
+    bool assetsUrlProvided = false;
+    bool fingerprintAssets = false;
+    std::vector<Encoding> precompress;
+    bool minify = false;
+    bool searchIndex = false;
+    bool blockMarkdown = false;
+    std::string emitCpp;
+    bool snapshot = true;
     bool showHelp = false;
 };
 
@@ -59,6 +83,25 @@ void PrintUsage(const char *exe)
               << "  --templates <file>       Path to template directives (default <content>/directives/templates.md)\n"
               << "  --output-dir <path>      Directory for generated HTML (default sibling 'site' next to content)\n"
               << "  --warnings-file <file>   File to collect warnings (default warnings.txt beside content)\n"
+              << "  --warnings-format <fmt>  text (default) or json, one object per line\n"
+              << "  -j, --jobs <n>           Render n pages concurrently, 0 uses every core (default 1)\n"
+              << "  --full                   Render every page instead of only changed ones\n"
+              << "  --watch                  Stay running and re-render the pages affected by every change (Linux only)\n"
+              << "  --serve                  Preview on http://127.0.0.1:<port>/, rendering pages on request from memory (Linux only)\n"
+              << "  --port <n>               Port for --serve (default 8000)\n"
+              << "  --stats                  Print time per build phase and build counters\n"
+              << "  --trace <file>           Write a Chrome trace-event JSON of the build to file\n"
+              << "  --assets <dir>           Copy the files under dir into the output, only the changed ones\n"
+              << "  --assets-out <dir>       Where --assets copies go (default <output-dir>/<name of the assets dir>)\n"
+              << "  --assets-url <prefix>    What $Asset(path)$ puts before a copy's path (default '<name of the assets dir>/')\n"
+              << "  --fingerprint-assets     Name copies name.<hash>.ext so they can be cached forever\n"
+              << "  --block-markdown         Parse pages as markdown blocks: paragraphs, lists, quotes and fenced code\n"
+              << "  --minify                 Collapse whitespace and drop comments in the generated HTML\n"
+              << "  --search-index           Write a full-text index of the pages to <output-dir>/search-index.json\n"
+              << "  --precompress            Write page.html.gz next to every page, redone only when the page changes\n"
+              << "  --precompress-zstd       Also write page.html.zst (needs a build with zstd)\n"
+              << "  --emit-cpp <file>        Write the templates as C++ to file and exit, see 'make meengi_compiled'\n"
+              << "  --no-snapshot            Parse layout.md and templates.md every run instead of keeping them in <output-dir>/.meengi-snapshot\n"
               << "  -h, --help               Show this help text\n";
 }
 
@@ -92,6 +135,116 @@ bool ParseArguments(int argc, char **argv, CLIOptions &options, std::string &err
             options.warningsFile = argv[++i];
             options.warningsProvided = true;
         }
+        else if (arg == "--warnings-format" && i + 1 < argc)
+        {
+            std::string format(argv[++i]);
+            if (format != "text" && format != "json")
+            {
+                error = "Unknown warnings format: " + format;
+                return false;
+            }
+            options.warningsJson = format == "json";
+        }
+        else if ((arg == "--jobs" || arg == "-j") && i + 1 < argc)
+        {
+            std::string value(argv[++i]);
+            try
+            {
+                int jobs = std::stoi(value);
+                if (jobs < 0)
+                    throw std::out_of_range(value);
+                options.jobs = static_cast<unsigned>(jobs);
+            }
+            catch (const std::exception &)
+            {
+                error = "Invalid job count: " + value;
+                return false;
+            }
+        }
+        else if (arg == "--full")
+        {
+            options.fullRebuild = true;
+        }
+        else if (arg == "--watch")
+        {
+            options.watch = true;
+        }
+        else if (arg == "--serve")
+        {
+            options.serve = true;
+        }
+        else if (arg == "--port" && i + 1 < argc)
+        {
+            std::string value(argv[++i]);
+            try
+            {
+                int port = std::stoi(value);
+                if (port <= 0 || port > 65535)
+                    throw std::out_of_range(value);
+                options.port = static_cast<uint16_t>(port);
+            }
+            catch (const std::exception &)
+            {
+                error = "Invalid port: " + value;
+                return false;
+            }
+        }
+        else if (arg == "--stats")
+        {
+            options.stats = true;
+        }
+        else if (arg == "--trace" && i + 1 < argc)
+        {
+            options.tracePath = argv[++i];
+        }
+        else if (arg == "--assets" && i + 1 < argc)
+        {
+            options.assetsDir = argv[++i];
+        }
+        else if (arg == "--assets-out" && i + 1 < argc)
+        {
+            options.assetsOutputDir = argv[++i];
+        }
+        else if (arg == "--assets-url" && i + 1 < argc)
+        {
+            options.assetsUrl = argv[++i];
+            options.assetsUrlProvided = true;
+        }
+        else if (arg == "--fingerprint-assets")
+        {
+            options.fingerprintAssets = true;
+        }
+        else if (arg == "--minify")
+        {
+            options.minify = true;
+        }
+        else if (arg == "--block-markdown")
+        {
+            options.blockMarkdown = true;
+        }
+        else if (arg == "--search-index")
+        {
+            options.searchIndex = true;
+        }
+        else if (arg == "--emit-cpp" && i + 1 < argc)
+        {
+            options.emitCpp = argv[++i];
+        }
+        else if (arg == "--no-snapshot")
+        {
+            options.snapshot = false;
+        }
+        else if (arg == "--precompress" || arg == "--precompress-zstd")
+        {
+            auto encoding = arg == "--precompress" ? Encoding::Gzip : Encoding::Zstd;
+            if (!EncodingAvailable(encoding))
+            {
+                error = std::string("This build of meengi has no ") + EncodingName(encoding) + " support";
+                return false;
+            }
+            if (std::find(options.precompress.begin(), options.precompress.end(), encoding) == options.precompress.end())
+                options.precompress.push_back(encoding);
+        }
         else if (arg == "--help" || arg == "-h")
         {
             options.showHelp = true;
@@ -133,6 +286,37 @@ GeneratorConfig BuildConfig(const CLIOptions &options, const fs::path &cwd)
     else
         config.warningsFile = (workspaceRoot.empty() ? fs::path("warnings.txt") : workspaceRoot / "warnings.txt").string();
 
+    config.warningsJson = opts.warningsJson;
+    config.jobs = opts.jobs;
+    config.incremental = !opts.fullRebuild;
+    // Both keep running while the sources are edited
+    config.mapFiles = !opts.watch && !opts.serve;
+    config.stats = opts.stats;
+    if (!opts.tracePath.empty())
+        config.tracePath = ToAbsolute(opts.tracePath, cwd).string();
+
+    config.precompress = opts.precompress;
+    config.minify = opts.minify;
+    config.blockMarkdown = opts.blockMarkdown;
+    if (opts.searchIndex)
+        config.searchIndex = (fs::path(config.outputDir) / "search-index.json").string();
+    if (opts.snapshot)
+        config.snapshotPath = (fs::path(config.outputDir) / ".meengi-snapshot").string();
+
+    // Pages sit at the top of the output directory, so by default assets are linked relative to it
+    if (!opts.assetsDir.empty())
+    {
+        fs::path assets = ToAbsolute(opts.assetsDir, cwd).lexically_normal();
+        if (!assets.has_filename())
+            assets = assets.parent_path();
+        config.assetsDir = assets.string();
+        if (opts.assetsOutputDir.empty())
+            config.assetsOutputDir = (fs::path(config.outputDir) / assets.filename()).string();
+        else
+            config.assetsOutputDir = ToAbsolute(opts.assetsOutputDir, cwd).string();
+        config.assetsUrl = opts.assetsUrlProvided ? opts.assetsUrl : assets.filename().string() + "/";
+        config.fingerprintAssets = opts.fingerprintAssets;
+    }
     return config;
 }
 }
@@ -155,19 +339,36 @@ int main(int argc, char **argv)
     }
 
     auto config = BuildConfig(options, fs::current_path());
-    LayoutParser::Reset();
-    PageRenderer::Reset();
-    SetGeneratorConfig(config);
+    if (!options.emitCpp.empty())
+    {
+        TemplateParser templates(config.templatesPath);
+        auto path = ToAbsolute(options.emitCpp, fs::current_path()).string();
+        if (!WriteFileAtomically(path, TemplateCompiler::EmitCpp(templates, HashFile(config.templatesPath))))
+        {
+            std::cerr << "Could not write " << path << std::endl;
+            return 1;
+        }
+        return 0;
+    }
 
-    ClearPreviousFiles();
+    if (config.stats || !config.tracePath.empty())
+        BuildStats::Enable(!config.tracePath.empty());
 
-    auto start = LayoutParser::GetStartNode();
-    if (start == nullptr)
+    Generator generator(config);
+    if (options.serve)
     {
-        std::cerr << "Failed to parse layout. Check " << config.layoutPath << std::endl;
-        return 1;
+        PreviewServer server(generator);
+        return server.Run(options.port);
+    }
+    if (options.watch)
+    {
+        SiteWatcher watcher(generator);
+        return watcher.Run();
     }
 
-    PageRenderer::Render(start);
+    // --full renders every page, but pages whose HTML didn't change are still left alone
+    StatsWindow window;
+    generator.Render();
+    BuildStats::Report(config, window);
     return 0;
 }
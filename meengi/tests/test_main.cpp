@@ -1,9 +1,14 @@
+#include <algorithm>
+#include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <new>
 #include <stdexcept>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "GeneratorConfig.h"
@@ -11,7 +16,48 @@
 #include "TemplateParser.h"
 #include "ShortHandParser.h"
 #include "FileHelpers.h"
-#include "PageRenderer.h"
+#include "Generator.h"
+#include "SiteWatcher.h"
+#include "PreviewServer.h"
+#include "BuildManifest.h"
+#include "BuildStats.h"
+#include "HtmlMinifier.h"
+#include "SearchIndex.h"
+#include "BlockParser.h"
+#include "DelimiterSet.h"
+
+// Counts the heap allocations of the current thread while countAllocations is set,
+// the ones of at least largeAllocation bytes separately
+namespace
+{
+constexpr size_t largeAllocation = 1 << 16;
+thread_local bool countAllocations = false;
+thread_local size_t allocations = 0;
+thread_local size_t largeAllocations = 0;
+} // namespace
+
+void *operator new(size_t size)
+{
+    if (countAllocations)
+    {
+        allocations++;
+        if (size >= largeAllocation)
+            largeAllocations++;
+    }
+    if (void *memory = std::malloc(size == 0 ? 1 : size))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    std::free(memory);
+}
 
 namespace
 {
@@ -35,9 +81,20 @@ fs::path FixtureRoot()
     return fs::path("./tests/fixtures/basic");
 }
 
-GeneratorConfig BuildFixtureConfig()
+// templates.md of the temp sites that list children, a test appends the templates it needs
+const std::string childListTemplates = "# $ChildList(items)\n<ul>$$items$$</ul>\n#\n\n# $ChildListItem(name)\n<li>$$name$$</li>\n#\n\n";
+
+// An empty directory under the system temp directory, whatever an earlier run left there is removed
+fs::path TempRoot(const std::string &name)
+{
+    auto root = fs::temp_directory_path() / name;
+    fs::remove_all(root);
+    return root;
+}
+
+// A site laid out like the fixtures: content/ with its directives/, rendered into site/, warnings.txt next to them
+GeneratorConfig TempSiteConfig(const fs::path &root)
 {
-    auto root = FixtureRoot();
     GeneratorConfig config;
     config.contentDir = (root / "content").string();
     config.outputDir = (root / "site").string();
@@ -47,11 +104,9 @@ GeneratorConfig BuildFixtureConfig()
     return config;
 }
 
-void PrepareGenerator()
+GeneratorConfig BuildFixtureConfig()
 {
-    LayoutParser::Reset();
-    PageRenderer::Reset();
-    SetGeneratorConfig(BuildFixtureConfig());
+    return TempSiteConfig(FixtureRoot());
 }
 
 std::string ReadFile(const fs::path &path)
@@ -63,16 +118,34 @@ std::string ReadFile(const fs::path &path)
     return buffer.str();
 }
 
+void WriteFile(const fs::path &path, const std::string &content)
+{
+    fs::create_directories(path.parent_path());
+    std::ofstream stream(path, std::ios::trunc);
+    stream << content;
+}
+
 void TestLayoutParserBuildsTree()
 {
-    PrepareGenerator();
-    Node *root = LayoutParser::GetStartNode();
+    LayoutParser parser(BuildFixtureConfig().layoutPath);
+    auto &tree = parser.GetTree();
+    Node *root = parser.GetStartNode();
     Expect(root != nullptr, "LayoutParser returned null start node");
-    Expect(root->name == "index", "Expected 'index' as root but got '" + root->name + "'");
-    Expect(root->children.size() == 2, "index should have two children");
-    Node *about = LayoutParser::FindNode("about");
+    Expect(root->name == "index", "Expected 'index' as root but got '" + std::string(root->name) + "'");
+    Expect(tree.Children(root).size() == 2, "index should have two children");
+    Node *about = parser.FindNode("about");
     Expect(about != nullptr, "About node missing");
-    Expect(about->parent == root, "About parent mismatch");
+    Expect(tree.Parent(about) == root, "About parent mismatch");
+
+    // Nodes are stored in BFS order, every node's children next to each other
+    Expect(root->id == 0 && tree.Size() == 4, "Layout should hold its four pages with the root first");
+    NodeId expected = 1;
+    for (NodeId id = 0; id < tree.Size(); id++)
+    {
+        for (auto child : tree.Children(tree.Root() + id))
+            Expect(child->id == expected++, "Children should follow BFS order");
+    }
+    Expect(parser.FindNode("missing") == nullptr, "Unknown names should not be found");
 }
 
 void TestTemplateParserRendersSimplePage()
@@ -83,6 +156,27 @@ void TestTemplateParserRendersSimplePage()
     Expect(output.find("<p>Body</p>") != std::string::npos, "TemplateParser failed to render body");
 }
 
+void TestTemplateParserCompiledExpansion()
+{
+    auto path = fs::temp_directory_path() / "meengi_compiled_templates.md";
+    WriteFile(path,
+              "# $Link(name,href)\n<a href=\"$$href$$\">$$name$$</a>\n#\n\n"
+              "# $Figure(link,desc)\n<figure>$Link($$desc$$,$$link$$)$</figure>\n#\n\n"
+              "# $Twice(a,b)\n$$a$$-$$b$$-$$a$$\n#\n\n"
+              "# $Loop()\nx$Loop()$y\n#\n");
+    TemplateParser parser(path.string());
+
+    auto figures = parser.Parse("$Figure(a.png,first)$ and $Figure(b.png,second)$");
+    Expect(figures == "<figure><a href=\"a.png\">first</a></figure> and <figure><a href=\"b.png\">second</a></figure>",
+           "Placeholders inside nested invocations expanded wrong: " + figures);
+    Expect(parser.Parse("$Twice(1,2)$") == "1-2-1", "Repeated placeholders expanded wrong");
+    Expect(parser.Parse("$Twice(1)$") == "1--", "Missing arguments should follow Template::Parse");
+    Expect(parser.Parse("[$Loop()$]") == "[xy]", "Recursive invocation should expand to nothing");
+    Expect(parser.Parse("costs $5 or $6") == "costs 6", "Unknown invocations should expand to nothing");
+    Expect(parser.Parse("a lone $ stays") == "a lone $ stays", "A single $ should be left alone");
+    fs::remove(path);
+}
+
 void TestShortHandParserFormatting()
 {
     ShortHandParser parser;
@@ -94,6 +188,183 @@ void TestShortHandParserFormatting()
     Expect(parser.Parse("/hline") == "<div class=\" hrcls\"><hr></ div>", "Horizontal rule conversion failed");
 }
 
+void TestHtmlMinifierCollapsesWhitespace()
+{
+    auto minify = [](const std::string &html)
+    {
+        std::string out;
+        auto saved = HtmlMinifier::Minify(html, out);
+        Expect(saved == html.size() - out.size(), "Minify reported the wrong number of saved bytes");
+        return out;
+    };
+
+    Expect(minify("\n  <div>\n    <p>a   b</p>\n  </div>\n") == "<div> <p>a b</p> </div>", "Whitespace should collapse to one space");
+    Expect(minify("a <!-- note\n --> b<!--[if IE]>x<![endif]-->") == "a b<!--[if IE]>x<![endif]-->", "Comments should be dropped, conditional ones kept");
+    Expect(minify("<a  href=\"x  y\"\n class='c'  >t</a>") == "<a href=\"x  y\" class='c'>t</a>", "Tags collapse whitespace outside quotes only");
+    Expect(minify("<pre>a\n   b</pre>  <TEXTAREA>  x  </textarea>") == "<pre>a\n   b</pre> <TEXTAREA>  x  </textarea>", "pre and textarea content must be kept");
+    Expect(minify("<script>if (a < b)\n  f(\"<!-- x -->\");</script>") == "<script>if (a < b)\n  f(\"<!-- x -->\");</script>", "Script content must be kept");
+    Expect(minify("1 < 2 <3") == "1 < 2 <3", "A lone < is text");
+}
+
+// Every line of the real content plus every page/template as one block (template expansions are multi line)
+// must come out of the scanner exactly like it did out of the old regex chain.
+void TestBlockParserBuildsBlocks()
+{
+    auto parse = [](const std::vector<std::string> &lines)
+    {
+        std::string out;
+        BlockParser blocks(out);
+        for (const auto &line : lines)
+            blocks.Feed(line);
+        blocks.Finish();
+        return out;
+    };
+
+    Expect(parse({"# Title *now*", "first line", "second **bold** line", "", "next"}) == "<h1>Title <i>now</i></h1>\n<p>first line\nsecond <b>bold</b> line</p>\n<p>next</p>\n",
+           "Paragraphs should span lines until a blank line");
+    Expect(parse({"- one", "  more of one", "- two", "1. first", "", "> quoted", "> still"}) == "<ul>\n<li>one\nmore of one</li>\n<li>two</li>\n</ul>\n<ol>\n<li>first</li>\n</ol>\n<blockquote>quoted\nstill</blockquote>\n",
+           "Lists and quotes should collect their lines");
+    Expect(parse({"```cpp", "if (a < b && *p*)", "", "```", "<div>**x**</div>\ntext"}) == "<pre><code class=\"language-cpp\">if (a &lt; b &amp;&amp; *p*)\n\n</code></pre>\n<div><b>x</b></div>\n<p>text</p>\n",
+           "Fenced code should be escaped and HTML lines passed through");
+
+    auto spans = [](const std::string &text)
+    {
+        std::string out;
+        BlockParser::ParseInline(text, out);
+        return out;
+    };
+    Expect(spans("**a *b* c** `x*y` /nl") == "<b>a <i>b</i> c</b> <code>x*y</code> <br><br>", "Inline spans should nest");
+    Expect(spans("*a **b* c**") == "<i>a **b</i> c**", "Spans should not overlap");
+    Expect(spans("* * ` ** *") == "<i> </i> ` ** *", "Unpaired delimiters stay as they are");
+
+    // Long runs of delimiters are one pass, not one scan per delimiter
+    std::string stars(1 << 20, '*');
+    std::string bolds;
+    for (size_t i = 0; i < stars.size() / 4; i++)
+        bolds += "<b></b>";
+    Expect(spans(stars) == bolds, "Stars pair up as empty bold spans");
+    std::string ticks(1 << 20, '`');
+    Expect(spans(ticks).size() == (ticks.size() / 2) * 13, "Backticks pair up as empty code spans");
+}
+
+void TestShortHandScannerMatchesRegexOnContent()
+{
+    ShortHandParser parser;
+    std::vector<std::string> samples = {
+        "", ">", "> # quoted heading", "**a*b**", "*x **a*b**", "***a**", "*a**b", "# a\r", "#\n\n**a** # b",
+        "```a#\n```", "``````", "/n**x**l /hline /nl", "a # b\nc # d", ">\n\nfoo", "> a\nb"};
+
+    size_t files = 0;
+    for (const auto &entry : fs::recursive_directory_iterator("../content"))
+    {
+        if (!entry.is_regular_file() || entry.path().extension() != ".md")
+            continue;
+        files++;
+        auto lines = GetLinesFromFile(entry.path().string(), false);
+        std::string block;
+        for (const auto &line : lines)
+        {
+            samples.push_back(line);
+            block += line + "\n";
+        }
+        samples.push_back(block);
+    }
+    Expect(files > 0, "No content found under ../content");
+
+    std::string out = "prefix";
+    for (const auto &sample : samples)
+    {
+        out.resize(6);
+        parser.Parse(std::string_view(sample), out);
+        auto expected = parser.ParseRegex(sample);
+        Expect(out.compare(6, std::string::npos, expected) == 0, "Shorthand engines disagree on '" + sample + "'");
+    }
+}
+
+// Views out of the mapped file must split exactly like the old getline loop
+void TestMappedFileLinesMatchGetline()
+{
+    auto path = fs::temp_directory_path() / "meengi_mapped.md";
+    std::vector<std::string> samples = {"", "\n", "a", "a\n", "a\n\nb", "// c\nx\r\n//\n/ y\n\n", "//only"};
+    for (const auto &entry : fs::recursive_directory_iterator("../content"))
+    {
+        if (entry.is_regular_file())
+            samples.push_back(ReadFile(entry.path()));
+    }
+
+    for (const auto &sample : samples)
+    {
+        WriteFile(path, sample);
+        for (bool ignoreComments : {false, true})
+        {
+            std::vector<std::string> expected;
+            std::istringstream stream(sample);
+            std::string line;
+            while (std::getline(stream, line))
+            {
+                if (!ignoreComments || line.rfind("//", 0) != 0)
+                    expected.push_back(line);
+            }
+
+            MappedFile file(path.string());
+            auto views = file.Lines(ignoreComments);
+            Expect(std::equal(views.begin(), views.end(), expected.begin(), expected.end()), "MappedFile split '" + sample.substr(0, 40) + "' differently");
+        }
+    }
+
+    WriteFile(path, "a\n// comment\nb\n");
+    MappedFile file(path.string());
+    LineReader reader(file.Text());
+    std::string_view line;
+    Expect(reader.Next(line) && line == "a" && reader.LineNumber() == 1, "LineReader missed the first line");
+    Expect(reader.Next(line) && line == "b" && reader.LineNumber() == 3, "LineReader should count skipped comments");
+    Expect(!reader.Next(line), "LineReader read past the end");
+
+    Expect(!MappedFile((path.parent_path() / "meengi_missing.md").string()).IsOpen(), "Missing files should not open");
+
+    // A file read rather than mapped keeps its text when it is truncated meanwhile
+    MappedFile copy;
+    Expect(copy.Open(path.string(), false) && copy.Text() == "a\n// comment\nb\n", "An unmapped file should read the whole file");
+    WriteFile(path, "");
+    Expect(copy.Text() == "a\n// comment\nb\n", "An unmapped file should not follow the file on disk");
+    fs::remove(path);
+}
+
+void TestDelimiterSetMatchesFindFirstOf()
+{
+    // Text from a fixed LCG so every run checks the same bytes, dense enough in delimiters to hit every lane
+    std::string text;
+    uint32_t state = 12345;
+    const std::string alphabet = "abc *`#/\n\r,()$\xff\x80";
+    for (size_t i = 0; i < 1000; i++)
+    {
+        state = state * 1103515245 + 12345;
+        text += (state >> 16) % 4 == 0 ? alphabet[(state >> 8) % alphabet.size()] : 'x';
+    }
+
+    const std::vector<std::string> sets = {"*`#/\n\r", ",()", "$", "\xff", std::string("abcdefghijklmnopq*")};
+    auto initial = DelimiterSet::Level();
+    for (auto level : {ScanLevel::Scalar, ScanLevel::Sse2, ScanLevel::Avx2})
+    {
+        DelimiterSet::SetLevel(level);
+        for (const auto &set : sets)
+        {
+            DelimiterSet delimiters(set);
+            for (size_t length : {size_t(0), size_t(1), size_t(63), size_t(64), size_t(65), size_t(200), text.size()})
+            {
+                std::string_view view(text.data(), length);
+                for (size_t from = 0; from <= length; from++)
+                {
+                    if (delimiters.Find(view, from) != view.find_first_of(set, from))
+                        throw std::runtime_error(std::string("DelimiterSet::Find differs from find_first_of at the ") + DelimiterSet::LevelName(DelimiterSet::Level()) + " level");
+                }
+            }
+        }
+    }
+    DelimiterSet::SetLevel(initial);
+    Expect(DelimiterSet::Level() == initial, "SetLevel should restore the best level");
+}
+
 void TestFileHelpersUtilities()
 {
     auto extracted = ExtractBetween("##Sample", "##", "\n");
@@ -120,17 +391,68 @@ void TestFileHelpersUtilities()
 
 void TestWarnAndClearRespectConfig()
 {
-    PrepareGenerator();
-    ClearPreviousWarnings();
-    warn("example warning");
+    Generator generator(BuildFixtureConfig());
+    auto &warnings = generator.Warnings();
+    warnings.Clear();
+    {
+        WarningScope scope(warnings);
+        warn("example warning");
+    }
+    warnings.Flush();
     auto warningPath = fs::path(BuildFixtureConfig().warningsFile);
     auto content = ReadFile(warningPath);
     Expect(content.find("example warning") != std::string::npos, "Warning not written to configured file");
 }
 
+void TestWarningSinkBuffersAndDeduplicates()
+{
+    auto config = BuildFixtureConfig();
+    auto warningPath = fs::path(config.warningsFile);
+    WarningSink sink(config.warningsFile, config.contentDir, false);
+    sink.Clear();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+        threads.emplace_back([&]()
+                             {
+            WarningScope scope(sink);
+            for (int i = 0; i < 100; i++)
+                warn("repeated warning"); });
+    for (auto &thread : threads)
+        thread.join();
+    Expect(ReadFile(warningPath).empty(), "Warnings should stay buffered until flushed");
+
+    {
+        WarningScope scope(sink);
+        WarningLocation location((fs::path(config.contentDir) / "about.md").string());
+        location.SetLine(3);
+        warn("located warning");
+    }
+    sink.Flush();
+    Expect(ReadFile(warningPath) == "repeated warning\nabout.md:3: located warning\n", "Repeats should be dropped and locations prefixed");
+
+    WarningSink jsonSink(config.warningsFile, config.contentDir, true);
+    jsonSink.Clear();
+    jsonSink.Add(Warning{"say \"hi\"", (fs::path(config.contentDir) / "index.md").string(), 7});
+    jsonSink.Flush();
+    Expect(ReadFile(warningPath) == "{\"message\": \"say \\\"hi\\\"\", \"file\": \"index.md\", \"line\": 7}\n", "JSON warnings are malformed");
+
+    // Skipped pages replay their warnings from the manifest, locations included
+    BuildManifest manifest;
+    manifest.pages["index"].warnings.push_back(Warning{"bad column count", "content/index.md", 4});
+    auto manifestPath = fs::temp_directory_path() / "meengi_manifest_warnings";
+    BuildManifest loaded;
+    Expect(manifest.Save(manifestPath.string()) && loaded.Load(manifestPath.string()), "Manifest round trip failed");
+    const auto &replayed = loaded.pages["index"].warnings;
+    Expect(replayed.size() == 1 && replayed[0].message == "bad column count" && replayed[0].file == "content/index.md" && replayed[0].line == 4,
+           "Manifest lost the warning location");
+    fs::remove(manifestPath);
+
+    jsonSink.Clear();
+}
+
 void TestClearPreviousFilesRemovesHtml()
 {
-    PrepareGenerator();
     auto siteDir = fs::path(BuildFixtureConfig().outputDir);
     fs::create_directories(siteDir);
     auto htmlPath = siteDir / "temp.html";
@@ -139,18 +461,33 @@ void TestClearPreviousFilesRemovesHtml()
         std::ofstream(htmlPath) << "temp";
         std::ofstream(otherPath) << "keep";
     }
-    ClearPreviousFiles();
+    ClearPreviousFiles(siteDir.string());
     Expect(!fs::exists(htmlPath), "ClearPreviousFiles should remove html files");
     Expect(fs::exists(otherPath), "ClearPreviousFiles should not remove non-html files");
 }
 
+void TestWriteFileAtomicallyReplacesFiles()
+{
+    auto dir = fs::temp_directory_path() / "meengi_atomic_write";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    auto path = (dir / "page.html").string();
+
+    std::string big(1 << 20, 'x');
+    Expect(WriteFileAtomically(path, "old"), "WriteFileAtomically failed on a new file");
+    Expect(WriteFileAtomically(path, big), "WriteFileAtomically failed to replace a file");
+    Expect(GetLinesFromFile(path, false) == std::vector<std::string>{big}, "Replaced file has the wrong content");
+    Expect(std::distance(fs::directory_iterator(dir), fs::directory_iterator()) == 1, "Temporary files were left behind");
+    Expect(!WriteFileAtomically((dir / "missing" / "page.html").string(), "x"), "Writing into a missing directory should fail");
+    fs::remove_all(dir);
+}
+
 void TestPageRendererProducesOutput()
 {
-    PrepareGenerator();
-    ClearPreviousFiles();
-    auto start = LayoutParser::GetStartNode();
-    PageRenderer::Render(start);
     auto siteDir = fs::path(BuildFixtureConfig().outputDir);
+    ClearPreviousFiles(siteDir.string());
+    Generator generator(BuildFixtureConfig());
+    generator.Render();
     auto indexPath = siteDir / "index.html";
     auto aboutPath = siteDir / "about.html";
     Expect(fs::exists(indexPath), "index.html was not generated");
@@ -158,6 +495,854 @@ void TestPageRendererProducesOutput()
     auto indexContent = ReadFile(indexPath);
     Expect(indexContent.find("fixture home page") != std::string::npos, "Rendered index missing body content");
 }
+
+void TestParallelRenderMatchesSerial()
+{
+    auto siteDir = fs::path(BuildFixtureConfig().outputDir);
+    auto renderWith = [&](unsigned jobs)
+    {
+        auto config = BuildFixtureConfig();
+        config.jobs = jobs;
+        ClearPreviousFiles(siteDir.string());
+        Generator generator(config);
+        generator.Render();
+
+        std::vector<std::pair<std::string, std::string>> pages;
+        for (const auto &entry : fs::directory_iterator(siteDir))
+        {
+            if (entry.path().extension() == ".html")
+                pages.emplace_back(entry.path().filename().string(), ReadFile(entry.path()));
+        }
+        std::sort(pages.begin(), pages.end());
+        return pages;
+    };
+
+    auto serial = renderWith(1);
+    auto parallel = renderWith(4);
+    Expect(serial.size() == 4, "Expected four rendered fixture pages");
+    Expect(serial == parallel, "Parallel render differs from serial render");
+}
+
+// Two sites in one process, rendered at once from different threads, must come out like they do alone
+void TestGeneratorsRenderSitesConcurrently()
+{
+    auto root = TempRoot("meengi_generators");
+    WriteFile(root / "other" / "directives" / "layout.md", "##home\n#x\n#y\n#x\n");
+    WriteFile(root / "other" / "directives" / "templates.md", "# $Page(body)\n<section>$$body$$</section>\n#\n");
+    WriteFile(root / "other" / "home.md", "$Page(home)$\n");
+    WriteFile(root / "other" / "x.md", "$Page(x)$\n");
+    WriteFile(root / "other" / "y.md", "**y**\n");
+
+    auto fixture = BuildFixtureConfig();
+    fixture.outputDir = (root / "fixture-site").string();
+    fixture.warningsFile = (root / "fixture-warnings.txt").string();
+    fixture.jobs = 2;
+    fixture.incremental = false;
+
+    GeneratorConfig other;
+    other.contentDir = (root / "other").string();
+    other.outputDir = (root / "other-site").string();
+    other.layoutPath = (root / "other" / "directives" / "layout.md").string();
+    other.templatesPath = (root / "other" / "directives" / "templates.md").string();
+    other.warningsFile = (root / "other-warnings.txt").string();
+    other.jobs = 2;
+    other.incremental = false;
+
+    // Pages plus the warnings file, so a warning landing in the wrong site shows up too
+    auto snapshot = [](const GeneratorConfig &config)
+    {
+        std::vector<std::pair<std::string, std::string>> files;
+        for (const auto &entry : fs::directory_iterator(config.outputDir))
+        {
+            if (entry.path().extension() == ".html")
+                files.emplace_back(entry.path().filename().string(), ReadFile(entry.path()));
+        }
+        std::sort(files.begin(), files.end());
+        files.emplace_back("warnings", ReadFile(config.warningsFile));
+        return files;
+    };
+
+    Generator fixtureGenerator(fixture);
+    Generator otherGenerator(other);
+    fixtureGenerator.Render();
+    otherGenerator.Render();
+    auto fixtureAlone = snapshot(fixture);
+    auto otherAlone = snapshot(other);
+    Expect(otherAlone.size() == 4 && otherAlone[1].second == "<section>x</section>\n", "The second site rendered wrong");
+    Expect(otherAlone.back().second.find("multiple PageTitles") != std::string::npos, "The second site's layout warning is missing");
+
+    for (int round = 0; round < 3; round++)
+    {
+        fs::remove_all(fixture.outputDir);
+        fs::remove_all(other.outputDir);
+        // The fixture generator is also rendered from two threads at once, those renders take turns
+        std::vector<std::thread> threads;
+        threads.emplace_back([&]()
+                             { fixtureGenerator.Render(); });
+        threads.emplace_back([&]()
+                             { fixtureGenerator.Render(); });
+        threads.emplace_back([&]()
+                             { otherGenerator.Render(); });
+        for (auto &thread : threads)
+            thread.join();
+        Expect(snapshot(fixture) == fixtureAlone && snapshot(other) == otherAlone, "Concurrent generators interfered with each other");
+    }
+
+    fs::remove_all(root);
+}
+
+void TestIncrementalRenderSkipsUnchangedPages()
+{
+    auto root = TempRoot("meengi_incremental");
+    WriteFile(root / "content" / "directives" / "layout.md", "##index\n#a\n#b\n");
+    WriteFile(root / "content" / "directives" / "templates.md",
+              childListTemplates + "# $Page(body)\n<p>$$body$$</p>\n#\n");
+    WriteFile(root / "content" / "index.md", "$ChildList()$\n");
+    WriteFile(root / "content" / "a.md", "$Page(first)$\n");
+    WriteFile(root / "content" / "b.md", "plain b\n");
+
+    auto config = TempSiteConfig(root);
+
+    auto build = [&]()
+    {
+        Generator generator(config);
+        return generator.Render();
+    };
+
+    auto first = build();
+    Expect(first.pages == 3 && first.rendered == 3, "First build should render every page");
+    Expect(build().rendered == 0, "Unchanged build should not render any page");
+
+    // Output options apply to every page
+    config.minify = true;
+    Expect(build().rendered == 3, "Turning on --minify should re-render every page");
+    config.minify = false;
+    Expect(build().rendered == 3, "Turning off --minify should re-render every page");
+    config.blockMarkdown = true;
+    Expect(build().rendered == 3, "Turning on --block-markdown should re-render every page");
+    config.blockMarkdown = false;
+    Expect(build().rendered == 3, "Turning off --block-markdown should re-render every page");
+
+    // A full build renders everything again but leaves identical files (and their mtime) alone
+    auto aHtml = root / "site" / "a.html";
+    auto oldTime = fs::last_write_time(aHtml) - std::chrono::hours(1);
+    fs::last_write_time(aHtml, oldTime);
+    config.incremental = false;
+    auto full = build();
+    Expect(full.rendered == 3 && full.written == 0 && full.unchanged == 3, "A full build should not rewrite unchanged pages");
+    Expect(fs::last_write_time(aHtml) == oldTime, "An unchanged page should keep its mtime");
+    WriteFile(aHtml, "edited");
+    Expect(build().written == 1 && ReadFile(aHtml) == "<p>first</p>\n", "A page edited on disk should be rewritten");
+    config.incremental = true;
+
+    WriteFile(root / "content" / "a.md", "$Page(second)$\n");
+    Expect(build().rendered == 1, "Editing a.md should only re-render a");
+    Expect(ReadFile(root / "site" / "a.html") == "<p>second</p>\n", "a.html was not refreshed");
+
+    // Only the page using $Page$ depends on it
+    WriteFile(root / "content" / "directives" / "templates.md",
+              childListTemplates + "# $Page(body)\n<div>$$body$$</div>\n#\n");
+    Expect(build().rendered == 1, "Changing $Page$ should only re-render a");
+
+    // A new child invalidates the parent's $ChildList$ but not its siblings
+    WriteFile(root / "content" / "directives" / "layout.md", "##index\n#a\n#b\n#c\n");
+    WriteFile(root / "content" / "c.md", "plain c\n");
+    Expect(build().rendered == 2, "Adding a child should re-render the parent and the child only");
+    Expect(ReadFile(root / "site" / "index.html").find("<li>c</li>") != std::string::npos, "index.html is missing the new child");
+
+    // Pages dropped from the layout lose their output
+    WriteFile(root / "content" / "directives" / "layout.md", "##index\n#a\n#c\n");
+    build();
+    Expect(!fs::exists(root / "site" / "b.html"), "b.html should be removed once b leaves the layout");
+
+    // A page that can't be written (here a directory is in the way) is warned about and retried next build
+    WriteFile(root / "content" / "c.md", "plain c, edited\n");
+    fs::create_directories(root / "site" / "c.html.blocked");
+    fs::remove(root / "site" / "c.html");
+    fs::rename(root / "site" / "c.html.blocked", root / "site" / "c.html");
+    auto blocked = build();
+    Expect(blocked.rendered == 1 && blocked.written == 0, "A page that failed to write should not count as written");
+    Expect(ReadFile(root / "warnings.txt").find("Could not write") != std::string::npos, "A failed write should be warned about");
+    fs::remove(root / "site" / "c.html");
+    Expect(build().rendered == 1 && ReadFile(root / "site" / "c.html").find("edited") != std::string::npos, "A page that failed to write should be rendered again");
+
+    fs::remove_all(root);
+}
+
+void TestAssetsAreCopiedAndFingerprinted()
+{
+    auto root = TempRoot("meengi_assets");
+    WriteFile(root / "content" / "directives" / "layout.md", "##index\n");
+    WriteFile(root / "content" / "directives" / "templates.md", "# $Img(name)\n<img src=\"$Asset(images/$$name$$.png)$\">\n#\n");
+    WriteFile(root / "content" / "index.md", "$Img(a)$\n$Asset(missing.js)$\n");
+    WriteFile(root / "links" / "images" / "a.png", "first");
+    WriteFile(root / "links" / "style.css", "body {}");
+
+    auto config = TempSiteConfig(root);
+    config.assetsDir = (root / "links").string();
+    config.assetsOutputDir = (root / "site" / "links").string();
+    config.assetsUrl = "links/";
+    config.fingerprintAssets = true;
+
+    auto build = [&]()
+    {
+        Generator generator(config);
+        return generator.Render();
+    };
+
+    auto first = build();
+    std::string firstName = "a." + ToHex(HashBytes("first")).substr(0, 8) + ".png";
+    Expect(first.assets.files == 2 && first.assets.copied == 2, "Every asset should be copied on the first build");
+    Expect(ReadFile(root / "site" / "links" / "images" / firstName) == "first", "Fingerprinted copy is missing");
+    Expect(ReadFile(root / "site" / "index.html").find("src=\"links/images/" + firstName + "\"") != std::string::npos, "$Asset$ should resolve to the fingerprinted URL");
+    Expect(ReadFile(config.warningsFile).find("missing.js is not in the assets directory") != std::string::npos, "Missing assets should be reported");
+
+    auto second = build();
+    Expect(second.assets.copied == 0 && second.assets.unchanged == 2 && second.rendered == 0, "Unchanged assets should not be copied again");
+
+    WriteFile(root / "links" / "images" / "a.png", "second");
+    auto third = build();
+    std::string secondName = "a." + ToHex(HashBytes("second")).substr(0, 8) + ".png";
+    Expect(third.assets.copied == 1 && third.rendered == 1, "A changed asset should be copied and its pages re-rendered");
+    Expect(fs::exists(root / "site" / "links" / "images" / secondName) && !fs::exists(root / "site" / "links" / "images" / firstName),
+           "The old fingerprinted copy should be replaced");
+    Expect(ReadFile(root / "site" / "index.html").find(secondName) != std::string::npos, "index.html should link the new copy");
+
+    // A copy that fails (a directory is in the way) is reported and counted neither as copied nor unchanged
+    WriteFile(root / "links" / "style.css", "p {}");
+    std::string styleName = "style." + ToHex(HashBytes("p {}")).substr(0, 8) + ".css";
+    fs::create_directories(root / "site" / "links" / styleName);
+    auto blocked = build();
+    Expect(blocked.assets.copied == 0 && blocked.assets.unchanged == 1, "A failed copy should not be counted as copied");
+    Expect(ReadFile(config.warningsFile).find("Could not copy asset") != std::string::npos, "A failed copy should be warned about");
+    fs::remove(root / "site" / "links" / styleName);
+    Expect(build().assets.copied == 1 && ReadFile(root / "site" / "links" / styleName) == "p {}", "A failed copy should be retried");
+
+    // Without fingerprints the output name stays, a failed copy must still be redone over the old one.
+    // The copy fails while the output directory points somewhere nothing can be created.
+    config.fingerprintAssets = false;
+    build();
+    auto links = root / "site" / "links";
+    if (fs::is_directory("/proc/self"))
+    {
+        WriteFile(root / "links" / "style.css", "p { color: red }");
+        fs::rename(links, root / "site" / "links.saved");
+        fs::create_directory_symlink("/proc/self", links);
+        Expect(build().assets.copied == 0, "Copying into /proc should fail");
+        fs::remove(links);
+        fs::rename(root / "site" / "links.saved", links);
+        Expect(ReadFile(links / "style.css") == "p {}", "The old copy should still be in place");
+        auto retried = build();
+        Expect(retried.assets.copied == 1 && ReadFile(links / "style.css") == "p { color: red }", "A failed copy should be redone under the same name");
+    }
+
+    fs::remove_all(root);
+}
+
+void TestSearchIndexFollowsPages()
+{
+    std::vector<std::string> terms;
+    SearchIndex::Tokenize("<h1 class=\"Title\">Hello, World</h1><!-- hidden --><script>var skipped;</script>\n<p>hello caf\xc3\xa9 a&amp;b x2 <b>Bold</b></p>", terms);
+    Expect(terms == std::vector<std::string>({"bold", "caf\xc3\xa9", "hello", "world", "x2"}), "Tokenize should keep the lowercased words of the text only");
+
+    auto root = TempRoot("meengi_search");
+    WriteFile(root / "content" / "directives" / "layout.md", "##index\n#a\n#b\n");
+    WriteFile(root / "content" / "directives" / "templates.md", "");
+    WriteFile(root / "content" / "index.md", "welcome home\n");
+    WriteFile(root / "content" / "a.md", "apple home\n");
+    WriteFile(root / "content" / "b.md", "banana home\n");
+
+    auto config = TempSiteConfig(root);
+    config.searchIndex = (root / "site" / "search-index.json").string();
+
+    auto build = [&]()
+    {
+        Generator generator(config);
+        return generator.Render();
+    };
+
+    // Posting lists are deltas: home is on pages 0, 1 and 2
+    Expect(build().rendered == 3, "First build should render every page");
+    Expect(ReadFile(config.searchIndex) == "{\"version\":1,\"pages\":[\"index\",\"a\",\"b\"],\"terms\":{\"apple\":[1],\"banana\":[2],\"home\":[0,1,1],\"welcome\":[0]}}\n",
+           "Unexpected search index");
+
+    // Skipped pages contribute the terms the manifest kept for them
+    WriteFile(root / "content" / "b.md", "cherry\n");
+    Expect(build().rendered == 1, "Editing b.md should only re-render b");
+    Expect(ReadFile(config.searchIndex) == "{\"version\":1,\"pages\":[\"index\",\"a\",\"b\"],\"terms\":{\"apple\":[1],\"cherry\":[2],\"home\":[0,1],\"welcome\":[0]}}\n",
+           "The search index should keep the terms of skipped pages");
+
+    // Without the index the pages have no terms to reuse, so switching it on renders them again
+    config.searchIndex.clear();
+    Expect(build().rendered == 3, "Turning off --search-index should re-render every page");
+    config.searchIndex = (root / "site" / "search-index.json").string();
+    Expect(build().rendered == 3, "Turning on --search-index should re-render every page");
+
+    fs::remove_all(root);
+}
+
+void TestPrecompressedVariantsFollowPages()
+{
+    if (!EncodingAvailable(Encoding::Gzip))
+        return;
+
+    auto root = TempRoot("meengi_precompress");
+    WriteFile(root / "content" / "directives" / "layout.md", "##index\n#a\n");
+    WriteFile(root / "content" / "directives" / "templates.md", "# $Page(body)\n<p>$$body$$</p>\n#\n");
+    WriteFile(root / "content" / "index.md", "index\n");
+    WriteFile(root / "content" / "a.md", "$Page(first)$\n");
+
+    auto config = TempSiteConfig(root);
+    config.precompress = {Encoding::Gzip};
+
+    auto build = [&]()
+    {
+        Generator generator(config);
+        return generator.Render();
+    };
+
+    build();
+    auto gz = root / "site" / "a.html.gz";
+    auto compressed = ReadFile(gz);
+    Expect(compressed.size() > 2 && compressed[0] == '\x1f' && compressed[1] == '\x8b', "a.html.gz should be a gzip file");
+    std::string expected;
+    Expect(Compress(Encoding::Gzip, "<p>first</p>\n", expected) && compressed == expected, "a.html.gz should hold the page");
+
+    // Unchanged pages keep their variant, changed ones get a new one
+    auto oldTime = fs::last_write_time(gz) - std::chrono::hours(1);
+    fs::last_write_time(gz, oldTime);
+    config.incremental = false;
+    build();
+    Expect(fs::last_write_time(gz) == oldTime, "An unchanged page should not be compressed again");
+    WriteFile(root / "content" / "a.md", "$Page(second)$\n");
+    build();
+    Expect(fs::last_write_time(gz) != oldTime, "A changed page should be compressed again");
+
+    // A variant that can't be written (a directory is in the way) is reported, and the page is redone next build
+    config.incremental = true;
+    WriteFile(root / "content" / "index.md", "index, edited\n");
+    auto indexGz = root / "site" / "index.html.gz";
+    fs::remove(indexGz);
+    WriteFile(indexGz / "blocker", "");
+    Expect(build().rendered == 1, "The edited page should be rendered");
+    Expect(ReadFile(root / "warnings.txt").find("Could not write") != std::string::npos, "A failed variant should be warned about");
+    Expect(build().rendered == 1, "A page whose variant failed should not count as up to date while something sits at its path");
+    fs::remove_all(indexGz);
+    Expect(build().rendered == 1, "A page that lost its variant should be rendered again");
+    Expect(Compress(Encoding::Gzip, "index, edited\n", expected) && ReadFile(indexGz) == expected, "index.html.gz should hold the edited page");
+    config.incremental = false;
+
+    // Without --precompress a changed page drops its variant rather than leaving a stale one
+    config.precompress.clear();
+    WriteFile(root / "content" / "a.md", "$Page(third)$\n");
+    build();
+    Expect(!fs::exists(gz) && fs::exists(root / "site" / "index.html.gz"), "Only the changed page should lose its variant");
+
+    fs::remove_all(root);
+}
+
+void TestTreeMapFragmentsAreShared()
+{
+    auto root = TempRoot("meengi_treemap");
+    WriteFile(root / "layout.md", "##index\n#a\n#b\n\n##a\n#c\n\n##c\n#d\n");
+    WriteFile(root / "templates.md",
+              "# $TreeMap(map)\n<ul>$$map$$</ul>\n#\n"
+              "# $TreeMapTitle1(name,childMap)\n<li class=\"top\">$$name$$<ul>$$childMap$$</ul></li>\n#\n"
+              "# $TreeMapTitle2(name,childMap)\n<li>$$name$$<ul>$$childMap$$</ul></li>\n#\n");
+
+    LayoutParser layout((root / "layout.md").string());
+    TemplateParser parser((root / "templates.md").string());
+    auto render = [&](const std::string &page, const std::string &line)
+    {
+        RenderContext context;
+        context.layout = &layout.GetTree();
+        context.node = layout.FindNode(page);
+        return parser.Parse(line, context);
+    };
+
+    parser.BeginRender(1);
+    auto full = render("index", "$TreeMap()$");
+    auto partial = render("a", "$TreeMapPartial()$");
+    auto misses = parser.GetCacheMisses();
+    Expect(render("b", "$TreeMap()$") == full && parser.GetCacheMisses() == misses, "The site-wide tree map should be built once");
+    Expect(full.find("<li>d<ul></ul></li>") != std::string::npos, "Tree map is missing a nested node");
+
+    parser.BeginRender(1);
+    render("index", "$TreeMap()$");
+    Expect(parser.GetCacheMisses() == 0 && parser.GetCacheHits() == 1, "An unchanged layout should keep the cached fragments");
+    parser.BeginRender(2);
+    render("index", "$TreeMap()$");
+    Expect(parser.GetCacheMisses() > 0, "A new layout hash should drop the cached fragments");
+
+    parser.EnableCache(false);
+    Expect(render("index", "$TreeMap()$") == full && render("a", "$TreeMapPartial()$") == partial, "Cached tree maps differ from fresh ones");
+
+    fs::remove_all(root);
+}
+
+void TestBuildStatsRecordsPhasesAndTrace()
+{
+    auto config = BuildFixtureConfig();
+    config.incremental = false;
+    ClearPreviousFiles(config.outputDir);
+
+    auto tracePath = fs::temp_directory_path() / "meengi_trace.json";
+    BuildStats::Enable(true);
+    Generator generator(config);
+    StatsWindow both;
+    auto summary = generator.Render();
+    Expect(BuildStats::Get(Counter::Pages) == summary.pages && BuildStats::Get(Counter::PagesRendered) == summary.rendered, "Page counters are off");
+    Expect(BuildStats::Get(Counter::BytesIn) > 0 && BuildStats::Get(Counter::BytesOut) > 0, "Byte counters were not recorded");
+
+    // The second window only sees the second build, reporting it leaves the first window's numbers alone
+    auto pagesLine = [](size_t pages)
+    {
+        std::ostringstream line;
+        line << std::left << std::setw(22) << "pages" << std::right << std::setw(12) << pages << '\n';
+        return line.str();
+    };
+    {
+        StatsWindow second;
+        generator.Render();
+        config.stats = false;
+        config.tracePath = tracePath.string();
+        BuildStats::Report(config, second);
+        std::ostringstream table;
+        BuildStats::PrintSummary(table, second);
+        Expect(table.str().find("template expand") != std::string::npos, "Summary is missing the expansion phase");
+        Expect(table.str().find(pagesLine(summary.pages)) != std::string::npos, "A window should only count the pages rendered while it was open");
+    }
+    Expect(BuildStats::Get(Counter::Pages) == 2 * summary.pages, "Reporting one window reset the counters");
+    std::ostringstream table;
+    BuildStats::PrintSummary(table, both);
+    Expect(table.str().find(pagesLine(2 * summary.pages)) != std::string::npos, "The outer window should count both builds");
+
+    auto trace = ReadFile(tracePath);
+    Expect(trace.find("\"traceEvents\"") != std::string::npos && trace.find("\"name\": \"page\"") != std::string::npos, "Trace is missing page events");
+    Expect(BuildStats::WriteTrace(tracePath.string(), both), "Trace was not written");
+    Expect(ReadFile(tracePath).size() > trace.size(), "The outer window's trace should hold both builds");
+
+    BuildStats::Disable();
+    BuildStats::Reset();
+    fs::remove(tracePath);
+}
+
+void TestTemplateCacheMemoizesPureTemplates()
+{
+    auto path = fs::temp_directory_path() / "meengi_cache_templates.md";
+    WriteFile(path,
+              "# $Pure(x)\n<b>$$x$$</b>\n#\n"
+              "# $Wrap(x)\n<i>$Pure($$x$$)$</i>\n#\n"
+              "# $Who(x)\n$PageName()$ $$x$$\n#\n"
+              "# $Outer()\n$Who(a)$\n#\n"
+              "# $LoopA()\n$LoopB()$\n#\n"
+              "# $LoopB()\n$LoopA()$\n#\n"
+              "# $Dyn(n)\n$X$$n$$(a)$\n#\n");
+
+    TemplateParser parser(path.string());
+    Expect(parser.IsCacheable("Pure") && parser.IsCacheable("Wrap"), "Pure templates should be cacheable");
+    Expect(!parser.IsCacheable("Who") && !parser.IsCacheable("Outer"), "Templates reaching PageName must not be cached");
+    Expect(!parser.IsCacheable("LoopA") && !parser.IsCacheable("LoopB"), "Cyclic templates must not be cached");
+    Expect(!parser.IsCacheable("Dyn"), "Templates invoking a name built from placeholders must not be cached");
+
+    std::string line = "$Wrap(1)$ $Wrap(1)$ $Wrap(2)$ $Outer()$ $LoopA()$";
+    Node page("page");
+    RenderContext cached;
+    cached.node = &page;
+    auto output = parser.Parse(line, cached);
+    Expect(parser.GetCacheHits() == 1 && parser.GetCacheMisses() == 4, "Unexpected cache hit/miss counts");
+
+    RenderContext hitOnly;
+    hitOnly.node = &page;
+    parser.Parse("$Wrap(1)$", hitOnly);
+    Expect(hitOnly.usedTemplates.count("Pure") == 1, "A cache hit should still record the nested templates it used");
+
+    parser.EnableCache(false);
+    RenderContext uncached;
+    uncached.node = &page;
+    Expect(parser.Parse(line, uncached) == output, "Cached and uncached expansions differ");
+    Expect(uncached.usedTemplates == cached.usedTemplates && uncached.templateExpansions == cached.templateExpansions &&
+               uncached.maxTemplateDepth == cached.maxTemplateDepth,
+           "Cache hits should replay what the expansion recorded");
+    Expect(parser.GetCacheHits() == 0 && parser.GetCacheMisses() == 0, "Disabled cache should not count lookups");
+
+    fs::remove(path);
+}
+
+// Once a page's buffers have grown to fit, expanding a line allocates nothing, cached or not
+void TestTemplateExpansionDoesNotAllocate()
+{
+    auto root = TempRoot("meengi_no_alloc");
+    WriteFile(root / "layout.md", "##index\n#a\n#b\n\n##a\n#c\n");
+    WriteFile(root / "templates.md",
+              "# $Pure(x)\n<b>$$x$$</b>\n#\n"
+              "# $Wrap(x)\n<i>$Pure($$x$$)$</i>\n#\n"
+              "# $Card(title,body)\n<h2>$$title$$ on $PageName()$</h2>$Wrap($$body$$)$\n#\n"
+              "# $Dyn(n)\n$P$$n$$(dynamic)$\n#\n"
+              "# $ChildList(list,cls)\n<ul class=\"$$cls$$\">$$list$$</ul>\n#\n"
+              "# $ChildListItem(name)\n<li>$$name$$</li>\n#\n"
+              "# $NavigList(list)\n<nav>$$list$$</nav>\n#\n"
+              "# $NavigItem(name)\n<a>$$name$$</a>\n#\n"
+              "# $TreeMap(map)\n<ul>$$map$$</ul>\n#\n"
+              "# $TreeMapTitle1(name,childMap)\n<li>$$name$$<ul>$$childMap$$</ul></li>\n#\n"
+              "# $TreeMapTitle2(name,childMap)\n<li>$$name$$ $$childMap$$</li>\n#\n");
+
+    LayoutParser layout((root / "layout.md").string());
+    TemplateParser parser((root / "templates.md").string());
+    RenderContext context;
+    context.layout = &layout.GetTree();
+    context.node = layout.FindNode("a");
+    std::string line = "$Card(Title,some body text)$ $Wrap(1)$ $ChildList(links)$ $NavigList()$ $Dyn(ure)$ $TreeMap()$ done";
+
+    auto countFor = [&]()
+    {
+        std::string out;
+        for (int warmUp = 0; warmUp < 2; warmUp++)
+        {
+            out.clear();
+            parser.Parse(line, context, out);
+        }
+        auto expected = out;
+        allocations = 0;
+        countAllocations = true;
+        for (int i = 0; i < 50; i++)
+        {
+            out.clear();
+            parser.Parse(line, context, out);
+        }
+        countAllocations = false;
+        Expect(out == expected, "Repeated expansions of a line differ");
+        for (auto part : {"<h2>Title on a</h2><i><b>some body text</b></i>", "<ul class=\"links\"><li>c</li></ul>", "<nav><a>a</a><a>index</a></nav>",
+                          "<b>dynamic</b>", "<li>a<ul><li>c </li></ul></li>"})
+            Expect(out.find(part) != std::string::npos, std::string("Expansion is missing ") + part);
+        return allocations;
+    };
+
+    parser.BeginRender(1);
+    Expect(countFor() == 0, "Expanding a line with cached templates allocated");
+    Expect(parser.GetCacheHits() > 0, "The pure templates should have been served from the cache");
+    parser.EnableCache(false);
+    Expect(countFor() == 0, "Expanding a line without the cache allocated");
+
+    Template card(std::vector<int>{0, 1, 0}, std::vector<std::string>{"<p>", "</p><a href=\"", "\">", "</a>"});
+    std::vector<std::string_view> cardArgs = {"some paragraph text for the card", "page00042.html"};
+    std::string out;
+    card.Parse(cardArgs, out);
+    Expect(out == "<p>some paragraph text for the card</p><a href=\"page00042.html\">some paragraph text for the card</a>", "Template::Parse expanded wrong");
+    allocations = 0;
+    countAllocations = true;
+    for (int i = 0; i < 50; i++)
+    {
+        out.clear();
+        card.Parse(cardArgs, out);
+    }
+    countAllocations = false;
+    Expect(allocations == 0, "Template::Parse into a buffer that fits allocated");
+
+    // The expansion buffers are handed from page to page: with a long argument nested two levels deep,
+    // rendering more pages once the first build warmed them up allocates nothing of that size
+    std::string longText(largeAllocation, 'x');
+    WriteFile(root / "content" / "directives" / "layout.md", "##index\n#a\n#b\n#c\n");
+    WriteFile(root / "content" / "directives" / "templates.md",
+              "# $Inner(x)\n<b>$$x$$ $PageName()$</b>\n#\n# $Outer(x)\n<i>$Inner($$x$$)$ $PageName()$</i>\n#\n");
+    for (auto page : {"index", "a", "b", "c"})
+        WriteFile(root / "content" / (std::string(page) + ".md"), "$Outer(" + longText + ")$\n");
+    auto config = TempSiteConfig(root);
+    config.incremental = false;
+    config.jobs = 1;
+    Generator generator(config);
+    generator.Render();
+    largeAllocations = 0;
+    countAllocations = true;
+    generator.Render();
+    countAllocations = false;
+    Expect(ReadFile(root / "site" / "c.html").find("<i><b>" + longText + " c</b> c</i>") != std::string::npos, "The long argument was not expanded");
+    Expect(largeAllocations == 0, "Rendering pages should reuse the expansion buffers of the previous page");
+
+    fs::remove_all(root);
+}
+
+// meengi_tests is linked with tests/fixtures/compiled/templates.md compiled by --emit-cpp (see the Makefile)
+void TestCompiledTemplatesMatchInterpreter()
+{
+    auto fixture = fs::path("./tests/fixtures/compiled/templates.md");
+    auto compiled = CompiledTemplateSet::Linked();
+    Expect(compiled != nullptr && compiled->templatesHash == HashFile(fixture.string()), "The tests should be linked with the compiled fixture templates");
+
+    auto root = TempRoot("meengi_compiled");
+    auto directives = root / "content" / "directives";
+    WriteFile(directives / "layout.md", "##index\n#a\n#b\n\n##a\n#c\n#d\n\n##c\n#e\n");
+    fs::copy_file(fixture, directives / "templates.md");
+
+    TemplateParser interpreted(fixture.string());
+    TemplateParser generated(*compiled);
+    Expect(generated.GetCompiledCount() == compiled->count && interpreted.GetCompiledCount() == 0, "Only the generated parser has compiled templates");
+    for (size_t i = 0; i < compiled->count; i++)
+    {
+        std::string name(compiled->templates[i].name);
+        Expect(generated.GetTemplateHash(name) == interpreted.GetTemplateHash(name) && generated.IsCacheable(name) == interpreted.IsCacheable(name),
+               "Compiled template " + name + " should keep its hash and purity");
+    }
+
+    std::vector<std::string> lines = {
+        "$Page(Home,Welcome *here*)$",
+        "$Card(T,B,http://x)$ and $Card(T,B)$ and $Card()$ $Twice(1)$ $Twice(1,2)$ $Twice(1,2,3)$ $Third(a)$ $Third(a,b,c,d)$",
+        "$Wrap(Bold,x)$ $Wrap(Em,y)$ $Wrap(Missing,z)$ $LoopA()$ $Logo(the logo)$",
+        "$TreeMap()$ $TreeMapPartial()$ $NavigList()$ $ChildList(plain)$ $Unknown(1)$ $5 and a lone $",
+        "$Footer()$"};
+    LayoutParser layout((directives / "layout.md").string());
+    for (bool cache : {true, false})
+    {
+        interpreted.EnableCache(cache);
+        generated.EnableCache(cache);
+        for (auto page : {"index", "a", "b", "c", "e"})
+        {
+            for (const auto &line : lines)
+            {
+                RenderContext expected;
+                RenderContext actual;
+                for (auto context : {&expected, &actual})
+                {
+                    context->layout = &layout.GetTree();
+                    context->node = layout.FindNode(page);
+                }
+                Expect(generated.Parse(line, actual) == interpreted.Parse(line, expected), "Compiled templates expand " + line + " differently");
+                Expect(actual.usedTemplates == expected.usedTemplates && actual.layoutDependencies == expected.layoutDependencies &&
+                           actual.usedAssets == expected.usedAssets && actual.templateExpansions == expected.templateExpansions &&
+                           actual.maxTemplateDepth == expected.maxTemplateDepth,
+                       "Compiled templates record something else for " + line);
+            }
+        }
+    }
+
+    // A whole site, with templates.md unchanged and then edited so that it is read again
+    for (auto page : {"index", "a", "b", "c", "d", "e"})
+        WriteFile(root / "content" / (std::string(page) + ".md"), "$Page(" + std::string(page) + ",some *text*)$\n" + lines[1] + "\n" + lines[2] + "\n" + lines[3] + "\n");
+    auto render = [&](const std::string &site)
+    {
+        auto config = TempSiteConfig(root);
+        config.outputDir = (root / site).string();
+        config.warningsFile = (root / (site + ".txt")).string();
+        BuildStats::Enable(false);
+        Generator generator(config);
+        generator.Render();
+        auto count = BuildStats::Get(Counter::CompiledTemplates);
+        BuildStats::Disable();
+        BuildStats::Reset();
+        return count;
+    };
+    Expect(render("compiled") == compiled->count, "An unchanged templates.md should be served by the compiled templates");
+    WriteFile(directives / "templates.md", ReadFile(fixture) + "\n");
+    Expect(render("interpreted") == 0, "An edited templates.md should be read again");
+    for (auto page : {"index", "a", "b", "c", "d", "e"})
+    {
+        auto file = std::string(page) + ".html";
+        Expect(ReadFile(root / "compiled" / file) == ReadFile(root / "interpreted" / file), "Compiled templates rendered " + file + " differently");
+    }
+
+    fs::remove_all(root);
+}
+
+void TestDirectiveSnapshotSkipsParsing()
+{
+    auto root = TempRoot("meengi_snapshot");
+    auto directives = root / "content" / "directives";
+    // ghost isn't listed under a page, which layout.md reports
+    WriteFile(directives / "layout.md", "##index\n#a\n#b\n\n##ghost\n#c\n");
+    WriteFile(directives / "templates.md",
+              childListTemplates + "# $Page(body)\n<p>$Bold($$body$$)$</p>\n#\n\n"
+              "# $Bold(text)\n<b>$$text$$</b>\n#\n");
+    WriteFile(root / "content" / "index.md", "$ChildList()$\n");
+    WriteFile(root / "content" / "a.md", "$Page(first)$\n");
+    WriteFile(root / "content" / "b.md", "$Page(second)$ $ChildList()$\n");
+
+    auto config = TempSiteConfig(root);
+    config.snapshotPath = (root / "site" / ".meengi-snapshot").string();
+    config.incremental = false;
+
+    auto render = [&]()
+    {
+        BuildStats::Enable(false);
+        Generator generator(config);
+        generator.Render();
+        auto count = BuildStats::Get(Counter::SnapshotLoads);
+        BuildStats::Disable();
+        BuildStats::Reset();
+        return count;
+    };
+    auto site = [&]()
+    {
+        return ReadFile(root / "site" / "index.html") + ReadFile(root / "site" / "a.html") + ReadFile(root / "site" / "b.html");
+    };
+
+    Expect(render() == 0 && fs::exists(config.snapshotPath), "The first build should parse both files and write a snapshot");
+    auto pages = site();
+    auto warnings = ReadFile(root / "warnings.txt");
+    Expect(warnings.find("ghost") != std::string::npos, "layout.md should have raised a warning");
+    Expect(render() == 2, "An unchanged build should load layout and templates from the snapshot");
+    Expect(site() == pages && ReadFile(root / "warnings.txt") == warnings, "The snapshot should render the same site and warnings");
+
+    // Only the edited file is read again
+    WriteFile(directives / "layout.md", "##index\n#b\n#a\n\n##ghost\n#c\n");
+    Expect(render() == 1, "Editing layout.md should only reload the templates");
+    Expect(ReadFile(root / "site" / "index.html") != ReadFile(root / "site" / "a.html") && site() != pages, "The edited layout should be honoured");
+    Expect(render() == 2, "The next build should load the refreshed snapshot");
+
+    // A damaged snapshot is ignored and replaced
+    auto snapshot = ReadFile(config.snapshotPath);
+    WriteFile(config.snapshotPath, snapshot.substr(0, snapshot.size() / 2));
+    pages = site();
+    Expect(render() == 0 && site() == pages, "A truncated snapshot should be ignored");
+    std::string corrupt = ReadFile(config.snapshotPath);
+    for (size_t i = 48; i < corrupt.size(); i += 7)
+        corrupt[i] = static_cast<char>(0xff);
+    WriteFile(config.snapshotPath, corrupt);
+    Expect(render() <= 2 && site() == pages, "A corrupt snapshot should not change the site");
+    Expect(render() == 2, "A rewritten snapshot should load again");
+
+    fs::remove_all(root);
+}
+
+void TestSiteWatcherRebuildsChangedPages()
+{
+    auto root = TempRoot("meengi_watch");
+    WriteFile(root / "content" / "directives" / "layout.md", "##index\n#a\n#b\n");
+    WriteFile(root / "content" / "directives" / "templates.md", "# $Page(body)\n<p>$$body$$</p>\n#\n");
+    WriteFile(root / "content" / "index.md", "index\n");
+    WriteFile(root / "content" / "a.md", "$Page(first)$\n");
+    WriteFile(root / "content" / "b.md", "$Missing()$\n");
+
+    auto config = TempSiteConfig(root);
+    config.mapFiles = false;
+
+    Generator generator(config);
+    SiteWatcher watcher(generator);
+    Expect(watcher.Build().rendered == 3, "First build should render every page");
+    auto warnings = ReadFile(root / "warnings.txt");
+
+    WriteFile(root / "content" / "a.md", "$Page(second)$\n");
+    auto summary = watcher.Rebuild({(root / "content" / "a.md").string()});
+    Expect(summary.pages == 3 && summary.rendered == 1, "Editing a.md should only re-render a");
+    Expect(ReadFile(root / "site" / "a.html") == "<p>second</p>\n", "a.html was not refreshed");
+    Expect(ReadFile(root / "warnings.txt") == warnings, "Warnings of skipped pages should be kept");
+
+    WriteFile(root / "content" / "directives" / "templates.md", "# $Page(body)\n<div>$$body$$</div>\n#\n");
+    Expect(watcher.Rebuild({config.templatesPath}).rendered == 1, "Changing $Page$ should only re-render a");
+    Expect(ReadFile(root / "site" / "a.html") == "<div>second</div>\n", "a.html does not use the new template");
+
+    // After lost events every page's markdown and both directives are read again
+    WriteFile(root / "content" / "b.md", "$Page(fixed)$\n");
+    WriteFile(root / "content" / "directives" / "templates.md", "# $Page(body)\n<span>$$body$$</span>\n#\n");
+    summary = watcher.RebuildAll();
+    Expect(summary.rendered == 2 && ReadFile(root / "site" / "b.html") == "<span>fixed</span>\n", "Rebuilding everything should pick up unreported edits");
+    WriteFile(root / "content" / "index.md", "index, edited\n");
+    Expect(watcher.Rebuild({(root / "content" / "index.md").string()}).rendered == 1, "The watcher should track sources again afterwards");
+
+    fs::remove_all(root);
+}
+
+void TestSiteWatcherReusesExpandedLines()
+{
+    auto root = TempRoot("meengi_watch_lines");
+    auto templatesPath = root / "content" / "directives" / "templates.md";
+    WriteFile(root / "content" / "directives" / "layout.md", "##index\n#a\n#b\n");
+    WriteFile(templatesPath, childListTemplates + "# $Page(body)\n<p>$$body$$</p>\n#\n");
+    WriteFile(root / "content" / "index.md", "$ChildList()$\n$Page(one)$\n$Page(two)$\n");
+    WriteFile(root / "content" / "a.md", "$Page(a)$\n");
+    WriteFile(root / "content" / "b.md", "$Page(b)$\n");
+
+    auto config = TempSiteConfig(root);
+    config.mapFiles = false;
+    auto fresh = [&]()
+    {
+        auto freshConfig = config;
+        freshConfig.outputDir = (root / "fresh").string();
+        freshConfig.warningsFile = (root / "fresh.txt").string();
+        Generator(freshConfig).Render();
+        return ReadFile(root / "fresh" / "index.html");
+    };
+
+    BuildStats::Enable(false);
+    Generator generator(config);
+    SiteWatcher watcher(generator);
+    watcher.Build();
+    auto index = (root / "content" / "index.md").string();
+
+    // Only the new and the edited line are expanded, the moved lines come from the last render
+    WriteFile(index, "intro\n$ChildList()$\n$Page(one)$\n$Page(three)$\n");
+    auto reused = BuildStats::Get(Counter::LinesReused);
+    Expect(watcher.Rebuild({index}).rendered == 1, "Editing index.md should only re-render index");
+    Expect(BuildStats::Get(Counter::LinesReused) - reused == 2, "Unchanged lines should not be expanded again");
+    Expect(ReadFile(root / "site" / "index.html") == fresh(), "Reused lines rendered index.html differently");
+
+    // The reused $ChildList$ line still counts as a use of its templates
+    WriteFile(templatesPath, "# $ChildList(items)\n<ol>$$items$$</ol>\n#\n\n# $ChildListItem(name)\n<li>$$name$$</li>\n#\n\n# $Page(body)\n<p>$$body$$</p>\n#\n");
+    reused = BuildStats::Get(Counter::LinesReused);
+    Expect(watcher.Rebuild({templatesPath.string()}).rendered == 1, "Changing $ChildList$ should re-render index");
+    Expect(BuildStats::Get(Counter::LinesReused) == reused, "Lines expanded against other templates should not be reused");
+    Expect(ReadFile(root / "site" / "index.html") == fresh(), "index.html does not use the new $ChildList$");
+
+    BuildStats::Disable();
+    BuildStats::Reset();
+    fs::remove_all(root);
+}
+
+void TestPreviewServerRendersOnDemand()
+{
+    auto root = TempRoot("meengi_serve");
+    WriteFile(root / "content" / "directives" / "layout.md", "##index\n#a\n#b\n");
+    WriteFile(root / "content" / "directives" / "templates.md", "# $Page(body)\n<p>$$body$$</p>\n#\n");
+    WriteFile(root / "content" / "index.md", "index\n");
+    WriteFile(root / "content" / "a.md", "$Page(first)$\n");
+    WriteFile(root / "content" / "b.md", "$Page(b)$\n");
+    WriteFile(root / "links" / "style.css", "body {}");
+
+    auto config = TempSiteConfig(root);
+    config.mapFiles = false;
+
+    Generator generator(config);
+    PreviewServer server(generator);
+    auto page = server.Get("/a.html");
+    Expect(page.status == 200 && page.body && *page.body == "<p>first</p>\n" && page.renderMs >= 0, "/a.html should be rendered on request");
+    Expect(*server.Get("/a?x=1").body == *page.body && *server.Get("/").body == "index\n", "/a and / should name pages too");
+    Expect(server.Renders() == 2 && server.Get("/a.html").renderMs < 0, "Pages should be served from the cache once rendered");
+
+    auto file = server.Get("/links/style.css");
+    Expect(file.status == 200 && !file.body && file.fileSize == 7 && file.contentType.find("text/css") == 0, "Files next to the content should be served");
+    Expect(server.Get("/missing.html").status == 404 && server.Get("/%2e%2e/warnings.txt").status == 400, "Unknown and escaping paths should be refused");
+    for (auto target : {"//etc/passwd", "/%2Fetc%2Fhostname", "/%2F%2Fetc/passwd", "/links/../../warnings.txt"})
+    {
+        auto escaped = server.Get(target);
+        Expect(escaped.status == 400 && escaped.filePath.empty(), std::string("Absolute paths should be refused: ") + target);
+    }
+
+    // An edited page is rendered again, the other cached ones are kept until the templates change
+    server.Get("/b.html");
+    WriteFile(root / "content" / "a.md", "$Page(second)$\n");
+    server.Invalidate({(root / "content" / "a.md").string()});
+    Expect(*server.Get("/a.html").body == "<p>second</p>\n" && server.Get("/b.html").renderMs < 0, "Only the edited page should be rendered again");
+    WriteFile(root / "content" / "directives" / "templates.md", "# $Page(body)\n<div>$$body$$</div>\n#\n");
+    server.Invalidate({config.templatesPath});
+    Expect(*server.Get("/b.html").body == "<div>b</div>\n", "A template change should drop every cached page");
+    WriteFile(root / "content" / "b.md", "$Page(fixed)$\n");
+    server.InvalidateAll();
+    Expect(*server.Get("/b.html").body == "<div>fixed</div>\n", "Invalidating everything should drop every cached page");
+
+    // A layout edit reaches pages whose pure templates embed the layout lists
+    WriteFile(root / "content" / "directives" / "templates.md",
+              "# $Footer()\n<footer>$TreeMap()$</footer>\n#\n# $TreeMap(map)\n<ul>$$map$$</ul>\n#\n"
+              "# $TreeMapTitle1(name,childMap)\n<li>$$name$$<ul>$$childMap$$</ul></li>\n#\n# $TreeMapTitle2(name,childMap)\n<li>$$name$$</li>\n#\n");
+    WriteFile(root / "content" / "a.md", "$Footer()$\n");
+    server.Invalidate({config.templatesPath, (root / "content" / "a.md").string()});
+    Expect(server.Get("/a.html").body->find("<li>b") != std::string::npos, "The footer should list the pages");
+    WriteFile(root / "content" / "directives" / "layout.md", "##index\n#a\n#b\n#c\n");
+    WriteFile(root / "content" / "c.md", "c\n");
+    server.Invalidate({config.layoutPath});
+    Expect(server.Get("/a.html").body->find("<li>c") != std::string::npos, "A layout edit should show up in $TreeMap$");
+    Expect(!fs::exists(root / "site"), "Serving should not write the output directory");
+
+    fs::remove_all(root);
+}
 } // namespace
 
 int main()
@@ -171,11 +1356,34 @@ int main()
     std::vector<TestCase> tests = {
         {"LayoutParser builds trees from configured layout", TestLayoutParserBuildsTree},
         {"TemplateParser renders declared templates", TestTemplateParserRendersSimplePage},
+        {"TemplateParser expands compiled templates", TestTemplateParserCompiledExpansion},
         {"ShortHandParser expands markdown shorthands", TestShortHandParserFormatting},
+        {"HtmlMinifier collapses whitespace outside raw elements", TestHtmlMinifierCollapsesWhitespace},
+        {"BlockParser builds blocks across lines", TestBlockParserBuildsBlocks},
+        {"ShortHandParser scanner matches regex engine on content/", TestShortHandScannerMatchesRegexOnContent},
+        {"DelimiterSet finds what find_first_of finds at every level", TestDelimiterSetMatchesFindFirstOf},
         {"FileHelpers utilities cover template helpers", TestFileHelpersUtilities},
-        {"warn() and ClearPreviousWarnings respect config", TestWarnAndClearRespectConfig},
+        {"MappedFile splits lines like getline", TestMappedFileLinesMatchGetline},
+        {"warn() and WarningSink::Clear respect config", TestWarnAndClearRespectConfig},
+        {"Warnings are buffered, deduplicated and located", TestWarningSinkBuffersAndDeduplicates},
         {"ClearPreviousFiles removes only HTML files", TestClearPreviousFilesRemovesHtml},
-        {"PageRenderer renders fixtures into output", TestPageRendererProducesOutput}};
+        {"WriteFileAtomically replaces files in one go", TestWriteFileAtomicallyReplacesFiles},
+        {"PageRenderer renders fixtures into output", TestPageRendererProducesOutput},
+        {"PageRenderer renders the same pages with --jobs", TestParallelRenderMatchesSerial},
+        {"Generators render separate sites concurrently", TestGeneratorsRenderSitesConcurrently},
+        {"PageRenderer only re-renders pages whose inputs changed", TestIncrementalRenderSkipsUnchangedPages},
+        {"TemplateParser memoizes pure templates", TestTemplateCacheMemoizesPureTemplates},
+        {"TreeMap fragments are built once per layout", TestTreeMapFragmentsAreShared},
+        {"Template expansion stops allocating once warmed up", TestTemplateExpansionDoesNotAllocate},
+        {"Templates compiled by --emit-cpp expand like the interpreter", TestCompiledTemplatesMatchInterpreter},
+        {"A directive snapshot stands in for unchanged layout.md and templates.md", TestDirectiveSnapshotSkipsParsing},
+        {"Assets are copied incrementally and fingerprinted", TestAssetsAreCopiedAndFingerprinted},
+        {"The search index covers skipped pages", TestSearchIndexFollowsPages},
+        {"Precompressed variants are only redone with their page", TestPrecompressedVariantsFollowPages},
+        {"BuildStats records phases, counters and a trace", TestBuildStatsRecordsPhasesAndTrace},
+        {"SiteWatcher re-renders only the pages an edit affects", TestSiteWatcherRebuildsChangedPages},
+        {"SiteWatcher only expands the lines an edit changed", TestSiteWatcherReusesExpandedLines},
+        {"PreviewServer renders pages on request and caches them", TestPreviewServerRendersOnDemand}};
 
     size_t passed = 0;
     size_t failed = 0;